@@ -0,0 +1,135 @@
+/* Agent-based nest choice: K new nests of given qualities and Na ants, each with its own acceptance
+threshold drawn from a distribution (see agent-ssa.h).
+
+An ant accepts nest j if quality_j >= its threshold, and the dynamics are those of multi-nestchoice.cc;
+the simulation stops when a nest reaches the quorum threshold.
+
+Usage:
+        a.out alpha alpha_s z threshold Na [qualities=1/0] [thresholds=discrete:0/0.5:0.8/0.2] [colony=stratified]
+
+thresholds= is the distribution of the thresholds: discrete:v1/v2/...:p1/p2/..., uniform:lo:hi or normal:mean:sd.
+colony=stratified gives every trial the same colony, the quantiles of the distribution (for a discrete
+distribution, the fractions of the classes of multi-nestchoice.cc up to rounding), and colony=random draws
+the thresholds of the ants of each trial independently. The defaults are the L/H model with H = 0.2, so that
+        a.out 0.1 0.1 0.3 0.5 100
+gives the point H=0.2 of Figure 4 (finite-nestchoice.cc) up to sampling error. Continuous thresholds:
+        a.out 0.1 0.1 0.3 0.5 100000 qualities=1/0.8/0.6/0.4 thresholds=normal:0.5:0.2 colony=random trials=100
+
+The parameters alpha alpha_s z threshold Na can be given as lists or ranges (see sweep.h), one output line
+per grid point:
+        alpha alpha_s z threshold Na <time to quorum> <std> <precision> <mean threshold of the ants at the chosen nest>
+The optional arguments trials=, threads=, seed=, alpha_leak=, tol= rtol= batch=, checkpoint=<file>,
+shard=i/N, cache=<dir>, daemon=, connect=, max_events= and max_seconds= are those of finite-nestchoice.cc (tol= bounds the half-width of
+both the precision and the mean threshold, which is conservative for thresholds in [0,1]); only the exact SSA
+is available.
+*/
+
+#include <iostream>
+using namespace std;
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "options.h"
+#include "sweep.h"
+#include "agent-ssa.h"
+#include "checkpoint.h"
+#include "trial-cap.h"
+#include "result-cache.h"
+#include "sweep-daemon.h"
+
+static int agent_nestchoice(int argc, char **argv) {
+
+  options opt(argc, argv);
+  if (opt.npos() != 5) {
+    cerr << "agent-nestchoice.out alpha alpha_s z threshold Na [qualities=1/0] [thresholds=discrete:0/0.5:0.8/0.2] [colony=stratified]" << endl;
+    cerr << "alpha: rate at which committed ants convert to recruits" << endl;
+    cerr << "alpha_s: rate at which ants visiting a nest that they reject move to a nest that they accept" << endl;
+    cerr << "z: initial fraction of recruiters" << endl;
+    cerr << "threshold: quorum threshold, between 0 and 1" << endl;
+    cerr << "Na: number of ants" << endl;
+    cerr << "qualities: of the new nests; thresholds: discrete:v1/v2:p1/p2, uniform:lo:hi or normal:mean:sd" << endl;
+    cerr << "colony: stratified (quantiles of the distribution) or random (drawn in every trial)" << endl;
+    usage_common_options();
+    cerr << "per-trial caps: max_events=<n> max_seconds=<s> (# capped realisations appended, see trial-cap.h)" << endl;
+    exit(8);
+  }
+
+  vector<double> qualities = threshold_dist::parse_list(opt.get_str("qualities", "1/0"));
+  agent_bins bins(qualities);
+  threshold_dist dist(opt.get_str("thresholds", "discrete:0/0.5:0.8/0.2"));
+  string colony = opt.get_str("colony", "stratified");
+  if (colony != "stratified" && colony != "random") {
+    cerr << "colony must be stratified or random" << endl;
+    exit(8);
+  }
+  if (opt.method() != SSA_AUTO) {
+    cerr << "only the exact SSA is available for the agent-based model" << endl;
+    exit(8);
+  }
+
+  unsigned long seed = sweep_seed(opt); // seed=, or that of the checkpoint file
+  cerr << "seed = " << seed << endl;
+  double alpha_leak = opt.get("alpha_leak", 0.05);
+  cerr << "leak rate = " << alpha_leak << endl;
+  cerr << "nests = " << bins.md.nests() << ", threshold bins = " << bins.md.classes() << endl;
+
+  grid g;
+  for (int i=0 ; i<5 ; i++)
+    g.add(opt.pos[i]);
+  long npoints = g.size();
+  long p;
+
+  vector<ssa_network> nets;
+  vector<vector<double> > stratified(npoints);
+  for (p=0 ; p<npoints ; p++) {
+    vector<double> v = g.point(p);
+    int Na = (int)v[4];
+    nets.push_back(kq_network(bins.md, v[0], v[1], alpha_leak, Na));
+    if (colony == "stratified")
+      stratified[p] = agent_stratified(dist, Na);
+  }
+  cerr << "reactions = " << nets[0].channels() << endl;
+
+  stop_rule rule(opt.get_long("batch", 1000), opt.get("tol", 0.0), opt.get("rtol", 0.0), true);
+  sweep_checkpoint* ckpt = sweep_checkpoint_from(opt, "agent-nestchoice", seed, npoints, rule);
+  result_cache* cache = result_cache_from(opt, "agent-nestchoice", seed, g, opt.trials());
+  chunk_store* store = (ckpt != NULL)? (chunk_store*)ckpt : cache;
+  trial_cap cap = trial_cap_from(opt);
+  long capped = 0;
+
+  auto make_trial = [&](long p) {
+    vector<double> v = g.point(p);
+    int Na = (int)v[4];
+    agent_trial trial(nets[p], bins, dist, (colony == "stratified")? &stratified[p] : NULL, v[2], Na, quorum_ants(v[3], Na));
+    trial.cap = cap;
+    return trial;
+  };
+  auto emit = [&](long p, const vector<trial_sums>& sums) {
+    vector<double> v = g.point(p);
+    cout << v[0] << " " << v[1] << " " << v[2] << " " << v[3] << " " << v[4] << " " << sums[0].t_ave() << " " << sums[0].t_std()
+	 << " " << sums[0].s_ave() << " " << sums[1].s_ave();
+    if (rule.adaptive())
+      cout << " " << sums[0].n;
+    if (cap.active())
+      cout << " " << sums[0].capped;
+    capped += sums[0].capped;
+    cout << endl;
+  };
+  run_sweep_outputs(make_trial, npoints, opt.trials(), seed, opt.threads(), emit, rule, 1, store);
+
+  if (cap.active() && (ckpt == NULL || !ckpt->sharded()))
+    cerr << capped << " realisations capped" << endl;
+  if (ckpt != NULL && ckpt->sharded())
+    cerr << "shard " << opt.get_str("shard", "") << ": " << ckpt->written << " chunks written to " << opt.get_str("checkpoint", "") << endl;
+  delete ckpt;
+  if (cache != NULL)
+    cerr << cache->hits << " chunks from the cache " << opt.get_str("cache", "") << ", " << cache->simulated << " simulated" << endl;
+  delete cache;
+  ssa_profile_report("agent-nestchoice"); // with -DSSA_PROFILE (see ssa-profile.h)
+  return 0;
+}
+
+int main (int argc, char **argv) {
+  return sweep_main(argc, argv, agent_nestchoice, "agent-nestchoice.out"); // daemon=, connect= (see sweep-daemon.h)
+}
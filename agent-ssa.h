@@ -0,0 +1,283 @@
+/* Agent-based mode of the K-nest model (agent-nestchoice.cc): every ant carries its own acceptance threshold,
+drawn from a continuous or discrete distribution.
+
+An ant accepts nest j if quality_j >= its threshold, so that its dynamics depend on its threshold only through
+the set of nests that it accepts. With the distinct qualities q_0 < ... < q_{U-1} of the K nests, the ants fall
+into U+1 threshold bins, bin b holding the thresholds in (q_{b-1}, q_b] and accepting the nests of quality
+>= q_b (bin U accepts none). The event scheduler is the SSA of the K-nest, (U+1)-class network of nest-models.h
+over the counts of the (compartment, bin) groups: its propensities are exact, an event costs O(# reactions) with
+SSA_LINEAR or O(log # reactions) with the sum trees of SSA_TREE, independent of Na. Once the group of an event
+is selected, the ant that moves is drawn uniformly from the group, which is exact because the ants of a group
+are exchangeable.
+
+The ants are stored as arrays (structure of arrays): threshold[i], group[i] and slot[i], the position of ant i
+in members[group[i]], the contiguous list of the ants of its group. Drawing and moving an ant are O(1): it is
+swapped with the last member of its group and appended to the new one.
+
+Colonies: with colony=stratified, the thresholds are the quantiles F^-1((i + 1/2)/Na), i = 0, ..., Na-1, of the
+distribution, the same in every trial, so that a two-valued distribution gives exactly the fractions of the L/H
+model; with colony=random, each trial draws the thresholds of its Na ants independently. In both cases a fraction z of
+the ants of each bin (rounded down) starts committed to (or visiting) the nests, spread evenly and drawn at random.
+
+Threshold distributions:
+    discrete:v1/v2/...:p1/p2/...      value v_i with probability p_i
+    uniform:lo:hi
+    normal:mean:sd
+*/
+
+#ifndef AGENT_SSA_H
+#define AGENT_SSA_H
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "ssa-engine.h"
+#include "nest-models.h"
+#include "trial-runner.h"
+
+struct threshold_dist {
+  int type; // 0: discrete, 1: uniform, 2: normal
+  std::vector<double> value, cum; // discrete values and cumulative probabilities
+  double a, b; // lo, hi or mean, sd
+
+  // list of values separated by "/"
+  static std::vector<double> parse_list(const std::string& s) {
+    std::vector<double> v;
+    size_t begin = 0, end;
+    while (begin <= s.size()) {
+      end = s.find('/', begin);
+      if (end == std::string::npos)
+	end = s.size();
+      v.push_back(atof(s.substr(begin, end-begin).c_str()));
+      begin = end+1;
+    }
+    return v;
+  }
+
+  threshold_dist(const std::string& spec) {
+    size_t c1 = spec.find(':'), c2 = (c1 == std::string::npos)? c1 : spec.find(':', c1+1);
+    if (c2 == std::string::npos) {
+      std::cerr << "invalid threshold distribution " << spec << std::endl;
+      exit(8);
+    }
+    std::string name = spec.substr(0, c1), first = spec.substr(c1+1, c2-c1-1), second = spec.substr(c2+1);
+    a = b = 0.0;
+    if (name == "discrete") {
+      type = 0;
+      value = parse_list(first);
+      std::vector<double> p = parse_list(second);
+      double sum = 0.0;
+      for (size_t i=0 ; i<p.size() ; i++) {
+	sum += p[i];
+	cum.push_back(sum);
+      }
+      if (p.size() != value.size() || fabs(sum - 1.0) > 1e-6) {
+	std::cerr << "discrete:v1/v2/...:p1/p2/... needs as many probabilities as values, summing to 1" << std::endl;
+	exit(8);
+      }
+      cum.back() = 1.0;
+    } else if (name == "uniform" || name == "normal") {
+      type = (name == "uniform")? 1 : 2;
+      a = atof(first.c_str());
+      b = atof(second.c_str());
+    } else {
+      std::cerr << "the threshold distribution must be discrete, uniform or normal" << std::endl;
+      exit(8);
+    }
+  }
+
+  // F^-1(u), 0 < u < 1
+  double quantile(double u) const {
+    if (type == 0)
+      return value[std::upper_bound(cum.begin(), cum.end() - 1, u) - cum.begin()];
+    if (type == 1)
+      return a + (b - a) * u;
+    double lo = -40.0, hi = 40.0, mid; // normal: bisection on the standard normal CDF
+    for (int i=0 ; i<100 ; i++) {
+      mid = (lo + hi) / 2;
+      if (0.5 * erfc(-mid / sqrt(2.0)) < u)
+	lo = mid;
+      else
+	hi = mid;
+    }
+    return a + b * (lo + hi) / 2;
+  }
+
+  template <class Rng>
+  double sample(Rng& rng) const {
+    if (type == 2) // Box-Muller
+      return a + b * sqrt(-2.0 * log(rng.uniform())) * cos(2 * M_PI * rng.uniform());
+    return quantile(rng.uniform());
+  }
+};
+
+// bins of thresholds for the qualities of the nests: the K-nest model whose classes are the bins
+struct agent_bins {
+  std::vector<double> q; // distinct qualities, ascending
+  kq_model md;
+
+  agent_bins(const std::vector<double>& quality) {
+    q = quality;
+    std::sort(q.begin(), q.end());
+    q.erase(std::unique(q.begin(), q.end()), q.end());
+    md.quality = quality;
+    md.threshold = q;
+    md.threshold.push_back(HUGE_VAL); // accepts no nest
+    md.fraction.assign(md.threshold.size(), 0.0); // not used
+  }
+
+  int bin(double threshold) const { return (int)(std::lower_bound(q.begin(), q.end(), threshold) - q.begin()); }
+};
+
+// ants of a colony, grouped by (compartment) of the K-nest model of agent_bins
+struct agent_colony {
+  std::vector<double> threshold;
+  std::vector<int> group, slot;
+  std::vector<std::vector<int> > members;
+
+  // places the ants with the given thresholds (see the header) and sets the counts x
+  template <class Rng>
+  void init(const agent_bins& bins, const std::vector<double>& thresholds, double z, int* x, Rng& rng) {
+    const kq_model& md = bins.md;
+    const int K = md.nests(), M = md.classes(), Na = (int)thresholds.size();
+    int i, j, m, k, n;
+    threshold = thresholds;
+    group.resize(Na);
+    slot.resize(Na);
+    members.resize(md.species());
+    for (i=0 ; i<md.species() ; i++) {
+      members[i].clear();
+      x[i] = 0;
+    }
+    std::vector<std::vector<int> > in_bin(M);
+    for (i=0 ; i<Na ; i++)
+      in_bin[bins.bin(threshold[i])].push_back(i);
+    for (m=0 ; m<M ; m++) {
+      std::vector<int>& ants = in_bin[m];
+      n = (int)ants.size();
+      for (i=n-1 ; i>0 ; i--) // shuffle (Fisher-Yates)
+	std::swap(ants[i], ants[std::min(i, (int)(rng.uniform() * (i+1)))]);
+      k = 0;
+      for (j=0 ; j<K ; j++)
+	for (i=0 ; i<(int)(n*z/K + 1e-8) ; i++)
+	  add(ants[k++], md.com(j, m), x);
+      while (k < n)
+	add(ants[k++], md.oldnest(m), x);
+    }
+  }
+
+  void add(int ant, int g, int* x) {
+    group[ant] = g;
+    slot[ant] = (int)members[g].size();
+    members[g].push_back(ant);
+    x[g]++;
+  }
+
+  // moves a random ant of group a to group b
+  template <class Rng>
+  void move(int a, int b, Rng& rng) {
+    std::vector<int>& from = members[a];
+    int k = std::min((int)(rng.uniform() * from.size()), (int)from.size() - 1);
+    int ant = from[k];
+    from[k] = from.back();
+    slot[from[k]] = k;
+    from.pop_back();
+    group[ant] = b;
+    slot[ant] = (int)members[b].size();
+    members[b].push_back(ant);
+  }
+
+  // mean threshold of the ants at nest j
+  double mean_threshold(const kq_model& md, int j) const {
+    double sum = 0.0;
+    long n = 0;
+    for (int m=0 ; m<md.classes() ; m++) {
+      const int g[2] = {md.com(j, m), md.rec(j, m)};
+      for (int s=0 ; s<2 ; s++)
+	for (size_t i=0 ; i<members[g[s]].size() ; i++) {
+	  sum += threshold[members[g[s]][i]];
+	  n++;
+	}
+    }
+    return (n > 0)? sum / n : NAN;
+  }
+};
+
+// stopping rule of the K-nest model that moves the ants of the colony with the events of the engine
+template <class Rng>
+struct agent_running {
+  kq_running running;
+  agent_colony* colony;
+  Rng* rng;
+  agent_running(const kq_running& running_, agent_colony* colony_, Rng* rng_) : running(running_), colony(colony_), rng(rng_) {}
+  bool operator()(const int* x) const { return running(x); }
+  int margin(const int* x) const { return running.margin(x); }
+  void moved(int a, int b) { colony->move(a, b, *rng); }
+};
+
+/* One realisation of the agent-based model, a multi-output trial for trial-runner.h (with one time per
+   realisation): output 0 has score = 1 if the nest with the most ants has the highest quality (as kq_trial),
+   output 1 the mean threshold of the ants at that nest. With an active cap (trial-cap.h), a realisation that
+   hits it is capped in both outputs. */
+struct agent_trial {
+  ssa_engine engine;
+  const agent_bins* bins;
+  const threshold_dist* dist;
+  const std::vector<double>* stratified; // thresholds of the stratified colony, NULL for random colonies
+  kq_running running;
+  trial_cap cap;
+  agent_colony colony;
+  std::vector<int> x;
+  std::vector<double> thresholds;
+  double z;
+  int Na;
+
+  agent_trial(const ssa_network& net, const agent_bins& bins_, const threshold_dist& dist_, const std::vector<double>* stratified_,
+	      double z_, int Na_, int th_quorum)
+    : engine(net, SSA_AUTO), bins(&bins_), dist(&dist_), stratified(stratified_), running(bins_.md, Na_, th_quorum),
+      x(bins_.md.species()), z(z_), Na(Na_) {}
+
+  int outputs() const { return 2; }
+
+  template <class Rng>
+  void operator()(Rng& rng, trial_outcome* out) {
+    const kq_model& md = bins->md;
+    int j, w = 0;
+    if (stratified == NULL) {
+      thresholds.resize(Na);
+      for (int i=0 ; i<Na ; i++)
+	thresholds[i] = dist->sample(rng);
+    }
+    colony.init(*bins, (stratified != NULL)? *stratified : thresholds, z, &x[0], rng);
+    agent_running<Rng> keep_going(running, &colony, &rng);
+    double t;
+    if (!cap.active())
+      t = engine.run(&x[0], rng, keep_going);
+    else {
+      cap.start();
+      t = engine.run(&x[0], rng, capped_running<agent_running<Rng> >(keep_going, &cap));
+    }
+    out[0].capped = out[1].capped = cap.hit;
+    out[0].accepted = out[1].accepted = !cap.hit && running.oldnest(&x[0]) < Na; // discarded if all ants are back in the old nest
+    out[0].t = out[1].t = t;
+    for (j=1 ; j<md.nests() ; j++)
+      if (kq_nest(md, &x[0], j) > kq_nest(md, &x[0], w))
+	w = j;
+    out[0].score = (kq_nest(md, &x[0], w) >= running.th_quorum && md.quality[w] == md.quality[md.best()])? 1.0 : 0.0;
+    out[1].score = colony.mean_threshold(md, w);
+  }
+};
+
+// thresholds of the stratified colony of Na ants
+inline std::vector<double> agent_stratified(const threshold_dist& dist, int Na) {
+  std::vector<double> th(Na);
+  for (int i=0 ; i<Na ; i++)
+    th[i] = dist.quantile((i + 0.5) / Na);
+  return th;
+}
+
+#endif // AGENT_SSA_H
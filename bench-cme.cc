@@ -0,0 +1,71 @@
+/* Exact CME solver (cme-solver.h) against the SSA on the L/H model of finite-nestchoice.cc.
+
+For Na = 20, 30, ..., 100 at the parameters of Figure 4 (alpha=0.1 alpha_s=0.1 H=0.2 z=0.3 threshold=0.5),
+reports for the SSA the time of "trials" trials and the standard errors of the mean time to quorum and of
+the precision, and for the CME solver the # reachable states, # jumps, memory, time to enumerate the states
+and time to solve, with the difference of the two results in units of the standard error of the SSA (z).
+The CME solver is skipped when the state space exceeds max_states (about 200 bytes per state).
+
+Usage:
+        a.out [trials] [max_states]
+*/
+
+#include <iostream>
+using namespace std;
+#include <cstdlib> // atoi
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include "rng.h"
+#include "nest-models.h"
+#include "trial-runner.h"
+#include "cme-solver.h"
+
+static double elapsed(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main (int argc, char **argv) {
+
+  long trials = (argc > 1)? atol(argv[1]) : 10000;
+  long max_states = (argc > 2)? atol(argv[2]) : 10000000;
+  const double alpha = 0.1, alpha_s = 0.1, alpha_leak = 0.05, H = 0.2, z = 0.3, threshold = 0.5;
+  int x[LH_COMPARTMENTS];
+
+  for (int Na=20 ; Na<=100 ; Na+=10) {
+    int th_quorum = (int)(threshold*Na);
+    ssa_network net = lh_network(alpha, alpha_s, alpha_leak, Na);
+
+    trial_sums sums;
+    lh_trial trial(net, H, z, Na, th_quorum);
+    mt_stream rng(12345);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    run_chunk(trial, rng, trials, sums);
+    double sec_ssa = elapsed(start);
+    double se_t = sums.t_std()/sqrt((double)sums.n), se_s = sums.s_std()/sqrt((double)sums.n);
+    cout << "Na=" << Na << " ssa trials=" << trials << " sec=" << sec_ssa
+	 << " t=" << sums.t_ave() << " +- " << se_t << " precision=" << sums.s_ave() << " +- " << se_s << endl;
+
+    lh_init(x, H, z, Na);
+    start = chrono::steady_clock::now();
+    cme_chain chain(net, x, lh_running(Na, th_quorum), max_states);
+    double sec_build = elapsed(start);
+    if (!chain.complete) {
+      cout << "Na=" << Na << " cme skipped: more than " << max_states << " states" << endl;
+      continue;
+    }
+    start = chrono::steady_clock::now();
+    vector<double> accepted, good, w, v;
+    chain.expect([&](const int* x) { return (lh_oldnest(x) < Na)? 1.0 : 0.0; }, accepted);
+    chain.expect([&](const int* x) { return (lh_oldnest(x) < Na && lh_good(x) >= th_quorum)? 1.0 : 0.0; }, good);
+    chain.moments(accepted, w, v);
+    double sec_solve = elapsed(start);
+    double t = w[0]/accepted[0], precision = good[0]/accepted[0];
+    cout << "Na=" << Na << " cme states=" << chain.states() << " jumps=" << chain.jumps() << " MB=" << chain.memory()/1e6
+	 << " build sec=" << sec_build << " solve sec=" << sec_solve << " sweeps=" << chain.sweeps
+	 << " t=" << t << " precision=" << precision
+	 << " z(t)=" << (sums.t_ave() - t)/se_t << " z(precision)=" << (sums.s_ave() - precision)/se_s << endl;
+  }
+
+  return 0;
+}
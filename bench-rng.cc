@@ -0,0 +1,126 @@
+/* Benchmark and checks of the random number generators of rng.h.
+
+1. Deviates per second of mt_stream and xoshiro_stream: uniform(), fill(), and exponential()
+   (-log(uniform()) for mt_stream, ziggurat for xoshiro_stream).
+2. Moments and tail probabilities of the ziggurat exponential sampler against their exact values.
+3. Events per second of the SSA engine with either generator at the parameter sets of
+    Figure 4: alpha=0.1 alpha_s=0.1 H=0.2 z=0.3 threshold=0.5 Na=100 (L/H model)
+    Figure 9: alpha=0.1 z=0.12 Na=100 Nnest=2 (N-nest model)
+   and the mean time and score with their standard errors, with the difference between the two
+   generators in units of its standard error (z), which should be O(1).
+
+Usage:
+        a.out [trials]
+*/
+
+#include <iostream>
+using namespace std;
+#include <cstdlib> // atoi
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include "rng.h"
+#include "nest-models.h"
+#include "trial-runner.h"
+
+static double elapsed(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+template <class Rng>
+static void bench_deviates(const char* name, Rng rng, long n) {
+  vector<double> buf(1000);
+  double sum = 0.0;
+  long i, j;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (i=0 ; i<n ; i++)
+    sum += rng.uniform();
+  double sec_u = elapsed(start);
+  start = chrono::steady_clock::now();
+  for (i=0 ; i<n ; i+=1000) {
+    rng.fill(&buf[0], 1000);
+    for (j=0 ; j<1000 ; j++)
+      sum += buf[j];
+  }
+  double sec_f = elapsed(start);
+  start = chrono::steady_clock::now();
+  for (i=0 ; i<n ; i++)
+    sum += rng.exponential();
+  double sec_e = elapsed(start);
+  cout << name << " uniform/sec=" << n/sec_u << " fill/sec=" << n/sec_f << " exponential/sec=" << n/sec_e
+       << " (checksum " << sum << ")" << endl;
+}
+
+template <class Rng, class Trial>
+static trial_sums run_engine(const char* fig, const char* name, Trial trial, long trials) {
+  Rng rng = Rng::for_chunk(12345, 0, 0);
+  trial_sums sums;
+  long events = 0;
+  double t, score;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  while (sums.n < trials) {
+    if (trial(rng, t, score))
+      sums.add(t, score);
+    events += trial.engine.events;
+  }
+  double sec = elapsed(start);
+  cout << fig << " " << name << " trials=" << trials << " events/sec=" << events/sec
+       << " t=" << sums.t_ave() << " +- " << sums.t_std()/sqrt((double)sums.n)
+       << " score=" << sums.s_ave() << " +- " << sums.s_std()/sqrt((double)sums.n) << endl;
+  return sums;
+}
+
+static void compare(const char* fig, const trial_sums& a, const trial_sums& b) {
+  double se_t = sqrt(a.t_std()*a.t_std()/a.n + b.t_std()*b.t_std()/b.n);
+  double se_s = sqrt(a.s_std()*a.s_std()/a.n + b.s_std()*b.s_std()/b.n);
+  cout << fig << " z(t)=" << (a.t_ave() - b.t_ave())/se_t << " z(score)=" << (a.s_ave() - b.s_ave())/se_s << endl;
+}
+
+int main (int argc, char **argv) {
+
+  long trials = (argc > 1)? atol(argv[1]) : 100000;
+  const long n = 20000000;
+
+  bench_deviates("mt19937", mt_stream(12345), n);
+  bench_deviates("xoshiro256++", xoshiro_stream(12345), n);
+
+  { // ziggurat vs exact moments and tail probabilities of the exponential distribution
+    xoshiro_stream rng(777);
+    const double thr[] = {1.0, 5.0, 8.0, 12.0};
+    double s1 = 0.0, s2 = 0.0, x;
+    long tail[4] = {0, 0, 0, 0}, i;
+    int k;
+    for (i=0 ; i<n ; i++) {
+      x = rng.exponential();
+      s1 += x;
+      s2 += x*x;
+      for (k=0 ; k<4 ; k++)
+	tail[k] += (x > thr[k]);
+    }
+    cout << "ziggurat mean=" << s1/n << " (1 +- " << 1/sqrt((double)n) << ")"
+	 << " var=" << s2/n - (s1/n)*(s1/n) << " (1 +- " << sqrt(8.0/n) << ")" << endl;
+    for (k=0 ; k<4 ; k++) {
+      double p = exp(-thr[k]);
+      cout << "ziggurat P(x>" << thr[k] << ")=" << (double)tail[k]/n << " exact=" << p
+	   << " z=" << ((double)tail[k]/n - p)/sqrt(p*(1-p)/n) << endl;
+    }
+  }
+
+  { // Figure 4
+    int Na = 100;
+    ssa_network net = lh_network(0.1, 0.1, 0.05, Na);
+    trial_sums a = run_engine<mt_stream>("fig4", "mt19937", lh_trial(net, 0.2, 0.3, Na, Na/2), trials);
+    trial_sums b = run_engine<xoshiro_stream>("fig4", "xoshiro256++", lh_trial(net, 0.2, 0.3, Na, Na/2), trials);
+    compare("fig4", a, b);
+  }
+
+  { // Figure 9
+    int Na = 100;
+    ssa_network net = nnest_network(0.1, 0.05, Na, 2);
+    trial_sums a = run_engine<mt_stream>("fig9", "mt19937", nnest_trial(net, 0.12, Na, 2), trials);
+    trial_sums b = run_engine<xoshiro_stream>("fig9", "xoshiro256++", nnest_trial(net, 0.12, Na, 2), trials);
+    compare("fig9", a, b);
+  }
+
+  return 0;
+}
@@ -0,0 +1,151 @@
+/* Micro-benchmark of the SSA engine (ssa-engine.h).
+
+Runs a fixed number of trials with a fixed seed at the parameter sets of
+    Figure 4: alpha=0.1 alpha_s=0.1 H=0.2 z=0.3 threshold=0.5 Na=100 (L/H model)
+    Figure 9: alpha=0.1 z=0.12 Na=100 Nnest={2,4,6} (N-nest model)
+and reports the number of events per second.
+Then compares the compile-time specialised kernels of the L/H model (lh_kernels of nest-models.h) with the
+generic engine at Figure 4 and with alpha_s=0, alpha_leak=0 or H=0, on the same random numbers.
+Then compares the two selection methods of the engine (SSA_LINEAR and SSA_TREE) on the N-nest model
+with alpha=0.1 z=0.3 Na=1000 and Nnest={6,20,50,200}, and runs Figures 4 and 9 with the lockstep ensemble
+of ensemble-ssa.h (method=ensemble), for which events = # steps times ENSEMBLE_LANES. Compile with
+-O3 -march=native for the ensemble to use the SIMD width of the machine.
+
+Usage:
+        a.out [trials]
+*/
+
+#include <iostream>
+using namespace std;
+#include <cstdlib> // atoi
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include "rng.h"
+#include "nest-models.h"
+#include "trial-runner.h"
+#include "ensemble-ssa.h"
+
+static double elapsed(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* name, long trials, long events, double sec) {
+  cout << name << " trials=" << trials << " events=" << events << " sec=" << sec
+       << " events/sec=" << events/sec << " trials/sec=" << trials/sec << endl;
+}
+
+int main (int argc, char **argv) {
+
+  int trials = (argc > 1)? atoi(argv[1]) : 10000;
+  mt_stream rng(12345);
+  long events;
+  int tr, Nnest;
+
+  { // Figure 4
+    int Na = 100;
+    int x[LH_COMPARTMENTS];
+    ssa_network net = lh_network(0.1, 0.1, 0.05, Na);
+    ssa_engine engine(net);
+    lh_running running(Na, (int)(0.5*Na));
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    events = 0;
+    for (tr=0 ; tr<trials ; tr++) {
+      lh_init(x, 0.2, 0.3, Na);
+      engine.run(x, rng, running);
+      events += engine.events;
+    }
+    report("fig4", trials, events, elapsed(start));
+  }
+
+  { // compile-time specialised kernels of the L/H model (lh_kernels) against the generic engine
+    int Na = 100;
+    int x[LH_COMPARTMENTS];
+    const char* names[] = {"fig4", "alpha_s=0", "alpha_leak=0", "H=0"};
+    const double alpha_s[] = {0.1, 0.0, 0.1, 0.1}, alpha_leak[] = {0.05, 0.05, 0.0, 0.05}, H[] = {0.2, 0.2, 0.2, 0.0};
+    for (int v=0 ; v<4 ; v++) {
+      ssa_network net = lh_network(0.1, alpha_s[v], alpha_leak[v], Na);
+      double t_sum[2];
+      long ev[2];
+      for (int specialised=0 ; specialised<2 ; specialised++) {
+	lh_trial trial(net, H[v], 0.3, Na, (int)(0.5*Na));
+	if (!specialised)
+	  trial.kernels.channels = 0;
+	mt_stream rng2(777); // the same draws for both
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	ev[specialised] = 0;
+	t_sum[specialised] = 0.0;
+	for (tr=0 ; tr<trials ; tr++) {
+	  trial.init(x);
+	  t_sum[specialised] += trial.kernels.run(trial.engine, x, rng2, trial.running);
+	  ev[specialised] += trial.engine.events;
+	}
+	cout << names[v] << " ";
+	report(specialised? "specialised" : "generic", trials, ev[specialised], elapsed(start));
+      }
+      if (ev[0] != ev[1] || t_sum[0] != t_sum[1])
+	cout << names[v] << ": the specialised kernel differs from the generic engine" << endl;
+    }
+  }
+
+  for (Nnest=2 ; Nnest<=6 ; Nnest+=2) { // Figure 9
+    int Na = 100;
+    int x[1+2*Nnest];
+    ssa_network net = nnest_network(0.1, 0.05, Na, Nnest);
+    ssa_engine engine(net);
+    nnest_running running(Na);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    events = 0;
+    for (tr=0 ; tr<trials ; tr++) {
+      nnest_init(x, 0.12, Na, Nnest);
+      engine.run(x, rng, running);
+      events += engine.events;
+    }
+    cout << "Nnest=" << Nnest << " ";
+    report("fig9", trials, events, elapsed(start));
+  }
+
+  const int many[] = {6, 20, 50, 200};
+  for (int m=0 ; m<4 ; m++) { // many nests
+    int Na = 1000;
+    Nnest = many[m];
+    vector<int> x(1+2*Nnest);
+    ssa_network net = nnest_network(0.1, 0.05, Na, Nnest);
+    for (int method=SSA_LINEAR ; method<=SSA_TREE ; method++) {
+      ssa_engine engine(net, method);
+      nnest_running running(Na);
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      events = 0;
+      for (tr=0 ; tr<trials/10 ; tr++) {
+	nnest_init(&x[0], 0.3, Na, Nnest);
+	engine.run(&x[0], rng, running);
+	events += engine.events;
+      }
+      cout << "Nnest=" << Nnest << " Na=" << Na << " ";
+      report((method == SSA_LINEAR)? "linear" : "tree", trials/10, events, elapsed(start));
+    }
+  }
+
+  { // Figures 4 and 9 with the lockstep ensemble
+    int Na = 100;
+    trial_sums sums;
+    ssa_network net = lh_network(0.1, 0.1, 0.05, Na);
+    ensemble_trial<lh_trial> ens(net, lh_trial(net, 0.2, 0.3, Na, (int)(0.5*Na)));
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    run_chunk(ens, rng, trials, sums);
+    cout << "lanes=" << ENSEMBLE_LANES << " ";
+    report("fig4 ensemble", trials, ens.ens.steps*ENSEMBLE_LANES, elapsed(start));
+    for (Nnest=2 ; Nnest<=6 ; Nnest+=2) {
+      trial_sums sums;
+      ssa_network net = nnest_network(0.1, 0.05, Na, Nnest);
+      ensemble_trial<nnest_trial> ens(net, nnest_trial(net, 0.12, Na, Nnest));
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      run_chunk(ens, rng, trials, sums);
+      cout << "Nnest=" << Nnest << " lanes=" << ENSEMBLE_LANES << " ";
+      report("fig9 ensemble", trials, ens.ens.steps*ENSEMBLE_LANES, elapsed(start));
+    }
+  }
+
+  ssa_profile_report("bench-ssa"); // with -DSSA_PROFILE (see ssa-profile.h)
+  return 0;
+}
@@ -0,0 +1,65 @@
+/* Validation benchmark of the approximate methods of ssa-engine.h (SSA_TAU and SSA_HYBRID)
+against the exact SSA.
+
+For Na = 100, 1000, 10000, runs a fixed number of trials with a fixed seed at
+    Figure 4: alpha=0.1 alpha_s=0.1 H=0.2 z=0.3 threshold=0.5 (L/H model)
+    Figure 9: alpha=0.1 z=0.12 Nnest=2 (N-nest model)
+and reports, for each method, the mean time and mean score (precision or cohesion) with their
+standard errors, the wall time, and the speedup over the exact SSA.
+
+Usage:
+        a.out [trials]
+*/
+
+#include <iostream>
+using namespace std;
+#include <cstdlib> // atoi
+#include <cmath>
+#include <chrono>
+#include "rng.h"
+#include "nest-models.h"
+#include "trial-runner.h"
+
+static const char* method_name[] = {"linear", "tree", "exact", "tau", "hybrid"};
+
+template <class Trial>
+static double bench(const char* model, int Na, int method, Trial trial, long trials, double exact_sec) {
+  mt_stream rng(12345 + method);
+  trial_sums sums;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  run_chunk(trial, rng, trials, sums);
+  double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout << model << " Na=" << Na << " " << method_name[method]
+       << " t=" << sums.t_ave() << " +- " << sums.t_std()/sqrt((double)sums.n)
+       << " score=" << sums.s_ave() << " +- " << sums.s_std()/sqrt((double)sums.n)
+       << " sec=" << sec;
+  if (exact_sec > 0.0)
+    cout << " speedup=" << exact_sec/sec;
+  cout << endl;
+  return sec;
+}
+
+int main (int argc, char **argv) {
+
+  long trials = (argc > 1)? atol(argv[1]) : 1000;
+  const int methods[] = {SSA_TAU, SSA_HYBRID};
+  int Na, m;
+  double exact_sec;
+
+  for (Na=100 ; Na<=10000 ; Na*=10) { // Figure 4
+    ssa_network net = lh_network(0.1, 0.1, 0.05, Na);
+    exact_sec = bench("fig4", Na, SSA_AUTO, lh_trial(net, 0.2, 0.3, Na, Na/2, SSA_AUTO), trials, 0.0);
+    for (m=0 ; m<2 ; m++)
+      bench("fig4", Na, methods[m], lh_trial(net, 0.2, 0.3, Na, Na/2, methods[m]), trials, exact_sec);
+  }
+
+  for (Na=100 ; Na<=10000 ; Na*=10) { // Figure 9
+    ssa_network net = nnest_network(0.1, 0.05, Na, 2);
+    exact_sec = bench("fig9", Na, SSA_AUTO, nnest_trial(net, 0.12, Na, 2, SSA_AUTO), trials, 0.0);
+    for (m=0 ; m<2 ; m++)
+      bench("fig9", Na, methods[m], nnest_trial(net, 0.12, Na, 2, methods[m]), trials, exact_sec);
+  }
+
+  ssa_profile_report("bench-tauleap"); // with -DSSA_PROFILE (see ssa-profile.h)
+  return 0;
+}
@@ -0,0 +1,109 @@
+# Fixed-seed benchmark suite, run by "cmake --build <dir> --target bench" (see CMakeLists.txt).
+#
+# Times every workload below with the optimised driver, then runs it again with the same seed with the
+# instrumented build (<driver>-profile.out, -DSSA_PROFILE), whose JSON report gives the # events and trials:
+# with the same seed, both builds simulate the same trajectories. Prints one line per workload,
+#     <workload> trials=<n> events=<n> sec=<s> events/sec=<n> trials/sec=<n>
+# followed by the outputs of bench-ssa.out and bench-rng.out.
+#
+#     cmake -DBIN_DIR=<dir of the executables> [-DTRIALS_SCALE=<k>] -P bench.cmake
+#
+# TRIALS_SCALE (1 by default) multiplies the # trials of every workload.
+
+cmake_minimum_required(VERSION 3.13)
+
+if(NOT BIN_DIR)
+  message(FATAL_ERROR "usage: cmake -DBIN_DIR=<dir of the executables> -P bench.cmake")
+endif()
+if(NOT TRIALS_SCALE)
+  set(TRIALS_SCALE 1)
+endif()
+set(SEED 12345)
+
+# name|driver|arguments|trials
+set(workloads
+  "fig4|finite-nestchoice|0.1 0.1 0.06667,0.13334,0.2,0.26667,0.33334,0.4 0.3 0.5 100|20000"
+  "fig4-hybrid-Na10000|finite-nestchoice|0.1 0.1 0.2 0.3 0.5 10000 method=hybrid|200"
+  "fig9|cohesion-tradeoff|0.1 0.02:0.4:0.02 100 2|5000"
+  "fig9-Nnest6|cohesion-tradeoff|0.1 0.06:0.36:0.06 100 6|5000"
+  "fig6|speed-accuracy-coef|0 alpha_s=0.1 single_pass=1|2000"
+  "multi-2x2|multi-nestchoice|0.1 0.1 0.3 0.5 100|20000"
+  "multi-10x20-Na1000|multi-nestchoice|0.1 0.1 0.3 0.5 1000 qualities=0.1:1:0.1 thresholds=0:0.95:0.05|100")
+
+# microseconds since the epoch (seconds before CMake 3.23, which has no %f)
+function(now_usec out)
+  if(CMAKE_VERSION VERSION_LESS 3.23)
+    string(TIMESTAMP s "%s")
+    math(EXPR us "${s} * 1000000")
+  else()
+    string(TIMESTAMP us "%s%f")
+  endif()
+  set(${out} ${us} PARENT_SCOPE)
+endfunction()
+
+# integer value of a number printed by the profile (e.g. 1.23457e+07)
+function(to_integer value out)
+  if(value MATCHES "^([0-9]+)\\.?([0-9]*)e\\+?([0-9]+)$")
+    set(digits "${CMAKE_MATCH_1}${CMAKE_MATCH_2}")
+    string(LENGTH "${CMAKE_MATCH_2}" decimals)
+    math(EXPR zeros "${CMAKE_MATCH_3} - ${decimals}")
+    while(zeros GREATER 0)
+      string(APPEND digits "0")
+      math(EXPR zeros "${zeros} - 1")
+    endwhile()
+    math(EXPR v "${digits}")
+  elseif(value MATCHES "^([0-9]+)")
+    set(v ${CMAKE_MATCH_1})
+  else()
+    set(v 0)
+  endif()
+  set(${out} ${v} PARENT_SCOPE)
+endfunction()
+
+# s.ddd from microseconds
+function(format_sec us out)
+  math(EXPR s "${us} / 1000000")
+  math(EXPR ms "(${us} % 1000000) / 1000 + 1000")
+  string(SUBSTRING ${ms} 1 3 ms)
+  set(${out} "${s}.${ms}" PARENT_SCOPE)
+endfunction()
+
+foreach(w ${workloads})
+  string(REPLACE "|" ";" fields "${w}")
+  list(GET fields 0 name)
+  list(GET fields 1 driver)
+  list(GET fields 2 args)
+  list(GET fields 3 trials)
+  separate_arguments(argv UNIX_COMMAND "${args}")
+  math(EXPR trials "${trials} * ${TRIALS_SCALE}")
+
+  now_usec(t0)
+  execute_process(COMMAND ${BIN_DIR}/${driver}.out ${argv} trials=${trials} seed=${SEED}
+    RESULT_VARIABLE rc OUTPUT_QUIET ERROR_QUIET)
+  now_usec(t1)
+  if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "${name}: ${driver}.out failed (${rc})")
+  endif()
+  math(EXPR us "${t1} - ${t0}")
+  if(us LESS 1)
+    set(us 1)
+  endif()
+
+  execute_process(COMMAND ${BIN_DIR}/${driver}-profile.out ${argv} trials=${trials} seed=${SEED}
+    RESULT_VARIABLE rc OUTPUT_QUIET ERROR_VARIABLE report)
+  if(NOT rc EQUAL 0 OR NOT report MATCHES "\"trials\": {\"accepted\": ([0-9]+), \"rejected\": ([0-9]+)}, \"runs\": [0-9]+, \"events\": ([0-9.e+]+)")
+    message(FATAL_ERROR "${name}: no profile from ${driver}-profile.out")
+  endif()
+  math(EXPR n "${CMAKE_MATCH_1} + ${CMAKE_MATCH_2}")
+  to_integer(${CMAKE_MATCH_3} events)
+
+  format_sec(${us} sec)
+  math(EXPR events_per_sec "${events} * 1000000 / ${us}")
+  math(EXPR trials_per_sec "${n} * 1000000 / ${us}")
+  message("${name} trials=${n} events=${events} sec=${sec} events/sec=${events_per_sec} trials/sec=${trials_per_sec}")
+endforeach()
+
+math(EXPR trials "2000 * ${TRIALS_SCALE}")
+execute_process(COMMAND ${BIN_DIR}/bench-ssa.out ${trials})
+math(EXPR trials "20000 * ${TRIALS_SCALE}")
+execute_process(COMMAND ${BIN_DIR}/bench-rng.out ${trials})
@@ -0,0 +1,233 @@
+/* Checkpoint/resume and sharded sweeps for trial-runner.h.
+
+The trials of chunk c of grid point p are simulated with the generator Rng::for_chunk(seed, p, c), so a chunk
+is fully determined by (seed, p, c) and the state of a sweep is the set of finished chunks with their partial
+sums. With
+        checkpoint=<file>
+the runner appends the partial sums of every finished chunk to <file> and flushes it. If <file> exists, its
+chunks are not simulated again, and the sweep continues where it was interrupted (a chunk that was running
+is simulated again from its own generator). The partial sums are still reduced in chunk order, so the output
+of a resumed sweep is identical to that of an uninterrupted one. Without seed=, the seed of the file is used.
+
+With
+        shard=i/N checkpoint=<file> seed=<seed>
+the process simulates only the chunks c with c % N == i of every grid point and writes them to <file>,
+without printing results, so that N processes, e.g., on different nodes of a cluster, share a sweep.
+sweep-merge.cc combines the files of the shards into one, and running the driver with the same arguments and
+checkpoint=<merged file> prints the results (without simulating anything if all the chunks are there),
+identical to those of one process. The adaptive mode (tol=, rtol=) needs the sums of all the earlier
+chunks of a point to decide whether to go on, so it cannot be sharded; it can be checkpointed.
+
+File format (native byte order):
+    header      char magic[8] = "ANTCKPT2", uint64 signature, uint64 seed, int64 npoints, int64 trials
+    records     uint32 point, uint32 chunk, uint32 # outputs, then per output
+                int64 n, int64 rejected, int64 capped, double t, t2, s, s2 (trial_sums)
+Files of the first version ("ANTCKPT1", without capped) are still read, and resumed in their own format.
+The signature is a hash of the driver and of its arguments except threads=, seed=, checkpoint= and shard=,
+so that the chunks of different sweeps are never mixed. A record cut short by a killed process is dropped.
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <unistd.h> // truncate
+#include "options.h"
+#include "trial-runner.h"
+
+struct checkpoint_header {
+  uint64_t signature, seed;
+  int64_t npoints, trials;
+};
+
+struct sweep_checkpoint : chunk_store {
+  FILE* f;
+  checkpoint_header head;
+  int version; // of the file format, 1 or 2
+  int shard, nshards;
+  std::map<std::pair<long, long>, std::vector<trial_sums> > chunks; // loaded from the file, not yet used
+  long written;
+  std::mutex mtx;
+
+  // reads the header and the records of a file; false if it does not exist or is not a checkpoint.
+  // valid_bytes is the length of the complete records, version that of the format.
+  static bool read(const char* path, checkpoint_header& head, std::map<std::pair<long, long>, std::vector<trial_sums> >& chunks,
+		   long& valid_bytes, int& version) {
+    FILE* g = fopen(path, "rb");
+    char magic[8];
+    if (g == NULL)
+      return false;
+    if (fread(magic, 1, 8, g) != 8 || memcmp(magic, "ANTCKPT", 7) != 0 || (magic[7] != '1' && magic[7] != '2')
+	|| fread(&head, sizeof(head), 1, g) != 1) {
+      fclose(g);
+      return false;
+    }
+    version = magic[7] - '0';
+    const int ncounts = (version == 1)? 2 : 3;
+    valid_bytes = ftell(g);
+    uint32_t rec[3];
+    int64_t counts[3] = {0, 0, 0};
+    double moments[4];
+    while (fread(rec, sizeof(uint32_t), 3, g) == 3) {
+      std::vector<trial_sums> sums(rec[2]);
+      uint32_t k;
+      for (k=0 ; k<rec[2] ; k++) {
+	if (fread(counts, sizeof(int64_t), ncounts, g) != (size_t)ncounts || fread(moments, sizeof(double), 4, g) != 4)
+	  break;
+	sums[k].n = counts[0];
+	sums[k].rejected = counts[1];
+	sums[k].capped = counts[2];
+	sums[k].t = moments[0];
+	sums[k].t2 = moments[1];
+	sums[k].s = moments[2];
+	sums[k].s2 = moments[3];
+      }
+      if (k < rec[2])
+	break;
+      chunks[std::make_pair((long)rec[0], (long)rec[1])] = sums;
+      valid_bytes = ftell(g);
+    }
+    fclose(g);
+    return true;
+  }
+
+  // opens path for appending; the chunks already in the file are loaded
+  sweep_checkpoint(const char* path, const checkpoint_header& head_, int shard_ = 0, int nshards_ = 1)
+    : head(head_), version(2), shard(shard_), nshards(nshards_), written(0) {
+    checkpoint_header old;
+    long valid_bytes;
+    if (read(path, old, chunks, valid_bytes, version)) {
+      if (old.signature != head.signature || old.seed != head.seed || old.npoints != head.npoints || old.trials != head.trials) {
+	std::cerr << path << " is the checkpoint of another sweep (different arguments or seed)" << std::endl;
+	exit(8);
+      }
+      if (truncate(path, valid_bytes) != 0) { // drop a record cut short
+	std::cerr << "cannot truncate " << path << std::endl;
+	exit(8);
+      }
+      f = fopen(path, "ab");
+      std::cerr << chunks.size() << " chunks restored from " << path << std::endl;
+    } else {
+      f = fopen(path, "wb");
+      if (f != NULL) {
+	write_header(f, head);
+	fflush(f);
+      }
+    }
+    if (f == NULL) {
+      std::cerr << "cannot write " << path << std::endl;
+      exit(8);
+    }
+  }
+
+  ~sweep_checkpoint() { fclose(f); }
+
+  bool sharded() const { return nshards > 1; }
+  bool mine(long c) const { return c % nshards == shard; }
+
+  // partial sums of chunk c of point p if they were loaded from the file
+  bool restore(long p, long c, std::vector<trial_sums>& sums) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::map<std::pair<long, long>, std::vector<trial_sums> >::iterator it = chunks.find(std::make_pair(p, c));
+    if (it == chunks.end())
+      return false;
+    sums.swap(it->second);
+    chunks.erase(it);
+    return true;
+  }
+
+  // header of a new file, in the current format
+  static void write_header(FILE* g, const checkpoint_header& head) {
+    fwrite("ANTCKPT2", 1, 8, g);
+    fwrite(&head, sizeof(head), 1, g);
+  }
+
+  static void write_record(FILE* g, long p, long c, const std::vector<trial_sums>& sums, int version = 2) {
+    uint32_t rec[3] = {(uint32_t)p, (uint32_t)c, (uint32_t)sums.size()};
+    fwrite(rec, sizeof(uint32_t), 3, g);
+    for (size_t k=0 ; k<sums.size() ; k++) {
+      int64_t counts[3] = {sums[k].n, sums[k].rejected, sums[k].capped};
+      double moments[4] = {sums[k].t, sums[k].t2, sums[k].s, sums[k].s2};
+      fwrite(counts, sizeof(int64_t), (version == 1)? 2 : 3, g);
+      fwrite(moments, sizeof(double), 4, g);
+    }
+  }
+
+  void save(long p, long c, const std::vector<trial_sums>& sums) {
+    std::lock_guard<std::mutex> lock(mtx);
+    write_record(f, p, c, sums, version);
+    fflush(f);
+    written++;
+  }
+};
+
+// 64-bit FNV-1a hash of the driver name and of the arguments that define the sweep
+inline uint64_t sweep_signature(const options& opt, const char* driver) {
+  std::string s(driver);
+  uint64_t h = 14695981039346656037ULL;
+  size_t i;
+  for (i=0 ; i<opt.pos.size() ; i++)
+    s += std::string(" ") + opt.pos[i];
+  for (std::map<std::string, std::string>::const_iterator it=opt.kv.begin() ; it!=opt.kv.end() ; ++it)
+    if (it->first != "threads" && it->first != "seed" && it->first != "checkpoint" && it->first != "shard")
+      s += " " + it->first + "=" + it->second;
+  for (i=0 ; i<s.size() ; i++)
+    h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+  return h;
+}
+
+// seed of the run: seed= if given, else the seed of an existing checkpoint file, else 1 with cache=
+// (see result-cache.h), else a fresh one
+inline unsigned long sweep_seed(const options& opt) {
+  checkpoint_header head;
+  std::map<std::pair<long, long>, std::vector<trial_sums> > chunks;
+  long valid_bytes;
+  int version;
+  if (!opt.has("seed") && opt.has("checkpoint") && sweep_checkpoint::read(opt.get_str("checkpoint", "").c_str(), head, chunks, valid_bytes, version))
+    return (unsigned long)head.seed;
+  if (opt.has("shard") && !opt.has("seed")) {
+    std::cerr << "shard= needs the same seed= in all shards" << std::endl;
+    exit(8);
+  }
+  if (opt.has("cache") && !opt.has("seed"))
+    return 1;
+  return opt.seed();
+}
+
+// checkpoint of the options checkpoint= and shard=, NULL if neither is given
+inline sweep_checkpoint* sweep_checkpoint_from(const options& opt, const char* driver, unsigned long seed, long npoints,
+					       const stop_rule& rule) {
+  int shard = 0, nshards = 1;
+  if (opt.has("shard")) {
+    if (sscanf(opt.get_str("shard", "").c_str(), "%d/%d", &shard, &nshards) != 2 || nshards < 1 || shard < 0 || shard >= nshards) {
+      std::cerr << "shard must be i/N with 0 <= i < N" << std::endl;
+      exit(8);
+    }
+    if (!opt.has("checkpoint")) {
+      std::cerr << "shard= needs checkpoint=<file> for the results of the shard" << std::endl;
+      exit(8);
+    }
+    if (rule.adaptive()) {
+      std::cerr << "the adaptive mode (tol=, rtol=) cannot be sharded" << std::endl;
+      exit(8);
+    }
+  }
+  if (!opt.has("checkpoint"))
+    return NULL;
+  checkpoint_header head;
+  head.signature = sweep_signature(opt, driver);
+  head.seed = seed;
+  head.npoints = npoints;
+  head.trials = opt.trials();
+  return new sweep_checkpoint(opt.get_str("checkpoint", "").c_str(), head, shard, nshards);
+}
+
+#endif // CHECKPOINT_H
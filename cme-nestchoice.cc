@@ -0,0 +1,92 @@
+/* nest-choice: exact mean time to quorum and precision of the L/H model from the chemical master equation
+
+Computes, for small colonies, the quantities that finite-nestchoice.cc estimates from trials: the mean and
+standard deviation of the time to quorum and the precision, conditioned on the realisations in which a
+nest reaches the quorum before all ants are back in the old nest (the realisations that finite-nestchoice.cc
+keeps). The reachable states are enumerated and the absorption statistics are solved for (see cme-solver.h),
+so the results have no sampling error. The number of states grows roughly as Na^7 at the parameters of
+Figure 4 (3*10^4 states at Na=20, 1.8*10^7 at Na=50; see bench-cme.cc), which limits the method to Na of a
+few tens on a workstation.
+
+The arguments and the output are those of finite-nestchoice.cc, and each can be a list or a range (see sweep.h):
+        a.out alpha alpha_s H z threshold Na
+e.g., the first points of Figure 4 with 30 ants
+        a.out 0.1 0.1 0.06667,0.13334,0.2 0.3 0.5 30
+
+The optional argument
+        tol=1e-12 max_states=50000000
+set the relative tolerance of the Gauss-Seidel iterations and the largest # states (about 200 bytes each). The # states, # jumps, memory and times are
+written to stderr.
+*/
+
+
+#include <iostream>
+using namespace std;
+#include <cstdlib> // atoi
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include "options.h"
+#include "sweep.h"
+#include "nest-models.h"
+#include "cme-solver.h"
+
+int main (int argc, char **argv) {
+
+  options opt(argc, argv);
+  if (opt.npos() != 6) {
+    cerr << "cme-nestchoice.out alpha alpha_s H z threshold Na [alpha_leak=0.05] [tol=1e-12] [max_states=50000000]" << endl;
+    cerr << "alpha: rate at which committed ants convert to recruits, common to low-threshold and high-threshold ants" << endl;
+    cerr << "alpha_s: rate at which high-threshold ants visiting the poor nest moves to the good nest" << endl;
+    cerr << "H: fraction of high-threshold ants" << endl;
+    cerr << "z: initial fraction of recruiters" << endl;
+    cerr << "threshold: quorum threshold, between 0 and 1" << endl;
+    cerr << "Na: number of ants" << endl;
+    exit(8);
+  }
+
+  double alpha_leak = opt.get("alpha_leak", 0.05);
+  cerr << "leak rate = " << alpha_leak << endl;
+  double tol = opt.get("tol", 1e-12);
+  long max_states = opt.get_long("max_states", 50000000);
+
+  grid g;
+  for (int i=0 ; i<6 ; i++)
+    g.add(opt.pos[i]);
+  int x[LH_COMPARTMENTS];
+
+  for (long p=0 ; p<g.size() ; p++) {
+    vector<double> v = g.point(p);
+    int Na = (int)v[5];
+    int th_quorum = quorum_ants(v[4], Na);
+    ssa_network net = lh_network(v[0], v[1], alpha_leak, Na);
+    lh_init(x, v[2], v[3], Na);
+    lh_running running(Na, th_quorum);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    cme_chain chain(net, x, running, max_states);
+    if (!chain.complete) {
+      cerr << "more than " << max_states << " reachable states for Na=" << Na << "; increase max_states or use finite-nestchoice.cc" << endl;
+      exit(8);
+    }
+    double sec_build = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+    vector<double> accepted, good, w, v2;
+    // realisations kept by finite-nestchoice.cc, and those in which the good nest reached the quorum
+    chain.expect([&](const int* x) { return (lh_oldnest(x) < Na)? 1.0 : 0.0; }, accepted, tol);
+    chain.expect([&](const int* x) { return (lh_oldnest(x) < Na && lh_good(x) >= th_quorum)? 1.0 : 0.0; }, good, tol);
+    chain.moments(accepted, w, v2, tol);
+    double sec_solve = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    double t_quorum_ave = w[0] / accepted[0]; // time to quorum
+    double t_quorum_std = sqrt(v2[0] / accepted[0] - t_quorum_ave*t_quorum_ave);
+    double precision = good[0] / accepted[0]; // % correct collective decision
+    cout << v[2] << " " << v[1] << " " << v[3] << " " << v[4] << " " << t_quorum_ave << " " << t_quorum_std << " " << precision << endl;
+    cerr << "Na=" << Na << " states=" << chain.states() << " jumps=" << chain.jumps() << " MB=" << chain.memory()/1e6
+	 << " build sec=" << sec_build << " solve sec=" << sec_solve << " sweeps=" << chain.sweeps
+	 << " P(quorum)=" << accepted[0] << endl;
+  }
+
+  return 0;
+}
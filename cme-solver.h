@@ -0,0 +1,192 @@
+/* Exact first-passage statistics of a reaction network (ssa-engine.h) from its chemical master equation.
+
+For a small colony, the states reachable from the initial state are finite because the # ants is conserved,
+and the states where keep_going(x) of ssa_engine::run is false (or no reaction can fire) are absorbing.
+The reachable states are enumerated breadth first. A state is encoded as a 64-bit integer with a field of
+ceil(log2(Na+1)) bits per compartment, and a hash table maps the codes to the indices of the states.
+The embedded jump chain of the transient states is stored in compressed sparse rows: the exit rate a_i
+and the jump probabilities p_ij = a_ij / a_i.
+
+The statistics at absorption are solutions of linear systems with the matrix I - P of the transient states:
+    u_i = sum_j p_ij u_j                  u_j = f(x_j) at the absorbing states  (u = E[f(X_T)])
+    w_i = u_i / a_i + sum_j p_ij w_j      w_j = 0 at the absorbing states       (w = E[T f(X_T)])
+    v_i = 2 w_i / a_i + sum_j p_ij v_j    v_j = 0 at the absorbing states       (v = E[T^2 f(X_T)])
+The second and third follow from T = tau + T', where the holding time tau ~ Exp(a_i) is independent of the
+jump and of T'. The systems are solved by Gauss-Seidel sweeps in reverse breadth-first order, so that a
+state is updated after most of its successors, until the largest change in a sweep is below tol times the
+largest value.
+
+Memory grows with the # reachable states, which is polynomial in Na with the # compartments minus the # conserved
+quantities as the degree (see bench-cme.cc), so the method is for small colonies and complements the SSA.
+*/
+
+#ifndef CME_SOLVER_H
+#define CME_SOLVER_H
+
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <stdint.h>
+#include "ssa-engine.h"
+
+struct cme_chain {
+  const ssa_network& net;
+  int bits; // bits per compartment in a code
+  std::vector<uint64_t> code; // state i, in breadth-first order from the initial state
+  std::unordered_map<uint64_t, int> index;
+  std::vector<char> transient;
+  std::vector<double> a0; // exit rate of the transient states
+  std::vector<long> row; // jumps of state i are row[i], ..., row[i+1]-1
+  std::vector<int> col;
+  std::vector<double> prob;
+  long sweeps; // # Gauss-Seidel sweeps of all solves so far
+  bool complete; // false if the enumeration stopped at max_states
+
+  uint64_t encode(const int* x) const {
+    uint64_t c = 0;
+    for (int s=net.n_species-1 ; s>=0 ; s--)
+      c = (c << bits) | (uint64_t)x[s];
+    return c;
+  }
+  void decode(uint64_t c, int* x) const {
+    for (int s=0 ; s<net.n_species ; s++) {
+      x[s] = (int)(c & ((1ULL << bits) - 1));
+      c >>= bits;
+    }
+  }
+
+  // enumerates the states reachable from x0; gives up (complete = false) beyond max_states states
+  template <class Cont>
+  cme_chain(const ssa_network& net_, const int* x0, Cont keep_going, long max_states = 50000000)
+    : net(net_), sweeps(0), complete(true) {
+    int ns = net.n_species, nc = net.channels(), c, s;
+    std::vector<int> x(ns);
+    std::vector<double> P(net.pool_members.size()), a(nc);
+    size_t i, m;
+    for (bits=1 ; (1 << bits) <= net.Na ; bits++)
+      ;
+    if (bits * ns > 64) {
+      std::cerr << "cme_chain: " << ns << " compartments of " << bits << " bits do not fit in 64 bits" << std::endl;
+      exit(8);
+    }
+    code.push_back(encode(x0));
+    index[code[0]] = 0;
+    row.push_back(0);
+    for (i=0 ; i<code.size() && complete ; i++) { // breadth first: code grows while it is scanned
+      decode(code[i], &x[0]);
+      double sum = 0.0;
+      for (m=0 ; m<P.size() ; m++) {
+	P[m] = 0.0;
+	for (size_t j=0 ; j<net.pool_members[m].size() ; j++)
+	  P[m] += x[net.pool_members[m][j]];
+	P[m] /= net.Na;
+      }
+      for (c=0 ; c<nc ; c++) {
+	a[c] = net.k[c] * x[net.from[c]] * ((net.pool[c] >= 0)? P[net.pool[c]] : 1.0);
+	sum += a[c];
+      }
+      bool tr = keep_going(&x[0]) && sum > 0.0;
+      transient.push_back(tr);
+      a0.push_back(tr? sum : 0.0);
+      for (c=0 ; tr && c<nc ; c++) {
+	if (a[c] == 0.0)
+	  continue;
+	x[net.from[c]]--;
+	x[net.to[c]]++;
+	uint64_t cj = encode(&x[0]);
+	x[net.from[c]]++;
+	x[net.to[c]]--;
+	std::unordered_map<uint64_t, int>::iterator it = index.find(cj);
+	int j;
+	if (it == index.end()) {
+	  if ((long)code.size() >= max_states) {
+	    complete = false;
+	    break;
+	  }
+	  j = (int)code.size();
+	  index[cj] = j;
+	  code.push_back(cj);
+	} else
+	  j = it->second;
+	// the same target from two channels (e.g., recruitment by two pools) is one jump
+	for (s=(int)row.back() ; s<(int)col.size() && col[s]!=j ; s++)
+	  ;
+	if (s < (int)col.size())
+	  prob[s] += a[c] / sum;
+	else {
+	  col.push_back(j);
+	  prob.push_back(a[c] / sum);
+	}
+      }
+      row.push_back((long)col.size());
+    }
+  }
+
+  long states() const { return (long)code.size(); }
+  long jumps() const { return (long)col.size(); }
+
+  // approximate memory of the chain (states, hash table and sparse rows) in bytes
+  double memory() const {
+    return code.size() * (sizeof(uint64_t) + sizeof(char) + sizeof(double) + sizeof(long))
+      + index.bucket_count() * sizeof(void*) + index.size() * (sizeof(uint64_t) + sizeof(int) + 2*sizeof(void*))
+      + col.size() * (sizeof(int) + sizeof(double));
+  }
+
+  // solves y_i = b_i + sum_j p_ij y_j for the transient states; y holds the values of the absorbing states
+  void solve(const std::vector<double>& b, std::vector<double>& y, double tol, long max_sweeps) {
+    long i, s;
+    double yi, change, scale;
+    for (long k=1 ; k<=max_sweeps ; k++, sweeps++) {
+      change = scale = 0.0;
+      for (i=states()-1 ; i>=0 ; i--) {
+	if (!transient[i])
+	  continue;
+	yi = b[i];
+	for (s=row[i] ; s<row[i+1] ; s++)
+	  yi += prob[s] * y[col[s]];
+	change = std::max(change, fabs(yi - y[i]));
+	scale = std::max(scale, fabs(yi));
+	y[i] = yi;
+      }
+      if (change <= tol * scale) {
+	sweeps++;
+	return;
+      }
+    }
+    std::cerr << "cme_chain: no convergence after " << max_sweeps << " sweeps" << std::endl;
+  }
+
+  // u = E[f(X_T)] from every state, where f(x) is evaluated at the absorbing state X_T
+  template <class F>
+  void expect(F f, std::vector<double>& u, double tol = 1e-12, long max_sweeps = 1000000) {
+    long n = states(), i;
+    std::vector<int> x(net.n_species);
+    u.assign(n, 0.0);
+    for (i=0 ; i<n ; i++)
+      if (!transient[i]) {
+	decode(code[i], &x[0]);
+	u[i] = f(&x[0]);
+      }
+    solve(std::vector<double>(n, 0.0), u, tol, max_sweeps);
+  }
+
+  // w = E[T f(X_T)] and v = E[T^2 f(X_T)] from every state, given u = E[f(X_T)] of expect()
+  void moments(const std::vector<double>& u, std::vector<double>& w, std::vector<double>& v,
+	       double tol = 1e-12, long max_sweeps = 1000000) {
+    long n = states(), i;
+    std::vector<double> b(n, 0.0);
+    w.assign(n, 0.0);
+    v.assign(n, 0.0);
+    for (i=0 ; i<n ; i++)
+      b[i] = transient[i]? u[i] / a0[i] : 0.0;
+    solve(b, w, tol, max_sweeps);
+    for (i=0 ; i<n ; i++)
+      b[i] = transient[i]? 2.0 * w[i] / a0[i] : 0.0;
+    solve(b, v, tol, max_sweeps);
+  }
+};
+
+#endif // CME_SOLVER_H
@@ -1,178 +1,240 @@
 /* Cohesion tradeoff when all new nests are of equal quality.
    Simulation continues until all ants have emigrated to new nests.
 
-Mersenne Twister pseudo-random number generator code mt19937ar.c is needed. 
-One can download mt19937ar.c from various websites.
-One needs to correct the folder's name in
-    #include "../lib/stat/mt19937ar.c"
-below to your local folder's name.
-
-In the following, p={a,b,c} means that one needs to run the code with parameter p=a, p=b, and p=c, and collect results.
+Every parameter can be given as a list of values or ranges (see sweep.h), and the whole grid
+of parameter values is simulated in one process, with one output line per grid point
+in the order of the grid (the first parameter varies slowest).
 
 Produce the results shown in Figure 9 by running
 
-    a.out 0.1 z={0.02,0.04,0.06,0.08,0.1,0.12,0.14,0.16,0.18,0.2,0.22,0.24,0.26,0.28,0.3,0.32,0.34,0.36,0.38,0.4} 100 2
+    a.out 0.1 0.02:0.4:0.02 100 2
 
-    a.out 0.1 z={0.04,0.08,0.12,0.16,0.2,0.24,0.28,0.32,0.36,0.4} 100 4
+    a.out 0.1 0.04:0.4:0.04 100 4
 
-    a.out 0.1 z={0.06,0.12,0.18,0.24,0.30,0.36} 100 6
+    a.out 0.1 0.06:0.36:0.06 100 6
 
-    a.out {0.01,0.01778,0.03162,0.05623,0.1,0.1778,0.3162,0.5623,1} z=0.12 100 {2,4,6}
+    a.out 0.01,0.01778,0.03162,0.05623,0.1,0.1778,0.3162,0.5623,1 0.12 100 2,4,6
 
 Produce the results shown in Figure S6 by running
 
-    a.out {0.01,0.1,1} z={0.02,0.04,0.06,0.08,0.1,0.12,0.14,0.16,0.18,0.2,0.22,0.24,0.26,0.28,0.3,0.32,0.34,0.36,0.38,0.4} 100 2 with alpha_leak=0
+    a.out 0.01,0.1,1 0.02:0.4:0.02 100 2 alpha_leak=0
 
-    a.out {0.01,0.1,1} z={0.04,0.08,0.12,0.16,0.2,0.24,0.28,0.32,0.36,0.4} 100 4 with alpha_leak=0
+    a.out 0.01,0.1,1 0.04:0.4:0.04 100 4 alpha_leak=0
 
-    a.out {0.01,0.1,1} z={0.06,0.12,0.18,0.24,0.30,0.36} 100 6 with alpha_leak=0
+    a.out 0.01,0.1,1 0.06:0.36:0.06 100 6 alpha_leak=0
 
-    a.out {0.01,0.01778,0.03162,0.05623,0.1,0.1778,0.3162,0.5623,1} z={0.12,0.36} 100 {2,4,6} with alpha_leak=0
+    a.out 0.01,0.01778,0.03162,0.05623,0.1,0.1778,0.3162,0.5623,1 0.12,0.36 100 2,4,6 alpha_leak=0
 
 Produce the results shown in Figure S7 by running
 
-    a.out {0.2,1} z={0.02,0.04,0.06,0.08,0.1,0.12,0.14,0.16,0.18,0.2,0.22,0.24,0.26,0.28,0.3,0.32,0.34,0.36,0.38,0.4} 100 2
+    a.out 0.2,1 0.02:0.4:0.02 100 2
+
+    a.out 0.02,1 0.04:0.4:0.04 100 4
+
+    a.out 0.02,1 0.06:0.36:0.06 100 6
+
+    a.out 0.01,0.01778,0.03162,0.05623,0.1,0.1778,0.3162,0.5623,1 0.36 100 2,4,6
+
+Trials run in parallel on all cores (see trial-runner.h). The optional arguments
+        trials=10000 threads=#cores seed=random
+set the number of trials per grid point, the number of threads and the seed. The output depends only on the seed.
+alpha_leak=0.05 sets the rate at which ants leak back to the old nest.
+
+For large Na, the optional argument method=tau selects approximate tau leaping, and method=hybrid
+tau leaping that switches to the exact SSA near the end of the trial, so that the stopping time and
+the final distribution over the nests are not distorted by a leap overshooting the end of the emigration
+(see ssa-engine.h and bench-tauleap.cc). method=ensemble runs the exact SSA on ENSEMBLE_LANES trials
+in lockstep (see ensemble-ssa.h), with quantiles= and output= but not record=.
 
-    a.out {0.02,1} z={0.04,0.08,0.12,0.16,0.2,0.24,0.28,0.32,0.36,0.4} 100 4
+Adaptive mode: with the optional arguments
+        tol=<x> rtol=<y> batch=1000
+trials are run in batches of "batch" trials until the 95% confidence interval of the mean cohesion
+has half-width <= x and that of the mean time has half-width <= y times the mean.
+trials= is then the maximum # trials per grid point, and the # trials used is appended to each line.
 
-    a.out {0.02,1} z={0.06,0.12,0.18,0.24,0.30,0.36} 100 6
+Distributions: quantiles=1 appends the 5, 25, 50, 75 and 95 percentiles of the time (before the
+# trials of the adaptive mode), estimated by streaming t-digests without storing the trials, and
+output=<file> writes every realisation (time, score, winning nest, # events, final compartments) to <file>
+in the compact binary format of trial-output.h; trial-dump.cc converts it to text.
 
-    a.out {0.01,0.01778,0.03162,0.05623,0.1,0.1778,0.3162,0.5623,1} z=0.36 100 {2,4,6}
+Caps: max_events=<n> and max_seconds=<s> stop any realisation after n events or s seconds of wall time, for the
+slow emigrations at small alpha; such realisations are not used, and their # is appended to each line
+(see trial-cap.h; not with method=ensemble).
 
+Trajectories: record=<file> writes the mean, standard deviation and percentiles of the ants in the old nest
+and at each new nest over the realisations at the times 0, record_dt, ..., record_tmax (1 and 100 by
+default), one block per grid point (see trajectory-recorder.h; exact SSA and a single Nnest only).
 
+Long sweeps: checkpoint=<file> saves every finished chunk of trials to <file> and resumes from it when it exists,
+and shard=i/N checkpoint=<file> seed=<seed> runs the i-th of N slices of the sweep, e.g., on a cluster;
+sweep-merge.cc merges the files of the shards (see checkpoint.h).
+
+Result cache: cache=<dir> keeps the partial sums of every chunk of trials in <dir>, keyed by the parameters of
+the point and the seed (seed=1 by default), so that a later run at the same points prints at once and a run with
+more trials simulates only the new chunks (see result-cache.h). daemon=<socket> cache=<dir> starts a resident
+server, and <arguments> connect=<socket> runs the query in it (see sweep-daemon.h).
 */
 #include <iostream>
 using namespace std;
 #include <fstream>
 #include <cstdlib> // atoi
 #include <cmath> // cos, sin
-#include "../lib/stat/mt19937ar.c"
 #include <ctime>
-
-int main (int argc, char **argv) {
-
-  if (argc != 5) {
+#include <vector>
+#include <string>
+#include <sstream>
+#include "options.h"
+#include "sweep.h"
+#include "nest-models.h"
+#include "trial-runner.h"
+#include "checkpoint.h"
+#include "trial-cap.h"
+#include "result-cache.h"
+#include "sweep-daemon.h"
+#include "ensemble-ssa.h"
+#include "trial-output.h"
+#include "trajectory-recorder.h"
+
+static int cohesion_tradeoff(int argc, char **argv) {
+
+  options opt(argc, argv);
+  if (opt.npos() != 4) {
     cerr << "cohesion-tradeoff.out alpha z Na Nnest" << endl;
     cerr << "alpha: rate at which committed ants convert to recruits, common to low-threshold and high-threshold ants" << endl;
      cerr << "z: initial fraction of recruiters" << endl;
      cerr << "Na: number of ants" << endl;
      cerr << "Nnest: number of new nests" << endl;
+    usage_common_options();
+    cerr << "distributions: quantiles=1 (percentiles of the time), output=<file> (binary per-trial records, see trial-dump.cc)" << endl;
+    cerr << "per-trial caps: max_events=<n> max_seconds=<s> (# capped realisations appended, see trial-cap.h)" << endl;
+    cerr << "trajectories: record=<file> record_dt=1 record_tmax=100 (ensemble mean and percentiles, see trajectory-recorder.h)" << endl;
+    cerr << "result cache: cache=<dir> (see result-cache.h); daemon=<socket> cache=<dir> serves connect=<socket> (see sweep-daemon.h)" << endl;
     exit(8);
   }
 
-  init_genrand(time(NULL));
-  double alpha = atof(argv[1]); // conversion rate from committed to recruit
-  double alpha_leak = 0.05; // = 0.0 for fig. S6. = 0.05 otherwise
+  unsigned long seed = sweep_seed(opt); // seed=, or that of the checkpoint file
+  cerr << "seed = " << seed << endl;
+  double alpha_leak = opt.get("alpha_leak", 0.05); // = 0.0 for fig. S6. = 0.05 otherwise
   cerr << "leak rate = " << alpha_leak << endl;
-  double z = atof(argv[2]); // initial fraction of recruiters
-  int Na = atoi(argv[3]);
+
+  // alpha: conversion rate from committed to recruit
+  // z: initial fraction of recruiters
+  // Nnest: # new nests
+  grid g;
+  for (int i=0 ; i<4 ; i++)
+    g.add(opt.pos[i]);
+  long npoints = g.size();
+  long p;
   int tmp_sum;
 
-  double t;
-  double t_final_ave = 0.0;
-  double t_final_std = 0.0;
-  double cohesion_tmp;  
-  double cohesion_ave = 0.0;
-  double cohesion_std = 0.0;
-  double Entropy; // entropy (working var)
-
-  int i,j;
-  int trials = 10000;
-  int tr;
-  int Nnest = atoi(argv[4]); // # new nests
-  double rate[4*Nnest], rate_sum;
-  double ra;
-
-  int oldnest, com[Nnest], rec[Nnest]; // # ants in each category
-
-  tr = 0;
-  while (tr < trials) {
-    // initialization
-    t = 0.0;
-    oldnest = (int)(Na*(1-z)+1e-8);
-    tmp_sum = oldnest;
-    for (i=0 ; i<Nnest ; i++) {
-      com[i] = (int)((Na*z+1e-8)/Nnest);
-      rec[i] = 0;
-      tmp_sum += com[i];
+  vector<ssa_network> nets;
+  for (p=0 ; p<npoints ; p++) {
+    vector<double> v = g.point(p);
+    int Na = (int)v[2];
+    int Nnest = (int)v[3];
+    vector<int> x(1+2*Nnest); // x[0]: # ants in the old nest, x[1+2i], x[2+2i]: committed and recruiters of nest i
+    tmp_sum = nnest_init(&x[0], v[1], Na, Nnest); // Na - # ants placed before the rounding correction
+    if (tmp_sum > 0)
+      cerr << "Na - tmp_sum = " << tmp_sum << " " << x[0] - tmp_sum << " " << x[nnest_com(0)] << endl;
+    nets.push_back(nnest_network(v[0], alpha_leak, Na, Nnest));
+  }
+
+  stop_rule rule(opt.get_long("batch", 1000), opt.get("tol", 0.0), opt.get("rtol", 0.0), false);
+  sweep_checkpoint* ckpt = sweep_checkpoint_from(opt, "cohesion-tradeoff", seed, npoints, rule);
+  result_cache* cache = result_cache_from(opt, "cohesion-tradeoff", seed, g, opt.trials());
+  chunk_store* store = (ckpt != NULL)? (chunk_store*)ckpt : cache;
+
+  int method = opt.method();
+  trial_cap cap = trial_cap_from(opt);
+  long capped = 0;
+
+  // per-trial binary output and quantiles of the time (see trial-output.h)
+  trial_writer* out = opt.has("output")? new trial_writer(opt.get_str("output", "").c_str(), seed) : NULL;
+  trial_quantiles* quantiles = (opt.get_long("quantiles", 0) != 0)? new trial_quantiles(npoints) : NULL;
+  // time-resolved ensemble of the trajectories (see trajectory-recorder.h); the observables depend on Nnest
+  int Nnest0 = (int)g.point(0)[3];
+  for (p=0 ; p<npoints ; p++)
+    if (opt.has("record") && (int)g.point(p)[3] != Nnest0) {
+      cerr << "record= needs a single value of Nnest" << endl;
+      exit(8);
     }
-    if (tmp_sum < Na) {
-      if (tr==0)
-	cerr << "Na - tmp_sum = " << Na - tmp_sum << " " << oldnest << " " << com[0] << endl;
-      oldnest += Na - tmp_sum;
+  trajectory_recorder* rec = trajectory_recorder_from(opt, nnest_observables(Nnest0), 1+2*Nnest0, npoints);
+
+  auto make_trial = [&](long p) {
+    vector<double> v = g.point(p);
+    nnest_trial trial(nets[p], v[1], (int)v[2], (int)v[3], method);
+    trial.cap = cap;
+    if (rec != NULL)
+      trial.trace = trajectory_trace(rec, p);
+    return trial;
+  };
+  auto emit = [&](long p, const trial_sums& sums) {
+    vector<double> v = g.point(p);
+    double t_final_ave = sums.t_ave();
+    double t_final_std = sums.t_std();
+    double cohesion_ave = sums.s_ave();
+    double cohesion_std = sums.s_std();
+    cout << v[0] << " " << v[1] << " " << t_final_ave << " " << t_final_std << " " << cohesion_ave << " " << cohesion_std;
+    if (quantiles != NULL) {
+      tdigest d = quantiles->merged(p);
+      const double q[] = {0.05, 0.25, 0.5, 0.75, 0.95};
+      for (int k=0 ; k<5 ; k++)
+	cout << " " << d.quantile(q[k]);
     }
-
-    while (oldnest < Na && oldnest > 0.1 * Na) {
-
-	rate_sum = 0.0;
-	for (i=0 ; i<Nnest ; i++) {
-	  rate[4*i] = (double)rec[i] * oldnest / Na;
-	  rate[4*i+1] = alpha * com[i];
-	  rate[4*i+2] = alpha_leak * com[i];
-	  rate[4*i+3] = alpha_leak * rec[i];
-	  for (j=0 ; j<4 ; j++)
-	    rate_sum += rate[4*i+j];
-	}
-	ra = (genrand_int32()+0.5)/4294967296.0 * rate_sum; // 0 < ra < rate_sum
-
-	i=0;
-	while (ra > rate[i]) {
-	  ra -= rate[i];
-	  i++;
-	}
-	if (i >= 4*Nnest) {
-	  cerr << "error in ra" << endl;
-	  exit(8);
-	}
-
-	if (i % 4 == 0) { // recruitment occurs
-	  oldnest--;
-	  com[i/4]++;
-	} else if (i % 4 == 1) { // a committed ant turns to recruit
-	  com[i/4]--;
-	  rec[i/4]++;
-	} else if (i % 4 == 2) { // leak from committed to oldnest
-	  com[i/4]--;
-	  oldnest++;
-	} else { // leak from recruit to oldnest
-	  rec[i/4]--;
-	  oldnest++;
-	}
-	t += -1.0/rate_sum*log((genrand_int32()+0.5)/4294967296.0);
-    } // dynamics done
-
-    if (oldnest != Na) { // emigration done
-      tr++;
-      t_final_ave += t;
-      t_final_std += t*t;
-      tmp_sum = 0;
-      for (i=0 ; i<Nnest ; i++)
-	tmp_sum += com[i] + rec[i];
-
-      Entropy = 0.0;
-      for (i=0 ; i<Nnest ; i++) {
-	if (com[i]+rec[i]>0)
-	  Entropy += - (double)(com[i]+rec[i])/tmp_sum * log((double)(com[i]+rec[i])/tmp_sum);
-#ifdef VERBOSE
-	cerr << com[i]+rec[i] << " ";
-#endif // VERBOSE
-      } 
-	
-#ifdef VERBOSE
-      cerr << tmp_sum << " " << 1 - Entropy/log(Nnest) << endl;
-#endif // VERBOSE
-      cohesion_tmp = 1 - Entropy/log(Nnest);
-      cohesion_ave += cohesion_tmp;
-      cohesion_std += cohesion_tmp*cohesion_tmp;
+    if (rule.adaptive())
+      cout << " " << sums.n;
+    if (cap.active())
+      cout << " " << sums.capped;
+    capped += sums.capped;
+    cout << endl;
+  };
+  if ((out != NULL || quantiles != NULL) && ckpt != NULL) {
+    cerr << "output= and quantiles= are not available with checkpoint=" << endl;
+    exit(8);
+  }
+  if (method == SSA_ENSEMBLE) {
+    if (cap.active()) {
+      cerr << "max_events= and max_seconds= are not available with method=ensemble" << endl;
+      exit(8);
     }
-  } // a single trial done
-
-      t_final_ave /= trials;
-      t_final_std = sqrt(t_final_std/trials - t_final_ave*t_final_ave);
-      cohesion_ave /= trials;
-      cohesion_std = sqrt(cohesion_std/trials - cohesion_ave*cohesion_ave);
-      
-      cout << alpha << " " << z << " " << t_final_ave << " " << t_final_std << " " << cohesion_ave << " " << cohesion_std << endl;
-
+    auto make_ensemble = [&](long p) { return ensemble_trial<nnest_trial>(nets[p], make_trial(p)); };
+    if (out != NULL || quantiles != NULL) {
+      auto make_recorded = [&](long p) { return recorded_trial<ensemble_trial<nnest_trial> >(make_ensemble(p), out, quantiles); };
+      run_sweep(make_recorded, npoints, opt.trials(), seed, opt.threads(), emit, rule, 1, store);
+    } else
+      run_sweep(make_ensemble, npoints, opt.trials(), seed, opt.threads(), emit, rule, 1, store);
+  } else if (out != NULL || quantiles != NULL) {
+    auto make_recorded = [&](long p) { return recorded_trial<nnest_trial>(make_trial(p), out, quantiles); };
+    run_sweep(make_recorded, npoints, opt.trials(), seed, opt.threads(), emit, rule, 1, store);
+  } else
+    run_sweep(make_trial, npoints, opt.trials(), seed, opt.threads(), emit, rule, 1, store);
+
+  delete out; // flushes the file
+  delete quantiles;
+  if (rec != NULL) {
+    vector<string> label(npoints);
+    for (p=0 ; p<npoints ; p++) {
+      vector<double> v = g.point(p);
+      ostringstream s;
+      s << "alpha=" << v[0] << " z=" << v[1] << " Na=" << v[2] << " Nnest=" << v[3];
+      label[p] = s.str();
+    }
+    if (!rec->write(opt.get_str("record", "").c_str(), label))
+      cerr << "cannot write " << opt.get_str("record", "") << endl;
+    delete rec;
+  }
+  if (cap.active() && (ckpt == NULL || !ckpt->sharded()))
+    cerr << capped << " realisations capped" << endl;
+  if (ckpt != NULL && ckpt->sharded())
+    cerr << "shard " << opt.get_str("shard", "") << ": " << ckpt->written << " chunks written to " << opt.get_str("checkpoint", "") << endl;
+  delete ckpt;
+  if (cache != NULL)
+    cerr << cache->hits << " chunks from the cache " << opt.get_str("cache", "") << ", " << cache->simulated << " simulated" << endl;
+  delete cache;
+  ssa_profile_report("cohesion-tradeoff"); // with -DSSA_PROFILE (see ssa-profile.h)
   return 0;
 }
+
+int main (int argc, char **argv) {
+  return sweep_main(argc, argv, cohesion_tradeoff, "cohesion-tradeoff.out"); // daemon=, connect= (see sweep-daemon.h)
+}
@@ -1,7 +1,31 @@
 /* Differential equation version of the netst choice model
 
+The rate equations are those of the reaction network of the L/H model (lh_network in nest-models.h,
+ssa_network::drift in ssa-engine.h), integrated by the adaptive Dormand-Prince method of ode-solver.h.
+The state is printed every 0.01 time units from the dense output, and the time at which the good nest
+reaches the quorum (half of the ants) and the end of the dynamics are located within a step by event detection.
+
+Optional arguments:
+        rtol=1e-8 atol=1e-10
+set the relative and absolute error tolerance of the integrator.
+
+Scan mode: if any parameter is given as a list of values or ranges (see sweep.h), e.g.
+        a.out 0.02:1:0.02 0.1 0:1:0.02 0.3
+the trajectories are not printed. Instead, the grid points are integrated in batches of BATCH_LANES
+by the vectorised integrator of ode-batch.h, on threads=#cores threads, and one line
+        alpha alpha_s H z t_quorum t_end
+is printed per grid point in the order of the grid (t_quorum = -1 if the good nest never reaches
+the quorum, t_end = -1 if the dynamics do not stop before t_max=10000). Compile with
+-O3 -march=native to obtain AVX2/AVX-512 code.
+
+Sensitivity mode: sensitivity=1 integrates, together with the trajectory, its forward sensitivities with respect
+to alpha, alpha_s, H, z and alpha_leak (see ode-sensitivity.h), and appends to each line the 45 derivatives
+        d y_i / d p,  i = the 9 compartments in the order of nest-models.h, p = alpha alpha_s H z alpha_leak
+(compartment-major); the derivatives of t_quorum and t_end are printed to stderr. fit-nestchoice.cc fits
+the parameters to observed curves with them.
+
 Produce the results shown in Figure 3 by running
-        a.out of diffeqn-nestchoice.out alpha=0.1 alpha_s=0.1 H=0.2 z=0.3
+        diffeqn-nestchoice.out 0.1 0.1 0.2 0.3
 */
 
 #include <iostream>
@@ -10,12 +34,138 @@ using namespace std;
 #include <cstdlib> // atoi
 #include <cmath> // cos, sin
 #include <ctime>
-#define VERBOSE
+#include "options.h"
+#include "nest-models.h"
+#include "ode-solver.h"
+#include "ode-batch.h"
+#include "ode-sensitivity.h"
+#include "sweep.h"
+#include <thread>
+#include <atomic>
+
+#define BATCH_LANES 256
+
+// right-hand side for ode-solver.h
+struct network_rhs {
+  const ssa_network& net;
+  network_rhs(const ssa_network& net_) : net(net_) {}
+  void operator()(double, const double* y, double* dy) const { net.drift(y, dy); }
+};
+
+// the good nest reaches the quorum (half of the ants) at the zero; a template for the dual numbers of ode-sensitivity.h
+struct lh_quorum {
+  template <class T> T operator()(const T* y) const { return y[L_GOOD_COM] + y[H_GOOD_COM] + y[L_GOOD_REC] + y[H_GOOD_REC] - 0.5; }
+};
+
+// the dynamics stop when "# ants in the old nest <= eps" is reached for the first time
+struct lh_stop {
+  double eps;
+  lh_stop(double eps_) : eps(eps_) {}
+  template <class T> T operator()(const T* y) const { return eps - (y[L_OLDNEST] + y[H_OLDNEST]); }
+};
+
+// scan mode: t_quorum and t_end at every grid point of (alpha, alpha_s, H, z)
+static void scan(const grid& g, double alpha_leak, double eps, double t_max, double rtol, double atol, int threads) {
+  long npoints = g.size();
+  long nblocks = (npoints + BATCH_LANES - 1) / BATCH_LANES;
+  vector<double> t_quorum(npoints, -1.0), t_end(npoints, -1.0);
+  atomic<long> next_block(0);
+  lh_stop stop(eps);
+
+  auto worker = [&]() {
+    long b, p;
+    int l, nlanes;
+    vector<double> y0(LH_COMPARTMENTS * BATCH_LANES);
+    while ((b = next_block++) < nblocks) {
+      p = b * BATCH_LANES;
+      nlanes = (int)min((long)BATCH_LANES, npoints - p);
+      vector<ssa_network> nets;
+      for (l=0 ; l<BATCH_LANES ; l++) {
+	vector<double> v = g.point(p + ((l < nlanes)? l : 0));
+	nets.push_back(lh_network(v[0], v[1], alpha_leak, 1));
+	lh_ode_init(&y0[l], BATCH_LANES, v[2], v[3]);
+      }
+      network_batch rhs(&nets[0], nlanes, BATCH_LANES);
+      dopri5_batch ode(LH_COMPARTMENTS, BATCH_LANES, rtol, atol);
+      ode.init(rhs, 0.0, &y0[0]);
+      for (l=nlanes ; l<BATCH_LANES ; l++)
+	ode.retire(l);
+      while (ode.any_active()) {
+	ode.step(rhs);
+	for (l=0 ; l<nlanes ; l++) {
+	  if (!ode.accepted[l])
+	    continue;
+	  if (t_quorum[p+l] < 0.0)
+	    ode.event(l, lh_quorum(), t_quorum[p+l]);
+	  if (ode.event(l, stop, t_end[p+l]) || ode.t[l] > t_max)
+	    ode.retire(l);
+	}
+      }
+    }
+  };
+  vector<thread> pool;
+  for (int i=1 ; i<threads ; i++)
+    pool.push_back(thread(worker));
+  worker();
+  for (size_t i=0 ; i<pool.size() ; i++)
+    pool[i].join();
+
+  for (long p=0 ; p<npoints ; p++) {
+    vector<double> v = g.point(p);
+    cout << v[0] << " " << v[1] << " " << v[2] << " " << v[3] << " " << t_quorum[p] << " " << t_end[p] << endl;
+  }
+}
+
+// sensitivity mode: the trajectory, its derivatives with respect to the parameters and those of t_quorum and t_end
+static void sensitivity(const double* par, double eps, double dt_out, double rtol, double atol) {
+  const int n = LH_COMPARTMENTS, N = LH_PARAMS;
+  double t_quorum = -1.0, t_end;
+  double dt_quorum[LH_PARAMS], dt_end[LH_PARAMS];
+  long k_out = 1;
+  int i, p;
+  vector<double> Y(n*(1+N));
+  lh_sensitivity_init(par, &Y[0]);
+  lh_sensitivity_rhs rhs(n, lh_dual_drift(par));
+  dopri5 ode(n*(1+N), rtol, atol);
+  ode.init(rhs, 0.0, &Y[0]);
+  lh_stop stop(eps);
+  bool done = false;
+
+  while (!done) {
+    ode.step(rhs);
+    t_end = ode.t;
+    if (t_quorum < 0.0 && ode.event(lh_quorum(), t_quorum)) {
+      ode.dense(t_quorum, &Y[0]);
+      event_sensitivity(rhs, lh_quorum(), &Y[0], dt_quorum);
+    }
+    done = ode.event(stop, t_end);
+
+    for ( ; k_out * dt_out < t_end ; k_out++) {
+      ode.dense(k_out * dt_out, &Y[0]);
+      const double* y = &Y[0];
+      cout << k_out * dt_out << " " << y[L_GOOD_REC] + y[H_GOOD_REC] << " " << y[L_GOOD_COM] + y[H_GOOD_COM] + y[L_GOOD_REC] + y[H_GOOD_REC] << " " << y[L_POOR_REC] << " " << y[L_POOR_COM] + y[L_POOR_REC] + y[H_POOR_VIS];
+      for (i=0 ; i<n ; i++)
+	for (p=0 ; p<N ; p++)
+	  cout << " " << Y[n + i*N + p];
+      cout << endl;
+    }
+  }
+  ode.dense(t_end, &Y[0]);
+  event_sensitivity(rhs, stop, &Y[0], dt_end);
+
+  cerr << "t_quorum = " << t_quorum << " t_end = " << t_end << endl;
+  for (p=0 ; p<N ; p++)
+    cerr << "d/d" << lh_param_names[p] << ": t_quorum " << ((t_quorum < 0.0)? 0.0 : dt_quorum[p]) << " t_end " << dt_end[p] << endl;
+  cerr << "steps = " << ode.naccept << " rejected = " << ode.nreject << " rhs evaluations = " << ode.nfev << endl;
+}
 
 int main (int argc, char **argv) {
 
-  if (argc != 5) {
-    cerr << "diffeqn-nestchoice.out alpha alpha_s H z" << endl;
+  options opt(argc, argv);
+  if (opt.npos() != 4) {
+    cerr << "diffeqn-nestchoice.out alpha alpha_s H z [alpha_leak=0.05] [rtol=1e-8] [atol=1e-10] [threads=#cores]" << endl;
+    cerr << "each parameter may be a list of values or ranges, e.g. 0.1,0.2 or 0.02:1:0.02 (scan mode)" << endl;
+    cerr << "sensitivity=1: also print the derivatives of the 9 compartments, t_quorum and t_end with respect to alpha alpha_s H z alpha_leak" << endl;
     cerr << "alpha: rate at which committed ants convert to recruits, common to low-threshold and high-threshold ants" << endl;
     cerr << "alpha_s: rate at which high-threshold ants visiting the poor nest moves to the good nest" << endl;
     cerr << "H: fraction of high-threshold ants" << endl;
@@ -23,75 +173,66 @@ int main (int argc, char **argv) {
     exit(8);
   }
 
-  double alpha = atof(argv[1]); // conversion rate from committed to recruit
-  double alpha_g = alpha;
-  double alpha_p = alpha;
-  double alpha_s = atof(argv[2]); // rate at which high-threshold ants visiting the poor nest move to the good nest
-  double alpha_leak = 0.05;
-  double H = atof(argv[3]); // fraction of high-threshold ants
-  double L = 1-H; // fraction of low-threshold ants
-  double z = atof(argv[4]); // initial fraction of recruiters
-
-  double t=0;
-  double dt = 0.001;
-  double t_quorum;
-  double sum; // for checking
-
-  double L_oldnest, H_oldnest, L_poor_com, L_poor_rec, H_poor_vis, L_good_com, H_good_com, L_good_rec, H_good_rec;
-  double L_oldnest_prev, H_oldnest_prev, L_poor_com_prev, L_poor_rec_prev, H_poor_vis_prev, L_good_com_prev, H_good_com_prev, L_good_rec_prev, H_good_rec_prev;
-
-  // initialization
-  L_oldnest = L*(1-z);
-  H_oldnest = H*(1-z);
-  H_poor_vis = H_good_com = H*z/2;
-  L_poor_com = L_good_com = L*z/2;
-  L_poor_rec = L_good_rec = H_good_rec = 0.0;
-
+  grid g;
+  for (int i=0 ; i<4 ; i++)
+    g.add(opt.pos[i]);
+  double alpha_leak = opt.get("alpha_leak", 0.05);
   double eps = 0.1; // dynamics stop when "# ants in the current nest <= eps" is reached for the first time
+  if (g.size() > 1) {
+    if (opt.has("sensitivity")) {
+      cerr << "sensitivity= takes a single parameter point" << endl;
+      exit(8);
+    }
+    scan(g, alpha_leak, eps, 10000.0, opt.get("rtol", 1e-8), opt.get("atol", 1e-10), opt.threads());
+    return 0;
+  }
+
+  double alpha = g.axes[0][0]; // conversion rate from committed to recruit
+  double alpha_s = g.axes[1][0]; // rate at which high-threshold ants visiting the poor nest move to the good nest
+  double H = g.axes[2][0]; // fraction of high-threshold ants
+  double z = g.axes[3][0]; // initial fraction of recruiters
 
-  while (L_oldnest + H_oldnest > eps) {
-
-    if ((int)(t*100) > (int)((t-dt)*100))
-      cout << t << " " << L_good_rec + H_good_rec << " " << L_good_com + H_good_com + L_good_rec + H_good_rec << " " << L_poor_rec << " " << L_poor_com + L_poor_rec + H_poor_vis << endl;
-
-    if (L_good_com + H_good_com + L_good_rec + H_good_rec > 0.5 
-	&& L_good_com_prev + H_good_com_prev + L_good_rec_prev + H_good_rec_prev < 0.5)
-      t_quorum = t;
-    L_oldnest_prev = L_oldnest;
-    H_oldnest_prev = H_oldnest;
-    L_poor_com_prev = L_poor_com;
-    L_poor_rec_prev = L_poor_rec;
-    H_poor_vis_prev = H_poor_vis;
-    L_good_com_prev = L_good_com;
-    H_good_com_prev = H_good_com;
-    L_good_rec_prev = L_good_rec;
-    H_good_rec_prev = H_good_rec;
-
-    L_oldnest += dt * (alpha_leak * (L_poor_com_prev + L_poor_rec_prev + L_good_com_prev + L_good_rec_prev) -
-       (L_poor_rec_prev + L_good_rec_prev + H_good_rec_prev) * L_oldnest_prev);
-    H_oldnest += dt * (alpha_leak * (H_poor_vis_prev + H_good_com_prev + H_good_rec_prev) -
-       (L_poor_rec_prev + L_good_rec_prev + H_good_rec_prev) * H_oldnest_prev);
-    L_poor_com += dt * (L_poor_rec_prev * L_oldnest_prev - alpha_p * L_poor_com_prev - alpha_leak * L_poor_com_prev);
-    H_poor_vis += dt * (L_poor_rec_prev * H_oldnest_prev - alpha_s * H_poor_vis_prev - alpha_leak * H_poor_vis_prev);
-    L_good_com += dt * ((L_good_rec_prev + H_good_rec_prev) * L_oldnest_prev - alpha_g * L_good_com_prev - alpha_leak * L_good_com_prev);
-    H_good_com += dt * ((L_good_rec_prev + H_good_rec_prev) * H_oldnest_prev + alpha_s * H_poor_vis_prev - alpha_g * H_good_com_prev - alpha_leak * H_good_com_prev);
-    L_poor_rec += dt * (alpha_p * L_poor_com_prev - alpha_leak * L_poor_rec_prev);
-    L_good_rec += dt * (alpha_g * L_good_com_prev - alpha_leak * L_good_rec_prev);
-    H_good_rec += dt * (alpha_g * H_good_com_prev - alpha_leak * H_good_rec_prev);
-
-    sum = L_oldnest + H_oldnest + L_poor_com + H_poor_vis + L_good_com + H_good_com + L_poor_rec + L_good_rec + H_good_rec;
-    //    cerr << sum << endl;
-    L_oldnest /= sum;
-    H_oldnest /= sum;
-    L_poor_com /= sum;
-    H_poor_vis /= sum;
-    L_good_com /= sum;
-    H_good_com /= sum;
-    L_poor_rec /= sum;
-    L_good_rec /= sum;
-    H_good_rec /= sum;
-    t += dt;
+  double dt_out = 0.01; // output interval
+  if (opt.get_long("sensitivity", 0) != 0) {
+    double par[LH_PARAMS];
+    par[LH_P_ALPHA] = alpha;
+    par[LH_P_ALPHA_S] = alpha_s;
+    par[LH_P_H] = H;
+    par[LH_P_Z] = z;
+    par[LH_P_LEAK] = alpha_leak;
+    sensitivity(par, eps, dt_out, opt.get("rtol", 1e-8), opt.get("atol", 1e-10));
+    return 0;
   }
+  double t_quorum = -1.0;
+  double t_end;
+  long k_out = 1; // next output at t = k_out * dt_out
+  double y[LH_COMPARTMENTS];
+
+  lh_ode_init(y, 1, H, z); // initialization
+
+  ssa_network net = lh_network(alpha, alpha_s, alpha_leak, 1);
+  network_rhs rhs(net);
+  dopri5 ode(LH_COMPARTMENTS, opt.get("rtol", 1e-8), opt.get("atol", 1e-10));
+  ode.init(rhs, 0.0, y);
+
+  lh_stop stop(eps);
+  bool done = false;
+
+  while (!done) {
+    ode.step(rhs);
+    t_end = ode.t;
+    if (t_quorum < 0.0)
+      ode.event(lh_quorum(), t_quorum);
+    done = ode.event(stop, t_end);
+
+    for ( ; k_out * dt_out < t_end ; k_out++) {
+      ode.dense(k_out * dt_out, y);
+      cout << k_out * dt_out << " " << y[L_GOOD_REC] + y[H_GOOD_REC] << " " << y[L_GOOD_COM] + y[H_GOOD_COM] + y[L_GOOD_REC] + y[H_GOOD_REC] << " " << y[L_POOR_REC] << " " << y[L_POOR_COM] + y[L_POOR_REC] + y[H_POOR_VIS] << endl;
+    }
+  }
+
+  cerr << "t_quorum = " << t_quorum << " t_end = " << t_end << endl;
+  cerr << "steps = " << ode.naccept << " rejected = " << ode.nreject << " rhs evaluations = " << ode.nfev << endl;
 
   return 0;
 }
@@ -0,0 +1,282 @@
+/* Lockstep ensemble of exact SSA trials (method=ensemble).
+
+The trials of a chunk have the same reaction network and differ only in their random numbers, so
+ENSEMBLE_LANES trials are simulated side by side. The compartments of all lanes are stored in
+structure-of-arrays layout (compartment s of lane l at s*W + l), and one step fires one event in every
+lane: the propensities, their cumulative sums, the selection of the reaction (by counting the cumulative
+sums below the random threshold, which gives the same reaction as the linear scan of ssa_engine), the
+update of the compartments and the exponential waiting time are computed by loops over the lanes that
+the compiler vectorises (e.g. g++ -O3 -march=native). Each lane draws from its own xoshiro256++ stream,
+generated in the same vector registers and seeded from the generator of the chunk. A lane whose trial has
+stopped is refilled with the next trial at the following step.
+
+ensemble_trial wraps a model (lh_trial, nnest_trial) with
+    void init(int* x)                               initial condition
+    running                                         keep_going(x) of ssa_engine::run, with
+                                                    ens_mask running.lanes(const ens_vec* x)
+                                                    evaluating it in all lanes at once
+    bool finish(const int* x, double& score)        false if the realisation is discarded
+and is a trial for trial-runner.h. Like the trials of nest-models.h, it keeps the final compartments (x),
+the # events (engine.events) and the nest with the most ants (winner()) of the last realisation it returned,
+so that recorded_trial (trial-output.h) writes its per-trial records and quantiles. The results are returned in the order in which the trials were started,
+not in the order in which they finish, so the trials still running when a chunk has collected enough
+realisations are discarded independently of their duration, which would otherwise bias the sample
+towards short trials.
+
+The statistics are those of the exact SSA, but the random stream differs from that of ssa_engine.
+*/
+
+#ifndef ENSEMBLE_SSA_H
+#define ENSEMBLE_SSA_H
+
+#include <vector>
+#include <deque>
+#include <cmath>
+#include <stdint.h>
+#include "ssa-engine.h"
+
+// # trials in lockstep: one SIMD register of doubles
+#ifndef ENSEMBLE_LANES
+#if defined(__AVX512F__)
+#define ENSEMBLE_LANES 8
+#elif defined(__AVX__)
+#define ENSEMBLE_LANES 4
+#else
+#define ENSEMBLE_LANES 2
+#endif
+#endif
+
+// one value per lane; GCC vector extensions, which become SIMD instructions where available
+typedef double ens_vec __attribute__((vector_size(ENSEMBLE_LANES*sizeof(double))));
+typedef int64_t ens_mask __attribute__((vector_size(ENSEMBLE_LANES*sizeof(double)))); // result of a comparison
+typedef uint64_t ens_bits __attribute__((vector_size(ENSEMBLE_LANES*sizeof(double))));
+
+inline ens_vec ens_splat(double v) {
+  ens_vec r;
+  for (int l=0 ; l<ENSEMBLE_LANES ; l++)
+    r[l] = v;
+  return r;
+}
+
+// natural logarithm of x > 0 (normal numbers) in every lane.
+// x = 2^e * m with m in [sqrt(1/2), sqrt(2)), log(m) = 2 atanh(s), s = (m-1)/(m+1); relative error < 1e-15.
+inline ens_vec ens_log(ens_vec x) {
+  ens_mask b = (ens_mask)x, big;
+  ens_vec e, m;
+  big = (b & 0x000fffffffffffffLL) > 0x6a09e667f3bcdLL; // -1 if m >= sqrt(2)
+  e = (ens_vec)((b >> 52) | 0x4330000000000000LL) - (4503599627370496.0 + 1023.0); // 2^52 + biased exponent as a double
+  e += (ens_vec)(big & 0x3ff0000000000000LL); // +1.0 where m is halved
+  b = (b & 0x000fffffffffffffLL) | 0x3ff0000000000000LL; // m in [1, 2)
+  b += big & (int64_t)0xfff0000000000000ULL; // m/2 in [sqrt(1/2), 1)
+  m = (ens_vec)b;
+  ens_vec s = (m - 1.0) / (m + 1.0), s2 = s*s;
+  ens_vec p = ens_splat(1.0/19);
+  p = 1.0/17 + s2*p;
+  p = 1.0/15 + s2*p;
+  p = 1.0/13 + s2*p;
+  p = 1.0/11 + s2*p;
+  p = 1.0/9 + s2*p;
+  p = 1.0/7 + s2*p;
+  p = 1.0/5 + s2*p;
+  p = 1.0/3 + s2*p;
+  p = 1.0 + s2*p;
+  return e * 0.6931471805599453094 + 2.0*s*p;
+}
+
+// xoshiro256++ (rng.h) in every lane; the streams of the lanes are 2^128 draws apart
+struct ens_xoshiro {
+  ens_bits s0, s1, s2, s3;
+
+  void seed(uint64_t seed) {
+    xoshiro_stream g(seed);
+    for (int l=0 ; l<ENSEMBLE_LANES ; l++) {
+      s0[l] = g.s[0];
+      s1[l] = g.s[1];
+      s2[l] = g.s[2];
+      s3[l] = g.s[3];
+      g.jump();
+    }
+  }
+
+  // uniform deviates in (0,1): 52 random bits as the mantissa of a double in [1,2), shifted by 1 - 2^-53
+  ens_vec uniform() {
+    ens_bits r = s0 + s3;
+    r = ((r << 23) | (r >> 41)) + s0;
+    ens_bits t = s1 << 17;
+    s2 ^= s0;
+    s3 ^= s1;
+    s1 ^= s2;
+    s0 ^= s3;
+    s2 ^= t;
+    s3 = (s3 << 45) | (s3 >> 19);
+    return (ens_vec)((r >> 12) | 0x3ff0000000000000ULL) - (1.0 - 1.0/9007199254740992.0);
+  }
+};
+
+struct ssa_ensemble {
+  const ssa_network& net;
+  int ns, nc, np;
+  std::vector<ens_vec> x; // # ants in compartment s of every lane; exact integers
+  std::vector<ens_vec> acc; // cumulative propensity up to reaction c
+  std::vector<ens_vec> P; // pool sums
+  std::vector<int> from, to, pool;
+  std::vector<double> k;
+  ens_vec t;
+  ens_mask active; // -1 in the lanes that fire an event in the next step, 0 otherwise
+  ens_xoshiro rng;
+  long steps;
+
+  ssa_ensemble(const ssa_network& net_)
+    : net(net_), ns(net_.n_species), nc(net_.channels()), np((int)net_.pool_members.size()),
+      x(net_.n_species), acc(net_.channels()), P(net_.pool_members.size()),
+      from(net_.from), to(net_.to), pool(net_.pool), k(net_.k), steps(0) {
+    t = ens_splat(0.0);
+    active = (t != t); // all 0
+  }
+
+  void get(int l, int* xl) const {
+    for (int s=0 ; s<ns ; s++)
+      xl[s] = (int)x[s][l];
+  }
+  void set(int l, const int* xl) {
+    for (int s=0 ; s<ns ; s++)
+      x[s][l] = xl[s];
+    t[l] = 0.0;
+    active[l] = -1;
+  }
+
+  // one event in every active lane; lanes in an absorbing state (all propensities 0) become inactive
+  void step() {
+    const double inv_Na = 1.0 / net.Na;
+    const ens_vec zero = ens_splat(0.0), one = ens_splat(1.0);
+    ens_vec a, r, u, sel, hit;
+    int i, c;
+    size_t m;
+
+    for (i=0 ; i<np ; i++) {
+      P[i] = x[net.pool_members[i][0]];
+      for (m=1 ; m<net.pool_members[i].size() ; m++)
+	P[i] += x[net.pool_members[i][m]];
+      P[i] *= inv_Na;
+    }
+    a = zero;
+    for (c=0 ; c<nc ; c++) {
+      if (pool[c] >= 0)
+	a += k[c] * P[pool[c]] * x[from[c]];
+      else
+	a += k[c] * x[from[c]];
+      acc[c] = a;
+    }
+
+    r = rng.uniform();
+    u = rng.uniform();
+    active &= (a > 0.0);
+    r *= a;
+    sel = zero;
+    for (c=0 ; c<nc-1 ; c++)
+      sel += (r >= acc[c])? one : zero;
+    for (c=0 ; c<nc ; c++) {
+      hit = ((sel == (double)c) & active)? one : zero; // 1 in the lanes firing reaction c
+      x[from[c]] -= hit;
+      x[to[c]] += hit;
+    }
+    t += (active != 0)? -ens_log(u) / a : zero;
+    steps++;
+  }
+};
+
+template <class Model>
+struct ensemble_trial {
+  struct result {
+    bool done, accepted;
+    double t, score;
+    uint64_t events;
+    std::vector<int> x;
+  };
+  // network and # events of the last realisation, under the names of ssa_engine
+  struct lane_engine {
+    const ssa_network& net;
+    uint64_t events;
+    lane_engine(const ssa_network& net_) : net(net_), events(0) {}
+  };
+  Model model;
+  ssa_ensemble ens;
+  lane_engine engine;
+  std::vector<int> xl, x; // x: final state of the last realisation
+  long lane_trial[ENSEMBLE_LANES]; // index of the trial simulated in each lane
+  ens_vec lane_events; // # events of the trial of each lane
+  std::deque<result> results; // trials base, base+1, ...
+  long base, next_trial;
+  bool started;
+
+  ensemble_trial(const ssa_network& net, const Model& model_)
+    : model(model_), ens(net), engine(net), xl(net.n_species), x(net.n_species), base(0), next_trial(0), started(false) {}
+
+  ensemble_trial(const ensemble_trial& o)
+    : model(o.model), ens(o.ens.net), engine(o.ens.net), xl(o.xl.size()), x(o.x.size()), base(0), next_trial(0), started(false) {}
+
+  void start(int l) {
+    model.init(&xl[0]);
+    ens.set(l, &xl[0]);
+    lane_trial[l] = next_trial++;
+    lane_events[l] = 0.0;
+    result res = {false, false, 0.0, 0.0, 0, std::vector<int>()};
+    results.push_back(res);
+  }
+
+  int winner() const { return model.winner(); }
+
+  // finishes the trials of the lanes that have stopped and refills them until every lane is running (a trial
+  // may start stopped, e.g. at or past the quorum), then fires one event per lane. Returns early, without an
+  // event, once the oldest trial is done, so that trials which all start stopped do not loop for ever.
+  void advance() {
+    while (true) {
+      ens_mask going = ens.active & model.running.lanes(&ens.x[0]);
+      bool all_going = true;
+      for (int l=0 ; l<ENSEMBLE_LANES ; l++) {
+	if (going[l])
+	  continue;
+	all_going = false;
+	ens.get(l, &xl[0]);
+	result& res = results[lane_trial[l] - base];
+	res.done = true;
+	res.t = ens.t[l];
+	res.accepted = model.finish(&xl[0], res.score);
+	res.events = (uint64_t)lane_events[l];
+	res.x = xl;
+	start(l);
+      }
+      if (all_going)
+	break;
+      if (results.front().done)
+	return;
+    }
+    ens.step();
+    lane_events += (ens.active != 0)? ens_splat(1.0) : ens_splat(0.0); // the lanes that fired
+  }
+
+  template <class Rng>
+  bool operator()(Rng& rng, double& t, double& score) {
+    if (!started) {
+      ens.rng.seed(rng.bits());
+      for (int l=0 ; l<ENSEMBLE_LANES ; l++)
+	start(l);
+      started = true;
+    }
+    while (!results.front().done)
+      advance();
+    result& res = results.front();
+    t = res.t;
+    score = res.score;
+    engine.events = res.events;
+    x.swap(res.x);
+    for (size_t s=0 ; s<x.size() ; s++)
+      model.x[s] = x[s];
+    bool accepted = res.accepted;
+    results.pop_front();
+    base++;
+    return accepted;
+  }
+};
+
+#endif // ENSEMBLE_SSA_H
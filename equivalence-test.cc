@@ -0,0 +1,459 @@
+/* Statistical equivalence of two runs of the stochastic drivers, for engines, generators and builds whose
+random streams differ from those of the reference (method=ensemble, ANT_RNG, PGO, ...), so that their output
+cannot be compared bit for bit. equivalence.cmake runs it against the frozen reference runs of
+equivalence-reference.txt (cmake --build <dir> --target equivalence).
+
+Usage:
+        a.out summary <file>
+summarises a per-trial output file (output=<file> of finite-nestchoice.cc or cohesion-tradeoff.cc, see
+trial-output.h), one line per grid point:
+        point p trials n accepted a binary b successes k score mean sd quantiles Q t_0 ... t_Q-1
+with the # realisations and the accepted ones, whether every score is 0 or 1 (the precision of the L/H model)
+and the # of scores 1, the mean and standard deviation of the score (precision or cohesion), and the time to
+quorum (or to the end of the emigration) at the ranks 0, 1/(Q-1), ..., 1 of the accepted realisations (Q = 501).
+        a.out table <file> ... <file>
+summarises outputs of speed-accuracy-coef.cc with the same arguments and different seeds, one line per row of
+the output (the rows of the dummy values -10 are skipped):
+        corr i alpha y runs R mean sd
+with the mean and standard deviation of the correlation coefficient over the R runs.
+        a.out compare <reference> <candidate> [workload=<name>] [alpha=0.01] [tol=0] [verbose=0]
+compares two summaries point by point (the points of the section "workload <name>" of the reference with
+workload=): the time by a two-sample Kolmogorov-Smirnov test on the quantiles, the precision and the fraction
+of discarded realisations by two-sample binomial tests, the mean cohesion by its normal band and the
+correlation coefficients by the Student t band of the runs of the reference. Every test is at level alpha
+divided by the # tests (Bonferroni), so the probability of a false failure is at most alpha, and tol widens
+the bands of the cohesion and correlations by an absolute tolerance. Prints the failed tests (all of them
+with verbose=1) and one line
+        <workload> tests=<n> failed=<n> min_p=<p> PASS|FAIL
+and exits with 1 if a test failed.
+
+With Q = 501 quantiles, the empirical distribution functions of the Kolmogorov-Smirnov test are interpolated
+within 0.2% of rank, which is small against the critical distance at the default trials of equivalence.cmake
+(1.6% at 10^4 candidate trials).
+*/
+
+#include <iostream>
+using namespace std;
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include "options.h"
+#include "trial-output.h"
+
+#define EQUIV_QUANTILES 501
+
+struct point_summary {
+  long trials, accepted, successes;
+  bool binary;
+  double score_mean, score_sd;
+  vector<double> q; // time at the ranks k/(Q-1)
+};
+
+struct corr_summary {
+  double alpha, y, mean, sd;
+  int runs;
+};
+
+// summary of the per-trial output file f
+static void summarise_trials(const char* f) {
+  FILE* in = fopen(f, "rb");
+  char magic[8];
+  uint32_t version[2];
+  uint64_t seed;
+  if (in == NULL || fread(magic, 1, 8, in) != 8 || memcmp(magic, "ANTTRIAL", 8) != 0
+      || fread(version, sizeof(uint32_t), 2, in) != 2 || version[0] != 1 || fread(&seed, sizeof(uint64_t), 1, in) != 1) {
+    cerr << f << " is not a per-trial output file" << endl;
+    exit(8);
+  }
+  vector<vector<double> > t, score;
+  vector<long> trials;
+  trial_block b;
+  size_t i;
+  while (b.read(in)) {
+    if (b.point >= t.size()) {
+      t.resize(b.point+1);
+      score.resize(b.point+1);
+      trials.resize(b.point+1, 0);
+    }
+    trials[b.point] += b.size();
+    for (i=0 ; i<b.size() ; i++)
+      if (b.winner[i] >= 0) {
+	t[b.point].push_back(b.t[i]);
+	score[b.point].push_back(b.score[i]);
+      }
+  }
+  fclose(in);
+
+  cout << "# summary of " << f << " (seed " << seed << ")" << endl;
+  cout.precision(7);
+  for (size_t p=0 ; p<t.size() ; p++) {
+    vector<double>& tp = t[p];
+    long a = (long)tp.size(), k = 0;
+    bool binary = true;
+    double s1 = 0.0, s2 = 0.0;
+    for (i=0 ; i<score[p].size() ; i++) {
+      double s = score[p][i];
+      binary = binary && (s == 0.0 || s == 1.0);
+      k += (s == 1.0);
+      s1 += s;
+      s2 += s*s;
+    }
+    double mean = (a > 0)? s1/a : 0.0;
+    double sd = (a > 1)? sqrt(max(s2 - a*mean*mean, 0.0) / (a-1)) : 0.0;
+    cout << "point " << p << " trials " << trials[p] << " accepted " << a << " binary " << binary << " successes " << k
+	 << " score " << mean << " " << sd << " quantiles " << ((a > 0)? EQUIV_QUANTILES : 0);
+    sort(tp.begin(), tp.end());
+    for (int j=0 ; a > 0 && j<EQUIV_QUANTILES ; j++) { // linear interpolation between the order statistics
+      double r = (double)j / (EQUIV_QUANTILES-1) * (a-1);
+      long lo = (long)r;
+      double v = (lo+1 < a)? tp[lo] + (r-lo) * (tp[lo+1] - tp[lo]) : tp[lo];
+      cout << " " << v;
+    }
+    cout << endl;
+  }
+}
+
+// summary of the correlation coefficients of the outputs of speed-accuracy-coef.cc in files
+static void summarise_tables(const vector<const char*>& files) {
+  vector<vector<double> > rows; // alpha, y, then the coefficient of every file
+  for (size_t f=0 ; f<files.size() ; f++) {
+    ifstream in(files[f]);
+    if (!in) {
+      cerr << "cannot read " << files[f] << endl;
+      exit(8);
+    }
+    string line;
+    size_t r = 0;
+    while (getline(in, line)) {
+      vector<double> v;
+      const char* s = line.c_str();
+      char* end;
+      for (double x = strtod(s, &end) ; end != s ; x = strtod(s, &end)) { // strtod also reads nan
+	v.push_back(x);
+	s = end;
+      }
+      if (v.size() < 5 || v[2] == -10.0) // blank, or a dummy row of the plots
+	continue;
+      if (f == 0) {
+	vector<double> row(2);
+	row[0] = v[0];
+	row[1] = v[1];
+	rows.push_back(row);
+      }
+      if (r >= rows.size() || rows[r][0] != v[0] || rows[r][1] != v[1]) {
+	cerr << files[f] << " does not have the rows of " << files[0] << endl;
+	exit(8);
+      }
+      rows[r++].push_back(v[2]);
+    }
+    if (r != rows.size()) {
+      cerr << files[f] << " does not have the rows of " << files[0] << endl;
+      exit(8);
+    }
+  }
+
+  cout << "# correlation coefficients of " << files.size() << " runs" << endl;
+  cout.precision(7);
+  for (size_t r=0 ; r<rows.size() ; r++) {
+    int n = (int)rows[r].size() - 2;
+    double s1 = 0.0, s2 = 0.0;
+    for (int k=0 ; k<n ; k++) {
+      s1 += rows[r][2+k];
+      s2 += rows[r][2+k] * rows[r][2+k];
+    }
+    double mean = s1/n;
+    double sd = (n > 1)? sqrt(max(s2 - n*mean*mean, 0.0) / (n-1)) : 0.0;
+    cout << "corr " << r << " " << rows[r][0] << " " << rows[r][1] << " runs " << n << " " << mean << " " << sd << endl;
+  }
+}
+
+// reads the points and correlation rows of a summary, of the section "workload <name>" if name is not empty
+static void read_summary(const char* f, const string& name, vector<point_summary>& points, vector<corr_summary>& corr) {
+  ifstream in(f);
+  if (!in) {
+    cerr << "cannot read " << f << endl;
+    exit(8);
+  }
+  string line, key, w;
+  bool inside = name.empty(), found = name.empty();
+  while (getline(in, line)) {
+    istringstream s(line);
+    if (!(s >> key) || key[0] == '#')
+      continue;
+    if (key == "workload") {
+      s >> w;
+      inside = (w == name);
+      found = found || inside;
+      continue;
+    }
+    if (!inside)
+      continue;
+    long index;
+    int nq;
+    string label;
+    if (key == "point") {
+      point_summary p;
+      s >> index >> label >> p.trials >> label >> p.accepted >> label >> p.binary >> label >> p.successes
+	>> label >> p.score_mean >> p.score_sd >> label >> nq;
+      p.q.resize(nq);
+      for (int k=0 ; k<nq ; k++)
+	s >> p.q[k];
+      if (!s || index != (long)points.size()) {
+	cerr << "bad line in " << f << ": " << line.substr(0, 60) << endl;
+	exit(8);
+      }
+      points.push_back(p);
+    } else if (key == "corr") {
+      corr_summary c;
+      string mean, sd; // may be nan
+      s >> index >> c.alpha >> c.y >> label >> c.runs >> mean >> sd;
+      c.mean = strtod(mean.c_str(), NULL);
+      c.sd = strtod(sd.c_str(), NULL);
+      if (!s || index != (long)corr.size()) {
+	cerr << "bad line in " << f << ": " << line.substr(0, 60) << endl;
+	exit(8);
+      }
+      corr.push_back(c);
+    }
+  }
+  if (!found) {
+    cerr << "no workload " << name << " in " << f << endl;
+    exit(8);
+  }
+}
+
+// empirical distribution function at x from the quantiles q at equally spaced ranks
+static double quantile_cdf(const vector<double>& q, double x) {
+  size_t n = q.size();
+  if (x < q[0])
+    return 0.0;
+  if (x >= q[n-1])
+    return 1.0;
+  size_t i = upper_bound(q.begin(), q.end(), x) - q.begin(); // q[i-1] <= x < q[i]
+  double f = (q[i] > q[i-1])? (x - q[i-1]) / (q[i] - q[i-1]) : 1.0;
+  return (i - 1 + f) / (n - 1);
+}
+
+// Kolmogorov-Smirnov distance between the distributions of the quantiles a and b; the functions are
+// piecewise linear between the quantiles, so the supremum is at one of them
+static double ks_distance(const vector<double>& a, const vector<double>& b) {
+  double d = 0.0;
+  size_t i;
+  for (i=0 ; i<a.size() ; i++) {
+    d = max(d, fabs(quantile_cdf(a, a[i]) - quantile_cdf(b, a[i])));
+    d = max(d, fabs(quantile_cdf(a, a[i]) - quantile_cdf(b, a[i] - 1e-12*fabs(a[i]))));
+  }
+  for (i=0 ; i<b.size() ; i++) {
+    d = max(d, fabs(quantile_cdf(b, b[i]) - quantile_cdf(a, b[i])));
+    d = max(d, fabs(quantile_cdf(b, b[i]) - quantile_cdf(a, b[i] - 1e-12*fabs(b[i]))));
+  }
+  return d;
+}
+
+// asymptotic p-value of the two-sample Kolmogorov-Smirnov distance d between samples of n and m values
+static double ks_pvalue(double d, long n, long m) {
+  double ne = (double)n*m / (n+m);
+  double lambda = (sqrt(ne) + 0.12 + 0.11/sqrt(ne)) * d;
+  double p = 0.0, sign = 1.0;
+  if (lambda < 0.2)
+    return 1.0;
+  for (int k=1 ; k<=100 ; k++) {
+    double term = sign * 2.0 * exp(-2.0 * k*k * lambda*lambda);
+    p += term;
+    if (fabs(term) < 1e-12)
+      break;
+    sign = -sign;
+  }
+  return min(max(p, 0.0), 1.0);
+}
+
+// two-sided p-value of a standard normal deviate z
+static double normal_pvalue(double z) { return erfc(fabs(z) / sqrt(2.0)); }
+
+// two-sample binomial test of k1 of n1 against k2 of n2 (normal approximation with the pooled proportion)
+static double binomial_pvalue(long k1, long n1, long k2, long n2) {
+  double p = (double)(k1 + k2) / (n1 + n2);
+  double se = sqrt(p * (1-p) * (1.0/n1 + 1.0/n2));
+  if (se == 0.0)
+    return (k1*n2 == k2*n1)? 1.0 : 0.0;
+  return normal_pvalue(((double)k1/n1 - (double)k2/n2) / se);
+}
+
+// regularised incomplete beta function I_x(a, b) by its continued fraction (Lentz)
+static double incomplete_beta(double a, double b, double x) {
+  if (x <= 0.0 || x >= 1.0)
+    return (x <= 0.0)? 0.0 : 1.0;
+  if (x > (a+1)/(a+b+2))
+    return 1.0 - incomplete_beta(b, a, 1.0-x);
+  double front = exp(lgamma(a+b) - lgamma(a) - lgamma(b) + a*log(x) + b*log(1-x)) / a;
+  double c = 1.0, d = 1.0 - (a+b)*x/(a+1), f;
+  d = 1.0 / ((fabs(d) < 1e-300)? 1e-300 : d);
+  f = d;
+  for (int m=1 ; m<=300 ; m++) {
+    for (int even=0 ; even<2 ; even++) {
+      double num = even? -(a+m)*(a+b+m)*x / ((a+2*m)*(a+2*m+1)) : m*(b-m)*x / ((a+2*m-1)*(a+2*m));
+      d = 1.0 + num*d;
+      c = 1.0 + num/c;
+      d = 1.0 / ((fabs(d) < 1e-300)? 1e-300 : d);
+      c = (fabs(c) < 1e-300)? 1e-300 : c;
+      f *= c*d;
+    }
+    if (fabs(c*d - 1.0) < 1e-14)
+      break;
+  }
+  return front * f;
+}
+
+// two-sided p-value of t with nu degrees of freedom (Student)
+static double student_pvalue(double t, double nu) { return incomplete_beta(nu/2, 0.5, nu / (nu + t*t)); }
+
+// critical value c with pvalue(c) = level, by bisection
+template <class Pvalue>
+static double critical_value(Pvalue pvalue, double level) {
+  double lo = 0.0, hi = 1.0;
+  while (pvalue(hi) > level && hi < 1e6)
+    hi *= 2;
+  for (int k=0 ; k<100 ; k++) {
+    double mid = (lo + hi) / 2;
+    if (pvalue(mid) > level)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return hi;
+}
+
+struct test_result {
+  string label;
+  double p;
+  string detail;
+};
+
+static int compare(const char* ref_file, const char* cand_file, const options& opt) {
+  string name = opt.get_str("workload", "");
+  double alpha = opt.get("alpha", 0.01), tol = opt.get("tol", 0.0);
+  bool verbose = opt.get_long("verbose", 0) != 0;
+  vector<point_summary> ref, cand;
+  vector<corr_summary> ref_corr, cand_corr;
+  read_summary(ref_file, name, ref, ref_corr);
+  read_summary(cand_file, "", cand, cand_corr);
+  if (ref.size() != cand.size() || ref_corr.size() != cand_corr.size()) {
+    cerr << "the reference has " << ref.size() << " points and " << ref_corr.size() << " correlation rows, the candidate "
+	 << cand.size() << " and " << cand_corr.size() << endl;
+    exit(8);
+  }
+
+  // the # tests fixes the Bonferroni level, which the bands of the cohesion and correlations use
+  size_t p, ntests = 0, skipped = 0;
+  for (p=0 ; p<ref.size() ; p++)
+    ntests += 1 + 2*(ref[p].accepted > 0 && cand[p].accepted > 0);
+  for (p=0 ; p<ref_corr.size() ; p++)
+    if (std::isfinite(ref_corr[p].mean) && ref_corr[p].runs > 1)
+      ntests++;
+  double level = alpha / max(ntests, (size_t)1);
+  vector<test_result> tests;
+  char buf[256];
+
+  for (p=0 ; p<ref.size() ; p++) {
+    const point_summary& r = ref[p];
+    const point_summary& c = cand[p];
+    test_result res;
+    snprintf(buf, sizeof(buf), "point %zu", p);
+    string at(buf);
+
+    res.label = at + " discarded";
+    res.p = binomial_pvalue(r.trials - r.accepted, r.trials, c.trials - c.accepted, c.trials);
+    snprintf(buf, sizeof(buf), "%.5g vs %.5g", 1.0 - (double)r.accepted/r.trials, 1.0 - (double)c.accepted/c.trials);
+    res.detail = buf;
+    tests.push_back(res);
+    if (r.accepted == 0 || c.accepted == 0)
+      continue;
+
+    res.label = at + " time";
+    double d = ks_distance(r.q, c.q);
+    res.p = ks_pvalue(d, r.accepted, c.accepted);
+    snprintf(buf, sizeof(buf), "median %.5g vs %.5g, KS D=%.4g", r.q[r.q.size()/2], c.q[c.q.size()/2], d);
+    res.detail = buf;
+    tests.push_back(res);
+
+    if (r.binary) {
+      res.label = at + " precision";
+      res.p = binomial_pvalue(r.successes, r.accepted, c.successes, c.accepted);
+      snprintf(buf, sizeof(buf), "%.5g vs %.5g", r.score_mean, c.score_mean);
+    } else {
+      res.label = at + " cohesion";
+      double se = sqrt(r.score_sd*r.score_sd/r.accepted + c.score_sd*c.score_sd/c.accepted);
+      double diff = max(fabs(c.score_mean - r.score_mean) - tol, 0.0);
+      res.p = (se > 0.0)? normal_pvalue(diff / se) : ((diff == 0.0)? 1.0 : 0.0);
+      snprintf(buf, sizeof(buf), "%.5g vs %.5g, band +-%.3g", r.score_mean, c.score_mean,
+	       critical_value(normal_pvalue, level) * se + tol);
+    }
+    res.detail = buf;
+    tests.push_back(res);
+  }
+
+  for (p=0 ; p<ref_corr.size() ; p++) {
+    const corr_summary& r = ref_corr[p];
+    const corr_summary& c = cand_corr[p];
+    if (!std::isfinite(r.mean) || r.runs < 2) { // e.g. a precision of 1 at every point of the row
+      skipped++;
+      continue;
+    }
+    test_result res;
+    snprintf(buf, sizeof(buf), "corr %zu (alpha=%g y=%g)", p, r.alpha, r.y);
+    res.label = buf;
+    double nu = r.runs - 1;
+    double se = r.sd * sqrt(1.0/r.runs + 1.0/c.runs);
+    double diff = max(fabs(c.mean - r.mean) - tol, 0.0);
+    if (!std::isfinite(c.mean))
+      res.p = 0.0;
+    else
+      res.p = (se > 0.0)? student_pvalue(diff / se, nu) : ((diff == 0.0)? 1.0 : 0.0);
+    snprintf(buf, sizeof(buf), "%.4g vs %.4g, band +-%.3g", r.mean, c.mean,
+	     critical_value([nu](double t) { return student_pvalue(t, nu); }, level) * se + tol);
+    res.detail = buf;
+    tests.push_back(res);
+  }
+
+  long failed = 0;
+  double min_p = 1.0;
+  for (size_t k=0 ; k<tests.size() ; k++) {
+    bool fail = tests[k].p < level;
+    failed += fail;
+    min_p = min(min_p, tests[k].p);
+    if (fail || verbose)
+      cout << (name.empty()? "" : name + " ") << tests[k].label << ": " << tests[k].detail << ", p=" << tests[k].p
+	   << (fail? " FAIL" : " pass") << endl;
+  }
+  cout << (name.empty()? cand_file : name.c_str()) << " tests=" << tests.size() << " failed=" << failed << " min_p=" << min_p;
+  if (skipped > 0)
+    cout << " skipped=" << skipped;
+  cout << " " << ((failed == 0)? "PASS" : "FAIL") << endl;
+  return (failed == 0)? 0 : 1;
+}
+
+int main (int argc, char **argv) {
+
+  options opt(argc, argv);
+  string mode = (opt.npos() > 0)? opt.pos[0] : "";
+  if (mode == "summary" && opt.npos() == 2)
+    summarise_trials(opt.pos[1]);
+  else if (mode == "table" && opt.npos() >= 2)
+    summarise_tables(vector<const char*>(opt.pos.begin()+1, opt.pos.end()));
+  else if (mode == "compare" && opt.npos() == 3)
+    return compare(opt.pos[1], opt.pos[2], opt);
+  else {
+    cerr << "equivalence-test.out summary <per-trial output file>" << endl;
+    cerr << "equivalence-test.out table <output of speed-accuracy-coef.out> ..." << endl;
+    cerr << "equivalence-test.out compare <reference summary> <candidate summary> [workload=<name>] [alpha=0.01] [tol=0] [verbose=0]" << endl;
+    exit(8);
+  }
+  return 0;
+}
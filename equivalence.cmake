@@ -0,0 +1,200 @@
+# Statistical equivalence of a build or an engine with the frozen reference runs of equivalence-reference.txt,
+# run by "cmake --build <dir> --target equivalence" (see CMakeLists.txt and equivalence-test.cc).
+#
+# Every workload below, at the parameters of a figure of the paper, is run with the drivers of BIN_DIR and
+# the arguments ARGS (e.g. method=ensemble), summarised and compared with the reference run by
+# equivalence-test.out; the same workload is also run without ARGS by the drivers of REF_BIN_DIR (BIN_DIR by
+# default, e.g. a build with the default options) to time it. Prints one line per workload,
+#     <workload> tests=<n> failed=<n> min_p=<p> PASS|FAIL sec=<s> ref_sec=<s> speedup=<x>
+# preceded by the failed tests, and fails if a workload failed. The reference was run with the original
+# algorithms (method=exact, mt_stream), 20 times as many trials as the check and other seeds, so a check
+# that fails with the reference configuration itself means that the models or the engines changed.
+#
+#     cmake -DBIN_DIR=<dir> [-DREF_BIN_DIR=<dir>] [-DARGS=<arguments>] [-DWORKLOADS=<names>] [-DSEED=<n>]
+#           [-DALPHA=0.01] [-DTRIALS_SCALE=<k>] -P equivalence.cmake
+#     cmake -DBIN_DIR=<dir> -DFREEZE=ON -P equivalence.cmake      (rewrites equivalence-reference.txt)
+#
+# WORKLOADS is a ;-separated list of names (all by default); ARGS apply to all of them, so select those
+# whose driver has the option (speed-accuracy-coef.cc has no method=ensemble). TRIALS_SCALE (1 by default)
+# multiplies the # trials of the check, not those of the reference. ALPHA is the probability of a false
+# failure of a workload (equivalence-test.cc).
+
+cmake_minimum_required(VERSION 3.13)
+
+if(NOT BIN_DIR)
+  message(FATAL_ERROR "usage: cmake -DBIN_DIR=<dir of the executables> -P equivalence.cmake")
+endif()
+if(NOT REF_BIN_DIR)
+  set(REF_BIN_DIR ${BIN_DIR})
+endif()
+if(NOT TRIALS_SCALE)
+  set(TRIALS_SCALE 1)
+endif()
+if(NOT SEED)
+  set(SEED 777)
+endif()
+if(NOT ALPHA)
+  set(ALPHA 0.01)
+endif()
+set(REFERENCE ${CMAKE_CURRENT_LIST_DIR}/equivalence-reference.txt)
+set(REF_SCALE 20)
+set(REF_SEED 1001)
+set(WORK_DIR ${BIN_DIR}/equivalence)
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+# name|driver|arguments|trials[|runs]: per-trial workloads (output=) compare their points, those with runs
+# (speed-accuracy-coef.cc) the correlation coefficients of that many runs with different seeds
+set(workloads
+  "fig4|finite-nestchoice|0.1 0.1 0.06667,0.13334,0.2,0.26667,0.33334,0.4 0.3 0.5 100|10000"
+  "fig7|finite-nestchoice|0.1 0.1 0.2 0.1:0.4:0.1 0.5 100|10000"
+  "fig9-Nnest2|cohesion-tradeoff|0.1 0.02,0.1,0.2,0.4 100 2|10000"
+  "fig9-Nnest6|cohesion-tradeoff|0.1 0.06,0.18,0.36 100 6|10000"
+  "fig9-alpha|cohesion-tradeoff|0.01,0.1,1 0.12 100 4|10000"
+  # many recruiters: from z=0.8 the trials start at the quorum (Fig. S2 threshold) or with 90% of the ants out
+  # of the old nest, which checks how an engine starts and stops its trials
+  "fig7-highz|finite-nestchoice|0.1 0.1 0.2 0.6,0.8,0.9 0.4 100|10000"
+  "fig9-highz|cohesion-tradeoff|0.1 0.8,0.9,0.95 100 2|10000"
+  "fig6|speed-accuracy-coef|0 alpha_s=0.1|2000|2")
+
+# microseconds since the epoch (seconds before CMake 3.23, which has no %f)
+function(now_usec out)
+  if(CMAKE_VERSION VERSION_LESS 3.23)
+    string(TIMESTAMP s "%s")
+    math(EXPR us "${s} * 1000000")
+  else()
+    string(TIMESTAMP us "%s%f")
+  endif()
+  set(${out} ${us} PARENT_SCOPE)
+endfunction()
+
+# x.yy from hundredths
+function(format_hundredths h out)
+  math(EXPR i "${h} / 100")
+  math(EXPR f "${h} % 100 + 100")
+  string(SUBSTRING ${f} 1 2 f)
+  set(${out} "${i}.${f}" PARENT_SCOPE)
+endfunction()
+
+# runs driver with argv, trials and seed, writing the per-trial file or the table to out; sets <us> to the time
+function(run_driver dir driver argv trials seed out us)
+  if(out MATCHES "\\.antt$")
+    set(cmd ${dir}/${driver}.out ${argv} trials=${trials} seed=${seed} output=${out})
+    set(stdout /dev/null)
+  else()
+    set(cmd ${dir}/${driver}.out ${argv} trials=${trials} seed=${seed})
+    set(stdout ${out})
+  endif()
+  now_usec(t0)
+  execute_process(COMMAND ${cmd} RESULT_VARIABLE rc OUTPUT_FILE ${stdout} ERROR_QUIET)
+  now_usec(t1)
+  if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "${driver}.out ${argv} failed (${rc})")
+  endif()
+  math(EXPR t "${t1} - ${t0}")
+  if(t LESS 1)
+    set(t 1)
+  endif()
+  set(${us} ${t} PARENT_SCOPE)
+endfunction()
+
+# summary of the per-trial file or of the tables of a workload
+function(summarise files out)
+  if(files MATCHES "\\.antt$")
+    set(mode summary)
+  else()
+    set(mode table)
+  endif()
+  execute_process(COMMAND ${BIN_DIR}/equivalence-test.out ${mode} ${files} RESULT_VARIABLE rc OUTPUT_VARIABLE s)
+  if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "equivalence-test.out ${mode} failed")
+  endif()
+  set(${out} "${s}" PARENT_SCOPE)
+endfunction()
+
+if(FREEZE)
+  set(reference "# frozen reference runs of equivalence.cmake (method=exact, mt_stream); equivalence-test.cc summaries\n")
+endif()
+set(failed_workloads)
+
+foreach(w ${workloads})
+  string(REPLACE "|" ";" fields "${w}")
+  list(GET fields 0 name)
+  list(GET fields 1 driver)
+  list(GET fields 2 args)
+  list(GET fields 3 trials)
+  list(LENGTH fields nfields)
+  set(runs 0)
+  if(nfields GREATER 4)
+    list(GET fields 4 runs)
+  endif()
+  if(WORKLOADS AND NOT FREEZE AND NOT name IN_LIST WORKLOADS)
+    continue()
+  endif()
+  separate_arguments(argv UNIX_COMMAND "${args}")
+
+  if(FREEZE)
+    math(EXPR n "${trials} * ${REF_SCALE}")
+    set(files)
+    if(runs EQUAL 0)
+      set(files ${WORK_DIR}/${name}-ref.antt)
+      run_driver(${BIN_DIR} ${driver} "${argv}" ${n} ${REF_SEED} ${files} us)
+    else()
+      # as many runs of the # trials of the check, for the spread of a run
+      math(EXPR nruns "${REF_SCALE} - 1")
+      foreach(k RANGE ${nruns})
+        math(EXPR seed "${REF_SEED} + ${k}")
+        run_driver(${BIN_DIR} ${driver} "${argv}" ${trials} ${seed} ${WORK_DIR}/${name}-ref-${k}.txt us)
+        list(APPEND files ${WORK_DIR}/${name}-ref-${k}.txt)
+      endforeach()
+    endif()
+    summarise("${files}" s)
+    string(REGEX REPLACE "# [^\n]*\n" "" s "${s}")
+    string(APPEND reference "workload ${name} ${driver} ${args}\n${s}")
+    message("${name}: frozen")
+    continue()
+  endif()
+
+  math(EXPR trials "${trials} * ${TRIALS_SCALE}")
+  separate_arguments(extra UNIX_COMMAND "${ARGS}")
+  if(runs EQUAL 0)
+    set(files ${WORK_DIR}/${name}.antt)
+    run_driver(${BIN_DIR} ${driver} "${argv};${extra}" ${trials} ${SEED} ${files} us)
+    run_driver(${REF_BIN_DIR} ${driver} "${argv}" ${trials} ${SEED} ${WORK_DIR}/${name}-timing.antt ref_us)
+  else()
+    set(files)
+    set(us 0)
+    math(EXPR last "${runs} - 1")
+    foreach(k RANGE ${last})
+      math(EXPR seed "${SEED} + ${k}")
+      run_driver(${BIN_DIR} ${driver} "${argv};${extra}" ${trials} ${seed} ${WORK_DIR}/${name}-${k}.txt run_us)
+      math(EXPR us "${us} + ${run_us}")
+      list(APPEND files ${WORK_DIR}/${name}-${k}.txt)
+    endforeach()
+    math(EXPR us "${us} / ${runs}")
+    run_driver(${REF_BIN_DIR} ${driver} "${argv}" ${trials} ${SEED} ${WORK_DIR}/${name}-timing.txt ref_us)
+  endif()
+  summarise("${files}" s)
+  file(WRITE ${WORK_DIR}/${name}.sum "${s}")
+  execute_process(COMMAND ${BIN_DIR}/equivalence-test.out compare ${REFERENCE} ${WORK_DIR}/${name}.sum
+    workload=${name} alpha=${ALPHA} RESULT_VARIABLE rc OUTPUT_VARIABLE verdict OUTPUT_STRIP_TRAILING_WHITESPACE)
+  if(rc EQUAL 1)
+    list(APPEND failed_workloads ${name})
+  elseif(NOT rc EQUAL 0)
+    message(FATAL_ERROR "${name}: equivalence-test.out compare failed (${rc})")
+  endif()
+
+  math(EXPR sec "${us} / 10000")
+  math(EXPR ref_sec "${ref_us} / 10000")
+  math(EXPR speedup "${ref_us} * 100 / ${us}")
+  format_hundredths(${sec} sec)
+  format_hundredths(${ref_sec} ref_sec)
+  format_hundredths(${speedup} speedup)
+  message("${verdict} sec=${sec} ref_sec=${ref_sec} speedup=${speedup}")
+endforeach()
+
+if(FREEZE)
+  file(WRITE ${REFERENCE} "${reference}")
+  message("wrote ${REFERENCE}")
+elseif(failed_workloads)
+  message(FATAL_ERROR "not equivalent to the reference: ${failed_workloads}")
+endif()
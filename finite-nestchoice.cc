@@ -1,24 +1,63 @@
 /* nest-choice numerical simulations
 
-Mersenne Twister pseudo-random number generator code mt19937ar.c is needed. 
-One can download mt19937ar.c from various websites.
-One needs to correct the folder's name in
-    #include "../lib/stat/mt19937ar.c"
-below to your local folder's name.
-
-In the following, p={a,b,c} means that one needs to run the code with parameter p=a, p=b, and p=c, and collect results.
+Every parameter can be given as a list of values or ranges (see sweep.h), and the whole grid
+of parameter values is simulated in one process, with one output line per grid point
+in the order of the grid (the first parameter varies slowest).
 
 Produce the results shown in Figure 4 by running
-        a.out alpha=0.1 alpha_s=0.1 H={0.06667,0.13334,0.2,0.26667,0.33334,0.4} z=0.3 threshold=0.5 Na=100
+        a.out 0.1 0.1 0.06667,0.13334,0.2,0.26667,0.33334,0.4 0.3 0.5 100
 
 Produce the results shown in Figure 7 by running
-        a.out alpha=0.1 alpha_s=0.1 H=0.2 z={0.1,0.2,0.3,0.4} threshold=0.5 Na=100
+        a.out 0.1 0.1 0.2 0.1:0.4:0.1 0.5 100
 
 Produce the results shown in Figure S2 by running
-        a.out alpha=0.1 alpha_s=0.1 H=0.2 z=0.3 threshold={0.25,0.3,0.35,0.4,0.45,0.5} Na=100
+        a.out 0.1 0.1 0.2 0.3 0.25:0.5:0.05 100
 
 Produce the results shown in Figure S4 by running
-        a.out alpha=0.1 alpha_s={0,0.1,0.2,0.3,0.4,0.5} H=0.2 z=0.3 threshold=0.5 Na=100 
+        a.out 0.1 0:0.5:0.1 0.2 0.3 0.5 100
+
+The order of the arguments is alpha alpha_s H z threshold Na.
+
+Trials run in parallel on all cores (see trial-runner.h). The optional arguments
+        trials=10000 threads=#cores seed=random
+set the number of trials per grid point, the number of threads and the seed. The output depends only on the seed.
+alpha_leak=0.05 sets the rate at which ants leak back to the old nest.
+
+For large Na, the optional argument method=tau selects approximate tau leaping, and method=hybrid
+tau leaping that switches to the exact SSA near the end of the trial, so that the stopping time and
+the nest reaching the quorum are not distorted by a leap overshooting the quorum (see ssa-engine.h and bench-tauleap.cc).
+method=ensemble runs the exact SSA on ENSEMBLE_LANES trials in lockstep with vectorised loops (see ensemble-ssa.h),
+which is faster for small Na; the results are statistically but not bitwise equal to those of method=exact
+(equivalence-test.cc checks them).
+
+Adaptive mode: with the optional arguments
+        tol=<x> rtol=<y> batch=1000
+trials are run in batches of "batch" trials until the 95% confidence interval (Wilson interval) of the
+precision has half-width <= x and that of the mean time to quorum has half-width <= y times the mean.
+trials= is then the maximum # trials per grid point, and the # trials used is appended to each line.
+
+Distributions: quantiles=1 appends the 5, 25, 50, 75 and 95 percentiles of the time to quorum (before the
+# trials of the adaptive mode), estimated by streaming t-digests without storing the trials, and
+output=<file> writes every realisation (time, score, winning nest, # events, final compartments) to <file>
+in the compact binary format of trial-output.h; trial-dump.cc converts it to text.
+
+Caps: max_events=<n> and max_seconds=<s> stop any realisation after n events or s seconds of wall time; such
+realisations are not used, and their # is appended to each line (see trial-cap.h). rare-nestchoice.cc estimates
+the probability of choosing the poor nest and the tail of the time to quorum where they are too small for this driver.
+
+Trajectories: record=<file> writes the mean, standard deviation and percentiles of the recruiters and of the
+ants at each new nest over the accepted realisations at the times 0, record_dt, ..., record_tmax (1 and 100
+by default), one block per grid point, whose columns 2-5 overlay those of diffeqn-nestchoice.cc
+(see trajectory-recorder.h; exact SSA only).
+
+Long sweeps: checkpoint=<file> saves every finished chunk of trials to <file> and resumes from it when it exists,
+and shard=i/N checkpoint=<file> seed=<seed> runs the i-th of N slices of the sweep, e.g., on a cluster;
+sweep-merge.cc merges the files of the shards (see checkpoint.h).
+
+Result cache: cache=<dir> keeps the partial sums of every chunk of trials in <dir>, keyed by the parameters of
+the point and the seed (seed=1 by default), so that a later run at the same points prints at once and a run with
+more trials simulates only the new chunks (see result-cache.h). daemon=<socket> cache=<dir> starts a resident
+server, and <arguments> connect=<socket> runs the query in it (see sweep-daemon.h).
 */
 
 
@@ -27,16 +66,26 @@ using namespace std;
 #include <fstream>
 #include <cstdlib> // atoi
 #include <cmath> // cos, sin
-#include "../lib/stat/mt19937ar.c"
 #include <ctime>
-
-int compare_finite_nestchoice (const void *a, const void *b) {
-  return (*(double*)a-*(double*)b);
-}
-
-int main (int argc, char **argv) {
-
-  if (argc != 7) {
+#include <vector>
+#include <string>
+#include <sstream>
+#include "options.h"
+#include "sweep.h"
+#include "nest-models.h"
+#include "trial-runner.h"
+#include "checkpoint.h"
+#include "result-cache.h"
+#include "sweep-daemon.h"
+#include "ensemble-ssa.h"
+#include "trial-output.h"
+#include "trial-cap.h"
+#include "trajectory-recorder.h"
+
+static int finite_nestchoice(int argc, char **argv) {
+
+  options opt(argc, argv);
+  if (opt.npos() != 6) {
     cerr << "finite-nestchoice.out alpha alpha_s H z threshold Na" << endl;
     cerr << "alpha: rate at which committed ants convert to recruits, common to low-threshold and high-threshold ants" << endl;
     cerr << "alpha_s: rate at which high-threshold ants visiting the poor nest moves to the good nest" << endl;
@@ -44,149 +93,132 @@ int main (int argc, char **argv) {
      cerr << "z: initial fraction of recruiters" << endl;
      cerr << "threshold: quorum threshold, between 0 and 1" << endl;
      cerr << "Na: number of ants" << endl;
+    usage_common_options();
+    cerr << "distributions: quantiles=1 (percentiles of the time), output=<file> (binary per-trial records, see trial-dump.cc)" << endl;
+    cerr << "per-trial caps: max_events=<n> max_seconds=<s> (# capped realisations appended, see trial-cap.h)" << endl;
+    cerr << "trajectories: record=<file> record_dt=1 record_tmax=100 (ensemble mean and percentiles, see trajectory-recorder.h)" << endl;
+    cerr << "result cache: cache=<dir> (see result-cache.h); daemon=<socket> cache=<dir> serves connect=<socket> (see sweep-daemon.h)" << endl;
     exit(8);
   }
 
-  init_genrand(time(NULL));
-  double alpha = atof(argv[1]); // conversion rate from committed to recruit
-  double alpha_g = alpha;
-  double alpha_p = alpha;
-  double alpha_s = atof(argv[2]); // rate at which high-threshold ants visiting the poor nest move to the good nest
-  double alpha_leak = 0.05;
+  unsigned long seed = sweep_seed(opt); // seed=, or that of the checkpoint file
+  cerr << "seed = " << seed << endl;
+  double alpha_leak = opt.get("alpha_leak", 0.05);
   cerr << "leak rate = " << alpha_leak << endl;
-  double H = atof(argv[3]); // fraction of high-threshold ants
-  double L = 1-H; // fraction of low-threshold ants
-  double z = atof(argv[4]); // initial fraction of recruiters
-  double th_quorum_frac = atof(argv[5]); // quorum threshold (normalized by N_ant)
-  int Na = atoi(argv[6]);
-  int th_quorum = (int)(th_quorum_frac*Na); // quorum threshold
+
+  // alpha: conversion rate from committed to recruit
+  // alpha_s: rate at which high-threshold ants visiting the poor nest move to the good nest
+  // H: fraction of high-threshold ants
+  // z: initial fraction of recruiters
+  // threshold: quorum threshold (normalized by N_ant)
+  grid g;
+  for (int i=0 ; i<6 ; i++)
+    g.add(opt.pos[i]);
+  long npoints = g.size();
+  long p;
+  int x[LH_COMPARTMENTS];
   int tmp_sum;
 
-  int trials = 10000;
-  int tr;
-
-  cerr << "Quorum threshold (fractional) = " << th_quorum_frac << endl;
-  double precision = 0.0; // % correct collective decision
-
-  double t;
-  //  double t_quorum_list[trials]; // time to quorum for each trial
-  double t_quorum_ave = 0.0;
-  double t_quorum_std = 0.0;
-  
-  int i;
-  double accum_rate[15], ra;
-
-
-  int L_oldnest, H_oldnest, L_poor_com, L_poor_rec, H_poor_vis, L_good_com, H_good_com, L_good_rec, H_good_rec;
-
-  tr = 0;
-  while (tr < trials) {
-    // initialization
-    t = 0.0;
-    H_oldnest = (int)(Na*H*(1-z)+1e-8);
-    L_oldnest = (int)(Na*(1-z)+1e-8) - H_oldnest;
-    H_poor_vis = H_good_com = (int)((Na*H*z+1e-8)/2);
-    L_poor_com = (int)((Na*z+1e-8)/2) - H_poor_vis;
-    L_good_com = (int)((Na*z+1e-8)/2) - H_good_com;
-    L_poor_rec = L_good_rec = H_good_rec = 0;
-    tmp_sum = H_oldnest + L_oldnest + H_poor_vis + L_poor_com + H_good_com + L_good_com;
-    if (tmp_sum < Na)
-      H_oldnest += Na - tmp_sum;
-    if (tr==0)
-      cerr << "Na - tmp_sum = " << Na - tmp_sum << "; " << H_oldnest << " " << L_oldnest << " " << H_poor_vis << " " << L_poor_com << " " << H_good_com << " " << L_good_com << endl;
-
-    while (L_oldnest + H_oldnest < Na && L_good_com + H_good_com + L_good_rec + H_good_rec < th_quorum && L_poor_com + L_poor_rec + H_poor_vis < th_quorum) {
-
-#ifdef VERBOSE
-	if ((int)(t*100) > (int)((t-dt)*100))
-	  cout << t << " " << (double)good_com/Na << " " << (double)(good_com + good_rec)/Na << " " << (double)L_poor_com/Na << " " << (double)(L_poor_com + L_poor_rec)/Na << endl;
-#endif // VERBOSE
-
-	accum_rate[0] = (double)L_poor_rec * L_oldnest / Na;
-      	accum_rate[1] = accum_rate[0] + (double)L_poor_rec * H_oldnest / Na;
-	accum_rate[2] = accum_rate[1] + (double)(L_good_rec + H_good_rec) * L_oldnest / Na;
-	accum_rate[3] = accum_rate[2] + (double)(L_good_rec + H_good_rec) * H_oldnest / Na;
-	accum_rate[4] = accum_rate[3] + alpha_p * L_poor_com; // commited -> recruiter
-	accum_rate[5] = accum_rate[4] + alpha_g * L_good_com;
-	accum_rate[6] = accum_rate[5] + alpha_g * H_good_com;
-	accum_rate[7] = accum_rate[6] + alpha_s * H_poor_vis;
-	accum_rate[8] = accum_rate[7] + alpha_leak * L_poor_com;
-	accum_rate[9] = accum_rate[8] + alpha_leak * H_poor_vis;
-	accum_rate[10] = accum_rate[9] + alpha_leak * L_poor_rec;
-	accum_rate[11] = accum_rate[10] + alpha_leak * L_good_com;
-	accum_rate[12] = accum_rate[11] + alpha_leak * H_good_com;
-	accum_rate[13] = accum_rate[12] + alpha_leak * L_good_rec;
-	accum_rate[14] = accum_rate[13] + alpha_leak * H_good_rec;
-
-	ra = (genrand_int32()+0.5)/4294967296.0 * accum_rate[14];
-
-	if (ra < accum_rate[0]) {
-	  L_oldnest--;
-	  L_poor_com++;
-	} else if (ra < accum_rate[1]) {
-	  H_oldnest--;
-	  H_poor_vis++;
-	} else if (ra < accum_rate[2]) {
-	  L_oldnest--;
-	  L_good_com++;
-	} else if (ra < accum_rate[3]) {
-	  H_oldnest--;
-	  H_good_com++;
-	} else if (ra < accum_rate[4]) {
-	  L_poor_com--;
-	  L_poor_rec++;
-	} else if (ra < accum_rate[5]) {
-	  L_good_com--;
-	  L_good_rec++;
-	} else if (ra < accum_rate[6]) {
-	  H_good_com--;
-	  H_good_rec++;
-	} else if (ra < accum_rate[7]) { 
-	  H_poor_vis--;
-	  H_good_com++;
-	} else if (ra < accum_rate[8]) { // leak
-	  L_poor_com--;
-	  L_oldnest++;
-	} else if (ra < accum_rate[9]) {
-	  H_poor_vis--;
-	  H_oldnest++;
-	} else if (ra < accum_rate[10]) {
-	  L_poor_rec--;
-	  L_oldnest++;
-	} else if (ra < accum_rate[11]) {
-	  L_good_com--;
-	  L_oldnest++;
-	} else if (ra < accum_rate[12]) {
-	  H_good_com--;
-	  H_oldnest++;
-	} else if (ra < accum_rate[13]) {
-	  L_good_rec--;
-	  L_oldnest++;
-	} else if (ra < accum_rate[14]) {
-	  H_good_rec--;
-	  H_oldnest++;
-	}
-	t += -1.0/accum_rate[14]*log((genrand_int32()+0.5)/4294967296.0);
-    } // dynamics done
-
-
-      if (L_oldnest + H_oldnest < Na) { // quorum reached in either new site
-	//	t_quorum_list[tr] = t;
-	tr++;
-	t_quorum_ave += t;
-	t_quorum_std += t*t;
-	if (L_good_com + H_good_com + L_good_rec + H_good_rec == th_quorum)
-	  precision += 1.0;
-      }
-  } // all trials done
-      
-  //  qsort(t_quorum_list,trials,sizeof(double),compare_finite_nestchoice);
-  
-  t_quorum_ave /= trials;
-  t_quorum_std = sqrt(t_quorum_std/trials - t_quorum_ave*t_quorum_ave);
-  precision /= trials;
-  cout << H << " " << alpha_s << " " << z << " " << th_quorum_frac << " " << t_quorum_ave << " " << t_quorum_std << " " << precision << endl;
-      // cout << " " << t_quorum_list[(int)(trials*0.05)] << " " << t_quorum_list[(int)(trials*0.25)] << " " << t_quorum_list[(int)(trials*0.5)] << " " << t_quorum_list[(int)(trials*0.75)] << " " << t_quorum_list[(int)(trials*0.95)] << endl;
+  vector<ssa_network> nets;
+  for (p=0 ; p<npoints ; p++) {
+    vector<double> v = g.point(p);
+    int Na = (int)v[5];
+    tmp_sum = lh_init(x, v[2], v[3], Na); // Na - # ants placed before the rounding correction
+    if (tmp_sum > 0)
+      cerr << "Na - tmp_sum = " << tmp_sum << "; " << x[H_OLDNEST] << " " << x[L_OLDNEST] << " " << x[H_POOR_VIS] << " " << x[L_POOR_COM] << " " << x[H_GOOD_COM] << " " << x[L_GOOD_COM] << endl;
+    nets.push_back(lh_network(v[0], v[1], alpha_leak, Na));
+  }
 
+  stop_rule rule(opt.get_long("batch", 1000), opt.get("tol", 0.0), opt.get("rtol", 0.0), true);
+  sweep_checkpoint* ckpt = sweep_checkpoint_from(opt, "finite-nestchoice", seed, npoints, rule);
+  result_cache* cache = result_cache_from(opt, "finite-nestchoice", seed, g, opt.trials());
+  chunk_store* store = (ckpt != NULL)? (chunk_store*)ckpt : cache;
+
+  int method = opt.method();
+  trial_cap cap = trial_cap_from(opt);
+  long capped = 0;
+
+  // per-trial binary output and quantiles of the time (see trial-output.h)
+  trial_writer* out = opt.has("output")? new trial_writer(opt.get_str("output", "").c_str(), seed) : NULL;
+  trial_quantiles* quantiles = (opt.get_long("quantiles", 0) != 0)? new trial_quantiles(npoints) : NULL;
+  // time-resolved ensemble of the trajectories (see trajectory-recorder.h)
+  trajectory_recorder* rec = trajectory_recorder_from(opt, lh_observables(), LH_COMPARTMENTS, npoints);
+
+  auto make_trial = [&](long p) {
+    vector<double> v = g.point(p);
+    int Na = (int)v[5];
+    lh_trial trial(nets[p], v[2], v[3], Na, quorum_ants(v[4], Na), method);
+    trial.cap = cap;
+    if (rec != NULL)
+      trial.trace = trajectory_trace(rec, p);
+    return trial;
+  };
+  auto emit = [&](long p, const trial_sums& sums) {
+    vector<double> v = g.point(p);
+    double t_quorum_ave = sums.t_ave(); // time to quorum
+    double t_quorum_std = sums.t_std();
+    double precision = sums.s_ave(); // % correct collective decision
+    cout << v[2] << " " << v[1] << " " << v[3] << " " << v[4] << " " << t_quorum_ave << " " << t_quorum_std << " " << precision;
+    if (quantiles != NULL) {
+      tdigest d = quantiles->merged(p);
+      const double q[] = {0.05, 0.25, 0.5, 0.75, 0.95};
+      for (int k=0 ; k<5 ; k++)
+	cout << " " << d.quantile(q[k]);
+    }
+    if (rule.adaptive())
+      cout << " " << sums.n;
+    if (cap.active())
+      cout << " " << sums.capped;
+    capped += sums.capped;
+    cout << endl;
+  };
+  if ((out != NULL || quantiles != NULL) && ckpt != NULL) {
+    cerr << "output= and quantiles= are not available with checkpoint=" << endl;
+    exit(8);
+  }
+  if (method == SSA_ENSEMBLE) {
+    if (cap.active()) {
+      cerr << "max_events= and max_seconds= are not available with method=ensemble" << endl;
+      exit(8);
+    }
+    auto make_ensemble = [&](long p) { return ensemble_trial<lh_trial>(nets[p], make_trial(p)); };
+    if (out != NULL || quantiles != NULL) {
+      auto make_recorded = [&](long p) { return recorded_trial<ensemble_trial<lh_trial> >(make_ensemble(p), out, quantiles); };
+      run_sweep(make_recorded, npoints, opt.trials(), seed, opt.threads(), emit, rule, 1, store);
+    } else
+      run_sweep(make_ensemble, npoints, opt.trials(), seed, opt.threads(), emit, rule, 1, store);
+  } else if (out != NULL || quantiles != NULL) {
+    auto make_recorded = [&](long p) { return recorded_trial<lh_trial>(make_trial(p), out, quantiles); };
+    run_sweep(make_recorded, npoints, opt.trials(), seed, opt.threads(), emit, rule, 1, store);
+  } else
+    run_sweep(make_trial, npoints, opt.trials(), seed, opt.threads(), emit, rule, 1, store);
+
+  delete out; // flushes the file
+  delete quantiles;
+  if (rec != NULL) {
+    vector<string> label(npoints);
+    for (p=0 ; p<npoints ; p++) {
+      vector<double> v = g.point(p);
+      ostringstream s;
+      s << "alpha=" << v[0] << " alpha_s=" << v[1] << " H=" << v[2] << " z=" << v[3] << " threshold=" << v[4] << " Na=" << v[5];
+      label[p] = s.str();
+    }
+    if (!rec->write(opt.get_str("record", "").c_str(), label))
+      cerr << "cannot write " << opt.get_str("record", "") << endl;
+    delete rec;
+  }
+  if (cap.active() && (ckpt == NULL || !ckpt->sharded()))
+    cerr << capped << " realisations capped" << endl;
+  if (ckpt != NULL && ckpt->sharded())
+    cerr << "shard " << opt.get_str("shard", "") << ": " << ckpt->written << " chunks written to " << opt.get_str("checkpoint", "") << endl;
+  delete ckpt;
+  if (cache != NULL)
+    cerr << cache->hits << " chunks from the cache " << opt.get_str("cache", "") << ", " << cache->simulated << " simulated" << endl;
+  delete cache;
+  ssa_profile_report("finite-nestchoice"); // with -DSSA_PROFILE (see ssa-profile.h)
   return 0;
 }
+
+int main (int argc, char **argv) {
+  return sweep_main(argc, argv, finite_nestchoice, "finite-nestchoice.out"); // daemon=, connect= (see sweep-daemon.h)
+}
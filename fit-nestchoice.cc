@@ -0,0 +1,306 @@
+/* Least-squares fit of the mean-field L/H model (diffeqn-nestchoice.cc) to observed emigration curves.
+
+Usage:
+        a.out <data file> [fit=alpha,alpha_s,H,alpha_leak] [alpha=0.1] [alpha_s=0.1] [H=0.2] [z=0.3] [alpha_leak=0.05]
+
+The data file has the columns of diffeqn-nestchoice.cc,
+        t <recruiters of the good nest> <ants at the good nest> <recruiters of the poor nest> <ants at the poor nest>
+as fractions of the colony, one line per observation time (increasing, from t = 0 on); lines starting with #
+are skipped, and a value "nan" marks a missing observation. Further columns are ignored, so that the output of
+record=<file> of finite-nestchoice.cc (trajectory-recorder.h) can be fitted directly; block=<i> selects the i-th
+of the blocks separated by blank lines (0 by default).
+
+The parameters named in fit= are fitted, from the initial values given by alpha= etc., and the others are held
+at these values. The sum of the squared differences between the model and the observations is minimised by
+Levenberg-Marquardt, with the Jacobian of the residuals from the forward sensitivities of ode-sensitivity.h:
+each iteration takes a single integration of the rate equations, whatever the # fitted parameters. A step that
+would leave the domain of the parameters (rates >= 0, 0 <= H, z <= 1) is rejected like one that increases the
+sum of squares. One output line
+        alpha alpha_s H z alpha_leak <sum of squares> <# observations>
+is printed, and to stderr the iterations and the standard errors of the fitted parameters, from the inverse of
+J^T J times the residual variance. The optional arguments rtol=1e-8 atol=1e-10 are those of diffeqn-nestchoice.cc,
+and max_iter=100 bounds the # iterations.
+
+For example, the curves of Figure 3,
+        diffeqn-nestchoice.out 0.1 0.1 0.2 0.3 > fig3.dat
+        a.out fig3.dat alpha=0.2 alpha_s=0.05 H=0.3 alpha_leak=0.1
+recover alpha = 0.1, alpha_s = 0.1, H = 0.2 and alpha_leak = 0.05.
+*/
+
+#include <iostream>
+using namespace std;
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "options.h"
+#include "nest-models.h"
+#include "ode-solver.h"
+#include "ode-sensitivity.h"
+
+enum { FIT_COLUMNS = 4 }; // the columns of diffeqn-nestchoice.cc
+
+// compartments summed in each column
+static const vector<int> fit_column(int c) {
+  static const int good_rec[] = {L_GOOD_REC, H_GOOD_REC};
+  static const int good[] = {L_GOOD_COM, H_GOOD_COM, L_GOOD_REC, H_GOOD_REC};
+  static const int poor_rec[] = {L_POOR_REC};
+  static const int poor[] = {L_POOR_COM, L_POOR_REC, H_POOR_VIS};
+  switch (c) {
+  case 0: return vector<int>(good_rec, good_rec + 2);
+  case 1: return vector<int>(good, good + 4);
+  case 2: return vector<int>(poor_rec, poor_rec + 1);
+  default: return vector<int>(poor, poor + 3);
+  }
+}
+
+// observation times and values (FIT_COLUMNS per time, NaN if missing) of block "block" of the file
+static void read_data(const char* path, int block, vector<double>& times, vector<double>& values) {
+  ifstream in(path);
+  if (!in) {
+    cerr << "cannot open " << path << endl;
+    exit(8);
+  }
+  string line;
+  int b = 0;
+  bool in_block = false;
+  while (getline(in, line)) {
+    if (line.empty() || line.find_first_not_of(" \t\r") == string::npos) { // blank lines end a block
+      if (in_block)
+	b++;
+      in_block = false;
+      continue;
+    }
+    in_block = true;
+    if (line[0] == '#' || b != block)
+      continue;
+    istringstream s(line);
+    string item;
+    vector<double> v;
+    while ((int)v.size() < 1+FIT_COLUMNS && s >> item)
+      v.push_back(atof(item.c_str()));
+    if ((int)v.size() < 1+FIT_COLUMNS) {
+      cerr << "fewer than " << 1+FIT_COLUMNS << " columns: " << line << endl;
+      exit(8);
+    }
+    if (v[0] < 0.0 || (!times.empty() && v[0] < times.back())) {
+      cerr << "the times must be non-negative and increasing: " << line << endl;
+      exit(8);
+    }
+    times.push_back(v[0]);
+    values.insert(values.end(), v.begin()+1, v.end());
+  }
+  if (times.empty()) {
+    cerr << "no data in block " << block << " of " << path << endl;
+    exit(8);
+  }
+}
+
+// solves A x = b for symmetric positive definite A (q x q) by Cholesky; false if A is singular
+static bool cholesky_solve(vector<double> A, vector<double>& x, int q) {
+  int i, j, k;
+  for (j=0 ; j<q ; j++) {
+    for (k=0 ; k<j ; k++)
+      A[j*q+j] -= A[j*q+k] * A[j*q+k];
+    if (!(A[j*q+j] > 0.0))
+      return false;
+    A[j*q+j] = sqrt(A[j*q+j]);
+    for (i=j+1 ; i<q ; i++) {
+      for (k=0 ; k<j ; k++)
+	A[i*q+j] -= A[i*q+k] * A[j*q+k];
+      A[i*q+j] /= A[j*q+j];
+    }
+  }
+  for (i=0 ; i<q ; i++) { // L y = b
+    for (k=0 ; k<i ; k++)
+      x[i] -= A[i*q+k] * x[k];
+    x[i] /= A[i*q+i];
+  }
+  for (i=q-1 ; i>=0 ; i--) { // L^T x = y
+    for (k=i+1 ; k<q ; k++)
+      x[i] -= A[k*q+i] * x[k];
+    x[i] /= A[i*q+i];
+  }
+  return true;
+}
+
+struct fit_problem {
+  vector<double> times, values;
+  vector<int> fitted; // indices of the fitted parameters
+  vector<vector<int> > columns;
+  double rtol, atol;
+
+  /* residuals r (model - data, 0 for missing values) and their Jacobian J (row-major, one column per fitted
+     parameter) at par, from one integration of the rate equations and their sensitivities; returns the sum of squares */
+  double residuals(const double* par, vector<double>& r, vector<double>& J) const {
+    const int n = LH_COMPARTMENTS, N = LH_PARAMS, q = (int)fitted.size();
+    vector<double> Y(n*(1+N)), Yt(n*(1+N));
+    lh_sensitivity_init(par, &Y[0]);
+    lh_sensitivity_rhs rhs(n, lh_dual_drift(par));
+    dopri5 ode(n*(1+N), rtol, atol);
+    ode.init(rhs, 0.0, &Y[0]);
+    size_t k, m;
+    int c, p;
+    double ss = 0.0;
+    r.assign(times.size() * FIT_COLUMNS, 0.0);
+    J.assign(times.size() * FIT_COLUMNS * q, 0.0);
+    for (k=0 ; k<times.size() ; k++) {
+      if (times[k] <= 0.0)
+	Yt = Y;
+      else {
+	while (ode.t < times[k])
+	  ode.step(rhs);
+	ode.dense(times[k], &Yt[0]);
+      }
+      for (c=0 ; c<FIT_COLUMNS ; c++) {
+	size_t row = k*FIT_COLUMNS + c;
+	if (std::isnan(values[row]))
+	  continue;
+	double model = 0.0;
+	for (m=0 ; m<columns[c].size() ; m++)
+	  model += Yt[columns[c][m]];
+	r[row] = model - values[row];
+	ss += r[row] * r[row];
+	for (p=0 ; p<q ; p++)
+	  for (m=0 ; m<columns[c].size() ; m++)
+	    J[row*q + p] += Yt[n + columns[c][m]*N + fitted[p]];
+      }
+    }
+    return ss;
+  }
+};
+
+static bool in_domain(const double* par) {
+  return par[LH_P_ALPHA] >= 0.0 && par[LH_P_ALPHA_S] >= 0.0 && par[LH_P_LEAK] >= 0.0
+    && par[LH_P_H] >= 0.0 && par[LH_P_H] <= 1.0 && par[LH_P_Z] >= 0.0 && par[LH_P_Z] <= 1.0;
+}
+
+int main (int argc, char **argv) {
+
+  options opt(argc, argv);
+  if (opt.npos() != 1) {
+    cerr << "fit-nestchoice.out <data file> [fit=alpha,alpha_s,H,alpha_leak] [alpha=0.1] [alpha_s=0.1] [H=0.2] [z=0.3] [alpha_leak=0.05]" << endl;
+    cerr << "data file: t good_rec good poor_rec poor (the columns of diffeqn-nestchoice.out), block=0 selects a block" << endl;
+    cerr << "fit: the parameters to fit; the others are held at their values" << endl;
+    cerr << "optional: rtol=1e-8 atol=1e-10 max_iter=100" << endl;
+    exit(8);
+  }
+
+  const double defaults[LH_PARAMS] = {0.1, 0.1, 0.2, 0.3, 0.05};
+  double par[LH_PARAMS], trial[LH_PARAMS];
+  int p, i, j;
+  for (p=0 ; p<LH_PARAMS ; p++)
+    par[p] = opt.get(lh_param_names[p], defaults[p]);
+  if (!in_domain(par)) {
+    cerr << "the initial parameters must satisfy alpha, alpha_s, alpha_leak >= 0 and 0 <= H, z <= 1" << endl;
+    exit(8);
+  }
+
+  fit_problem fp;
+  read_data(opt.pos[0], (int)opt.get_long("block", 0), fp.times, fp.values);
+  fp.rtol = opt.get("rtol", 1e-8);
+  fp.atol = opt.get("atol", 1e-10);
+  for (i=0 ; i<FIT_COLUMNS ; i++)
+    fp.columns.push_back(fit_column(i));
+  string spec = opt.get_str("fit", "alpha,alpha_s,H,alpha_leak"), name;
+  istringstream names(spec);
+  while (getline(names, name, ',')) {
+    for (p=0 ; p<LH_PARAMS && name != lh_param_names[p] ; p++)
+      ;
+    if (p == LH_PARAMS) {
+      cerr << "unknown parameter " << name << " (alpha, alpha_s, H, z or alpha_leak)" << endl;
+      exit(8);
+    }
+    fp.fitted.push_back(p);
+  }
+  const int q = (int)fp.fitted.size();
+  long nobs = 0;
+  for (size_t k=0 ; k<fp.values.size() ; k++)
+    nobs += !std::isnan(fp.values[k]);
+  if (q == 0 || nobs <= q) {
+    cerr << "need at least one fitted parameter and more observations than fitted parameters" << endl;
+    exit(8);
+  }
+
+  // Levenberg-Marquardt with the scaling of Marquardt (diag(J^T J))
+  vector<double> r, J, r_trial, J_trial;
+  vector<double> A(q*q), g(q), step(q);
+  double ss = fp.residuals(par, r, J), ss_trial;
+  double lambda = 1e-3;
+  long max_iter = opt.get_long("max_iter", 100);
+  long iter;
+  bool converged = false;
+  cerr << "iteration 0: sum of squares = " << ss << endl;
+  for (iter=1 ; iter<=max_iter && !converged ; iter++) {
+    for (i=0 ; i<q ; i++) {
+      g[i] = 0.0;
+      for (j=0 ; j<q ; j++)
+	A[i*q+j] = 0.0;
+    }
+    for (size_t row=0 ; row<r.size() ; row++)
+      for (i=0 ; i<q ; i++) {
+	g[i] -= J[row*q+i] * r[row];
+	for (j=0 ; j<q ; j++)
+	  A[i*q+j] += J[row*q+i] * J[row*q+j];
+      }
+    while (true) { // raise lambda until the step decreases the sum of squares
+      vector<double> damped(A);
+      for (i=0 ; i<q ; i++)
+	damped[i*q+i] += lambda * max(A[i*q+i], 1e-12);
+      step = g;
+      bool ok = cholesky_solve(damped, step, q);
+      for (p=0 ; p<LH_PARAMS ; p++)
+	trial[p] = par[p];
+      for (i=0 ; i<q ; i++)
+	trial[fp.fitted[i]] += step[i];
+      if (ok && in_domain(trial) && (ss_trial = fp.residuals(trial, r_trial, J_trial)) <= ss) {
+	converged = true; // all the steps small, or no decrease of the sum of squares
+	for (i=0 ; i<q ; i++)
+	  if (fabs(step[i]) > 1e-10 * (fabs(par[fp.fitted[i]]) + 1e-10))
+	    converged = false;
+	if (ss - ss_trial <= 1e-15 * ss)
+	  converged = true;
+	for (p=0 ; p<LH_PARAMS ; p++)
+	  par[p] = trial[p];
+	ss = ss_trial;
+	r.swap(r_trial);
+	J.swap(J_trial);
+	lambda = max(lambda / 10, 1e-12);
+	break;
+      }
+      lambda *= 10;
+      if (lambda > 1e12) { // no step decreases the sum of squares: at a minimum up to rounding
+	converged = true;
+	break;
+      }
+    }
+    cerr << "iteration " << iter << ": sum of squares = " << ss << " lambda = " << lambda << endl;
+  }
+  if (!converged)
+    cerr << "no convergence in " << max_iter << " iterations" << endl;
+
+  // standard errors: residual variance times the diagonal of (J^T J)^-1
+  for (i=0 ; i<q ; i++)
+    for (j=0 ; j<q ; j++) {
+      A[i*q+j] = 0.0;
+      for (size_t row=0 ; row<r.size() ; row++)
+	A[i*q+j] += J[row*q+i] * J[row*q+j];
+    }
+  double s2 = ss / (nobs - q);
+  for (i=0 ; i<q ; i++) {
+    vector<double> e(q, 0.0);
+    e[i] = 1.0;
+    cerr << lh_param_names[fp.fitted[i]] << " = " << par[fp.fitted[i]];
+    if (cholesky_solve(A, e, q))
+      cerr << " +- " << sqrt(s2 * e[i]) << endl;
+    else
+      cerr << " (not identifiable from these data)" << endl;
+  }
+
+  for (p=0 ; p<LH_PARAMS ; p++)
+    cout << par[p] << " ";
+  cout << ss << " " << nobs << endl;
+  return 0;
+}
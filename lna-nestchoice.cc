@@ -0,0 +1,369 @@
+/* Gaussian surrogate of the stochastic drivers: the linear-noise approximation (or the second-order normal moment
+closure) of the L/H model of finite-nestchoice.cc and of the N-nest model of cohesion-tradeoff.cc, for screening
+large parameter grids in milliseconds per point before running the SSA on the interesting regions.
+
+Usage:
+        a.out alpha alpha_s H z threshold Na                (L/H model, the arguments of finite-nestchoice.cc)
+        a.out alpha z Na Nnest model=nnest                  (N-nest model, the arguments of cohesion-tradeoff.cc)
+
+Every argument can be given as a list of values or ranges (see sweep.h), one output line per grid point, with
+the columns of the corresponding driver and the fraction of the samples that did not stop by tmax:
+        H alpha_s z threshold <mean time to quorum> <std> <precision> [<percentiles>] <not stopped>
+        alpha z <mean time> <std> <mean cohesion> <std of the cohesion> [<percentiles>] <not stopped>
+The means and covariances of the compartments are integrated by moment-closure.h from the initial state of the
+SSA (closure=lna, the default, or closure=normal). The stopping time is a first passage, which depends on the
+paths and not only on the Gaussian marginals, so the driver samples the Gaussian Markov process of the stopping
+observables with the same covariance (moment_solver::projection): the ants at the good and at the poor nest
+for the L/H model, the ants at each new nest for the N-nest model (the old nest holds the rest). samples=1000
+paths are advanced by the Euler-Maruyama method on the grid dt=0.05 up to tmax=1000, from a fixed seed (seed=1),
+and stopped when the quorum is reached (resp. when at most 10% of the ants are left in the old nest), with a
+continuity correction of half an ant and the boundary shifted by 0.5826 standard deviations of a step
+(Broadie and Glasserman) for the crossings between the grid times. The precision is the fraction of the paths
+that stop at the good nest, the cohesion that of nnest_cohesion on the ants at the new nests at the stopping
+time. Each path costs a few random numbers per step instead of the events of the SSA. quantiles=1 appends the
+5, 25, 50, 75 and 95 percentiles of the time, like finite-nestchoice.cc.
+
+The approximation is that of small fluctuations about the rate equations: it is good where the SSA has a
+unimodal outcome (most of the L/H model at Na >= 100), and a rough guide where the outcome is a symmetry
+breaking driven by the noise (the cohesion of the N-nest model at small Na; at alpha=0.01, where the rate
+equations never end the emigration, the mean time is off by an order of magnitude, and the last column shows
+it). The normal closure can diverge where the fluctuations grow without bound; the sampling then stops at the
+time of the divergence, which is written to the standard error, the columns are those of the paths that had
+stopped by then (nan if none had), and the fraction of the other paths is in the last column. Optional arguments:
+alpha_leak=0.05, threads=#cores (grid points in parallel), rtol=1e-6 atol=1e-9 (of the integrator), and
+record=<file> record_dt=1 record_tmax=100, which writes the means, standard deviations and covariances of the
+observables over time in the format of trajectory-recorder.h, with the covariances in place of the percentiles
+and the fraction of the paths still running (record_dt is rounded to a multiple of dt).
+*/
+
+#include <iostream>
+using namespace std;
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include "options.h"
+#include "sweep.h"
+#include "nest-models.h"
+#include "moment-closure.h"
+#include "rng.h"
+
+// rows of the record= file, one per record time: t, means, running, sds, covariances (fractions of Na)
+struct moment_record {
+  vector<trajectory_observable> obs;
+  int every; // grid steps per record time
+  long rows;
+  ostringstream out;
+
+  moment_record(const vector<trajectory_observable>& obs_, int every_, long rows_) : obs(obs_), every(every_), rows(rows_) {}
+
+  void header(const string& label) {
+    size_t a, b;
+    out << "# " << label << "\n# t";
+    for (a=0 ; a<obs.size() ; a++)
+      out << " " << obs[a].name;
+    out << " running";
+    for (a=0 ; a<obs.size() ; a++)
+      out << " " << obs[a].name << "_std";
+    for (a=0 ; a<obs.size() ; a++)
+      for (b=a+1 ; b<obs.size() ; b++)
+	out << " cov_" << obs[a].name << "_" << obs[b].name;
+    out << "\n";
+  }
+
+  void row(double t, const moment_state& m, double running) {
+    size_t a, b;
+    const double Na = m.Na;
+    out << t;
+    for (a=0 ; a<obs.size() ; a++)
+      out << " " << m.mean(obs[a]) / Na;
+    out << " " << running;
+    for (a=0 ; a<obs.size() ; a++)
+      out << " " << m.sd(obs[a]) / Na;
+    for (a=0 ; a<obs.size() ; a++)
+      for (b=a+1 ; b<obs.size() ; b++)
+	out << " " << m.cov(obs[a], obs[b]) / (Na*Na);
+    out << "\n";
+  }
+};
+
+struct lna_options {
+  bool normal, quantiles;
+  double dt, tmax, rtol, atol, alpha_leak;
+  int samples;
+  unsigned long seed;
+};
+
+// stopping times and scores of the sampled paths
+struct passage_sample {
+  vector<double> t, score;
+  long running;
+  double diverged; // time at which the moment equations diverged, 0 if they did not
+
+  passage_sample() : running(0), diverged(0.0) {}
+
+  double mean(const vector<double>& x) const {
+    double s = 0.0;
+    for (size_t i=0 ; i<x.size() ; i++)
+      s += x[i];
+    return s / x.size();
+  }
+  double sd(const vector<double>& x) const {
+    double s = 0.0, m = mean(x);
+    for (size_t i=0 ; i<x.size() ; i++)
+      s += (x[i] - m) * (x[i] - m);
+    return (x.size() > 1)? sqrt(s / (x.size() - 1)) : 0.0;
+  }
+  // percentiles of the stopping time, linear between the order statistics
+  void quantiles(ostringstream& out) const {
+    const double q[] = {0.05, 0.25, 0.5, 0.75, 0.95};
+    vector<double> sorted(t);
+    sort(sorted.begin(), sorted.end());
+    for (int k=0 ; k<5 ; k++) {
+      double r = q[k] * (sorted.size() - 1);
+      size_t i = (size_t)r;
+      out << " " << ((i+1 < sorted.size())? sorted[i] + (r - i) * (sorted[i+1] - sorted[i]) : sorted.back());
+    }
+  }
+};
+
+/* samples o.samples paths of the observables obs (mean + fluctuation of the projected process) from the
+   moments of sol; stop(X, shift, score) is called at every grid time with the values X of a running path and
+   the shifts of the boundaries for the crossings between grid times (0.5826 standard deviations of a step),
+   and returns true, with the score of the path, when the path stops. rec, if not NULL, gets the moments of
+   rec->obs every rec->every steps. */
+template <class Stop>
+static passage_sample passage(moment_solver& sol, int n, int Na, const vector<trajectory_observable>& obs, const lna_options& o,
+			      Stop stop, moment_record* rec) {
+  const int O = (int)obs.size();
+  const double sqdt = sqrt(o.dt);
+  vector<double> Y(n * (1+n)), Lambda(O*O, 0.0), D(O*O, 0.0), L(O*O, 0.0), xi((size_t)o.samples * O, 0.0);
+  vector<double> mean(O), X(O), shift(O, 0.0), dxi(O), w(O);
+  vector<int> alive(o.samples);
+  moment_state m(n, Na, &Y[0]);
+  xoshiro_stream rng(o.seed);
+  passage_sample res;
+  int a, b, s, i;
+  double score;
+  for (s=0 ; s<o.samples ; s++)
+    alive[s] = s;
+  for (long k=0 ; ; k++) {
+    const double t = k * o.dt;
+    if (!sol.at(t, &Y[0])) {
+      res.diverged = t;
+      break;
+    }
+    for (a=0 ; a<O ; a++)
+      mean[a] = m.mean(obs[a]);
+    for (i=0 ; i<(int)alive.size() ; ) {
+      double* x = &xi[(size_t)alive[i] * O];
+      if (k > 0) { // Euler-Maruyama step from t - dt with the process at t - dt
+	for (a=0 ; a<O ; a+=2) {
+	  double r = sqrt(-2.0 * log(rng.uniform())), u = 2.0 * M_PI * rng.uniform();
+	  w[a] = r * cos(u);
+	  if (a+1 < O)
+	    w[a+1] = r * sin(u);
+	}
+	for (a=0 ; a<O ; a++) {
+	  dxi[a] = 0.0;
+	  for (b=0 ; b<O ; b++)
+	    dxi[a] += Lambda[a*O+b] * x[b] * o.dt;
+	  for (b=0 ; b<=a ; b++)
+	    dxi[a] += L[a*O+b] * w[b] * sqdt;
+	}
+	for (a=0 ; a<O ; a++)
+	  x[a] += dxi[a];
+      }
+      for (a=0 ; a<O ; a++)
+	X[a] = mean[a] + x[a];
+      if (stop(&X[0], &shift[0], score)) {
+	res.t.push_back(t);
+	res.score.push_back(score);
+	alive[i] = alive.back();
+	alive.pop_back();
+      } else
+	i++;
+    }
+    if (rec != NULL && k % rec->every == 0 && k / rec->every < rec->rows)
+      rec->row(t, m, (double)alive.size() / o.samples);
+    if (t >= o.tmax || (alive.empty() && (rec == NULL || k / rec->every >= rec->rows)))
+      break;
+    sol.projection(&Y[0], obs, &Lambda[0], &D[0]);
+    for (a=0 ; a<O ; a++) { // Cholesky factor of the noise
+      for (b=0 ; b<=a ; b++) {
+	double c = D[a*O+b];
+	for (i=0 ; i<b ; i++)
+	  c -= L[a*O+i] * L[b*O+i];
+	L[a*O+b] = (a == b)? sqrt(std::max(c, 0.0)) : ((L[b*O+b] > 1e-12)? c / L[b*O+b] : 0.0);
+      }
+      shift[a] = 0.5826 * sqrt(std::max(D[a*O+a], 0.0) * o.dt);
+    }
+  }
+  res.running = (long)alive.size();
+  return res;
+}
+
+// output line of a grid point
+static string summary(const string& point, const passage_sample& r, const lna_options& o, bool score_sd) {
+  ostringstream out;
+  if (r.diverged > 0.0)
+    cerr << point << ": the moment equations diverged at t = " << r.diverged << ", " << r.running << " paths not stopped" << endl;
+  out << point << " ";
+  if (r.t.empty())
+    out << "nan nan nan";
+  else
+    out << r.mean(r.t) << " " << r.sd(r.t) << " " << r.mean(r.score);
+  if (score_sd)
+    out << " " << (r.t.empty()? 0.0 : r.sd(r.score));
+  if (o.quantiles && !r.t.empty())
+    r.quantiles(out);
+  out << " " << (double)r.running / o.samples;
+  return out.str();
+}
+
+// one grid point of the L/H model: the quorum at the good or at the poor nest
+static string lh_point(const vector<double>& v, const lna_options& o, moment_record* rec) {
+  const int Na = (int)v[5];
+  const double q = quorum_ants(v[4], Na) - 0.5; // continuity correction
+  int x[LH_COMPARTMENTS];
+  lh_init(x, v[2], v[3], Na);
+  ssa_network net = lh_network(v[0], v[1], o.alpha_leak, Na);
+  moment_solver sol(net, o.normal, x, o.rtol, o.atol);
+  vector<trajectory_observable> obs;
+  obs.push_back(lh_observables()[1]); // good
+  obs.push_back(lh_observables()[3]); // poor
+  auto stop = [&](const double* X, const double* shift, double& score) {
+    double good = X[0] - (q - shift[0]), poor = X[1] - (q - shift[1]);
+    if (good < 0.0 && poor < 0.0)
+      return false;
+    score = (good >= poor)? 1.0 : 0.0;
+    return true;
+  };
+  passage_sample r = passage(sol, LH_COMPARTMENTS, Na, obs, o, stop, rec);
+  ostringstream point;
+  point << v[2] << " " << v[1] << " " << v[3] << " " << v[4];
+  return summary(point.str(), r, o, false);
+}
+
+// one grid point of the N-nest model: the end of the emigration, and the cohesion at the new nests
+static string nnest_point(const vector<double>& v, const lna_options& o, moment_record* rec) {
+  const int Na = (int)v[2], Nnest = (int)v[3], n = 1 + 2*Nnest;
+  const double end = floor(0.1 * Na) + 0.5; // the old nest holds at most 10% of the ants, continuity correction
+  vector<int> x(n);
+  nnest_init(&x[0], v[1], Na, Nnest);
+  ssa_network net = nnest_network(v[0], o.alpha_leak, Na, Nnest);
+  moment_solver sol(net, o.normal, &x[0], o.rtol, o.atol);
+  vector<trajectory_observable> obs = nnest_observables(Nnest);
+  obs.erase(obs.begin()); // the old nest holds the rest
+  vector<int> ants(n, 0);
+  auto stop = [&](const double* X, const double* shift, double& score) {
+    double moved = 0.0, s2 = 0.0;
+    for (int i=0 ; i<Nnest ; i++) {
+      moved += X[i];
+      s2 += shift[i] * shift[i];
+    }
+    if (Na - moved > end + sqrt(s2))
+      return false;
+    for (int i=0 ; i<Nnest ; i++) // nnest_cohesion counts the ants of a nest in one of its compartments
+      ants[nnest_com(i)] = (int)floor(std::max(X[i], 0.0) + 0.5);
+    score = nnest_cohesion(&ants[0], Nnest);
+    return true;
+  };
+  passage_sample r = passage(sol, n, Na, obs, o, stop, rec);
+  ostringstream point;
+  point << v[0] << " " << v[1];
+  return summary(point.str(), r, o, true);
+}
+
+int main (int argc, char **argv) {
+
+  options opt(argc, argv);
+  string model = opt.get_str("model", "lh");
+  if ((model == "lh" && opt.npos() != 6) || (model == "nnest" && opt.npos() != 4) || (model != "lh" && model != "nnest")) {
+    cerr << "lna-nestchoice.out alpha alpha_s H z threshold Na             (L/H model, as finite-nestchoice.out)" << endl;
+    cerr << "lna-nestchoice.out alpha z Na Nnest model=nnest               (N-nest model, as cohesion-tradeoff.out)" << endl;
+    cerr << "closure=lna (linear-noise approximation) or closure=normal (second-order normal moment closure)" << endl;
+    cerr << "optional: samples=1000 dt=0.05 tmax=1000 seed=1 quantiles=1 alpha_leak=0.05 threads=#cores rtol=1e-6 atol=1e-9" << endl;
+    cerr << "means and covariances over time: record=<file> record_dt=1 record_tmax=100" << endl;
+    exit(8);
+  }
+
+  lna_options o;
+  string closure = opt.get_str("closure", "lna");
+  o.normal = (closure == "normal");
+  o.dt = opt.get("dt", 0.05);
+  o.tmax = opt.get("tmax", 1000.0);
+  o.rtol = opt.get("rtol", 1e-6);
+  o.atol = opt.get("atol", 1e-9);
+  o.alpha_leak = opt.get("alpha_leak", 0.05);
+  o.samples = (int)opt.get_long("samples", 1000);
+  o.quantiles = (opt.get_long("quantiles", 0) != 0);
+  o.seed = (unsigned long)opt.get_long("seed", 1);
+  if ((closure != "lna" && closure != "normal") || o.dt <= 0.0 || o.tmax <= 0.0 || o.samples < 1) {
+    cerr << "closure must be lna or normal, and dt, tmax and samples positive" << endl;
+    exit(8);
+  }
+  cerr << "leak rate = " << o.alpha_leak << endl;
+
+  grid g;
+  for (int i=0 ; i<opt.npos() ; i++)
+    g.add(opt.pos[i]);
+  long npoints = g.size();
+
+  bool record = opt.has("record");
+  double record_dt = opt.get("record_dt", 1.0), record_tmax = opt.get("record_tmax", 100.0);
+  int every = std::max(1, (int)floor(record_dt / o.dt + 0.5));
+  long rows = (long)floor(record_tmax / (every * o.dt) + 1e-9) + 1;
+  vector<moment_record*> recs(npoints, (moment_record*)NULL);
+
+  vector<string> lines(npoints);
+  std::atomic<long> next(0);
+  auto worker = [&]() {
+    long p;
+    while ((p = next++) < npoints) {
+      vector<double> v = g.point(p);
+      moment_record* rec = NULL;
+      if (record) {
+	ostringstream label;
+	if (model == "lh") {
+	  label << "alpha=" << v[0] << " alpha_s=" << v[1] << " H=" << v[2] << " z=" << v[3] << " threshold=" << v[4] << " Na=" << v[5];
+	  rec = new moment_record(lh_observables(), every, rows);
+	} else {
+	  label << "alpha=" << v[0] << " z=" << v[1] << " Na=" << v[2] << " Nnest=" << v[3];
+	  rec = new moment_record(nnest_observables((int)v[3]), every, rows);
+	}
+	rec->header(label.str() + " closure=" + closure);
+	recs[p] = rec;
+      }
+      lines[p] = (model == "lh")? lh_point(v, o, rec) : nnest_point(v, o, rec);
+    }
+  };
+  vector<std::thread> pool;
+  for (int i=1 ; i<opt.threads() && i<npoints ; i++)
+    pool.push_back(std::thread(worker));
+  worker();
+  for (size_t i=0 ; i<pool.size() ; i++)
+    pool[i].join();
+
+  for (long p=0 ; p<npoints ; p++)
+    cout << lines[p] << endl;
+
+  if (record) {
+    FILE* f = fopen(opt.get_str("record", "").c_str(), "w");
+    if (f == NULL)
+      cerr << "cannot write " << opt.get_str("record", "") << endl;
+    for (long p=0 ; p<npoints ; p++) {
+      if (f != NULL)
+	fprintf(f, "%s%s", recs[p]->out.str().c_str(), (p+1 < npoints)? "\n\n" : "");
+      delete recs[p];
+    }
+    if (f != NULL)
+      fclose(f);
+  }
+  return 0;
+}
@@ -0,0 +1,213 @@
+/* Linear-noise approximation and second-order moment closure of the reaction networks of ssa-engine.h, a fast
+Gaussian surrogate of the SSA for lna-nestchoice.cc.
+
+With y = E[x]/Na (fractions of ants) and C = Cov(x)/Na, the linear-noise approximation (van Kampen) is
+        dy/dt = f(y) = sum_c nu_c r_c(y)
+        dC/dt = J C + C J^T + B(y),   B = sum_c nu_c nu_c^T r_c(y)
+where r_c = a_c / Na is the intensive propensity of channel c (k y_from, or k y_from Y_pool for recruitment),
+nu_c = e_to - e_from its stoichiometry and J = df/dy; it is exact to O(1/sqrt(Na)). The propensities are at most
+quadratic, so the second-order moment equations close exactly if the third central moments vanish (normal
+closure): the mean gets the correction k nu_c C(from, pool) / Na of the recruitment channels, and B is evaluated
+at E[r_c] with the same correction, while the J C terms are those of the LNA. closure=normal thus costs the
+same as the LNA and is more accurate for small colonies, where the fluctuations shift the mean, but it can
+diverge where the fluctuations grow without bound (moment_solver::valid).
+
+The state of the integration is y and C (full, symmetric), n (1 + n) variables, integrated by dopri5 (ode-solver.h)
+from the integer initial state of the SSA (lh_init, nnest_init) with C = 0. The observables are sums of
+compartments (trajectory_observable of trajectory-recorder.h): their means, variances and covariances follow
+from y and C. For first-passage times, which depend on the paths and not only on the marginals, moment_solver::
+projection gives the Gaussian Markov process of the fluctuations of a few observables with the same covariance.
+*/
+
+#ifndef MOMENT_CLOSURE_H
+#define MOMENT_CLOSURE_H
+
+#include <vector>
+#include <cmath>
+#include "ssa-engine.h"
+#include "ode-solver.h"
+#include "trajectory-recorder.h"
+
+// right-hand side of the moment equations for ode-solver.h
+struct moment_rhs {
+  const ssa_network& net;
+  int n;
+  double Na;
+  bool normal; // second-order normal closure instead of the LNA
+  std::vector<double> g, P, JC;
+
+  moment_rhs(const ssa_network& net_, bool normal_) : net(net_), n(net_.n_species), Na(net_.Na), normal(normal_),
+    g(net_.n_species), P(net_.pool_members.size()), JC(net_.n_species * net_.n_species) {}
+
+  void operator()(double, const double* Y, double* dY) {
+    const double* y = Y;
+    const double* C = Y + n;
+    double* dy = dY;
+    double* dC = dY + n;
+    int c, i, j, f, t;
+    size_t m;
+    for (i=0 ; i<n*(1+n) ; i++)
+      dY[i] = 0.0;
+    for (i=0 ; i<n*n ; i++)
+      JC[i] = 0.0;
+    for (size_t p=0 ; p<P.size() ; p++) {
+      P[p] = 0.0;
+      for (m=0 ; m<net.pool_members[p].size() ; m++)
+	P[p] += y[net.pool_members[p][m]];
+    }
+    for (c=0 ; c<net.channels() ; c++) {
+      f = net.from[c];
+      t = net.to[c];
+      const double k = net.k[c];
+      double r;
+      if (net.pool[c] < 0) { // g = (dr_c/dy)^T C
+	r = k * y[f];
+	for (j=0 ; j<n ; j++)
+	  g[j] = k * C[f*n+j];
+      } else {
+	const std::vector<int>& pool = net.pool_members[net.pool[c]];
+	const double Pc = P[net.pool[c]];
+	r = k * y[f] * Pc;
+	for (j=0 ; j<n ; j++) {
+	  double cp = 0.0;
+	  for (m=0 ; m<pool.size() ; m++)
+	    cp += C[pool[m]*n+j];
+	  g[j] = k * (Pc * C[f*n+j] + y[f] * cp);
+	  if (normal && j == f)
+	    r += k * cp / Na; // E[r_c] = k (y_from Y_pool + Cov(x_from, pool) / Na^2)
+	}
+      }
+      dy[f] -= r;
+      dy[t] += r;
+      for (j=0 ; j<n ; j++) {
+	JC[t*n+j] += g[j];
+	JC[f*n+j] -= g[j];
+      }
+      dC[f*n+f] += r; // B
+      dC[t*n+t] += r;
+      dC[f*n+t] -= r;
+      dC[t*n+f] -= r;
+    }
+    for (i=0 ; i<n ; i++)
+      for (j=0 ; j<n ; j++)
+	dC[i*n+j] += JC[i*n+j] + JC[j*n+i];
+  }
+};
+
+// mean, variance and covariance of sums of compartments, in # ants, from the state Y of the moment equations
+struct moment_state {
+  int n;
+  double Na;
+  const double* Y;
+
+  moment_state(int n_, double Na_, const double* Y_) : n(n_), Na(Na_), Y(Y_) {}
+
+  double mean(const trajectory_observable& a) const {
+    double s = 0.0;
+    for (size_t i=0 ; i<a.compartments.size() ; i++)
+      s += Y[a.compartments[i]];
+    return Na * s;
+  }
+
+  double cov(const trajectory_observable& a, const trajectory_observable& b) const {
+    double s = 0.0;
+    for (size_t i=0 ; i<a.compartments.size() ; i++)
+      for (size_t j=0 ; j<b.compartments.size() ; j++)
+	s += Y[n + a.compartments[i]*n + b.compartments[j]];
+    return Na * s;
+  }
+
+  double sd(const trajectory_observable& a) const { return sqrt(std::max(cov(a, a), 0.0)); }
+};
+
+// integrator of the moment equations from the integer state x0 (zero covariance)
+struct moment_solver {
+  moment_rhs rhs;
+  dopri5 ode;
+
+  moment_solver(const ssa_network& net, bool normal, const int* x0, double rtol = 1e-6, double atol = 1e-9)
+    : rhs(net, normal), ode(net.n_species * (1 + net.n_species), rtol, atol) {
+    const int n = net.n_species;
+    std::vector<double> Y(n * (1+n), 0.0);
+    for (int i=0 ; i<n ; i++)
+      Y[i] = (double)x0[i] / net.Na;
+    ode.init(rhs, 0.0, &Y[0]);
+  }
+
+  /* Gaussian Markov process of the fluctuations xi of the observables, in # ants: d xi = Lambda xi dt + dW with
+     Cov(dW) = D dt, where D = O^T B O and Lambda = O^T J C O (O^T C O)^-1 is the regression of the drift of the
+     observables on their values, so that the covariance of the process is that of the observables at all times.
+     Y is the state at the time; Lambda and D are O x O, row-major. */
+  void projection(const double* Y, const std::vector<trajectory_observable>& obs, double* Lambda, double* D) {
+    const int n = rhs.n, O = (int)obs.size();
+    std::vector<double> dY(n * (1+n)), JCO(O*O), COO(O*O), inv(O*O);
+    int a, b, c;
+    size_t i, j;
+    rhs(0.0, Y, &dY[0]);
+    for (a=0 ; a<O ; a++)
+      for (b=0 ; b<O ; b++) {
+	double jc = 0.0, cc = 0.0, bb = 0.0;
+	for (i=0 ; i<obs[a].compartments.size() ; i++)
+	  for (j=0 ; j<obs[b].compartments.size() ; j++) {
+	    int u = obs[a].compartments[i], v = obs[b].compartments[j];
+	    jc += rhs.JC[u*n+v];
+	    cc += Y[n + u*n+v];
+	    bb += dY[n + u*n+v] - rhs.JC[u*n+v] - rhs.JC[v*n+u];
+	  }
+	JCO[a*O+b] = rhs.Na * jc;
+	COO[a*O+b] = rhs.Na * cc + ((a == b)? 1e-9 : 0.0);
+	D[a*O+b] = rhs.Na * bb;
+      }
+    for (a=0 ; a<O ; a++) // inverse of O^T C O by Gauss-Jordan elimination (symmetric positive definite)
+      for (b=0 ; b<O ; b++)
+	inv[a*O+b] = (a == b)? 1.0 : 0.0;
+    for (c=0 ; c<O ; c++) {
+      double piv = COO[c*O+c];
+      for (b=0 ; b<O ; b++) {
+	COO[c*O+b] /= piv;
+	inv[c*O+b] /= piv;
+      }
+      for (a=0 ; a<O ; a++)
+	if (a != c) {
+	  double f = COO[a*O+c];
+	  for (b=0 ; b<O ; b++) {
+	    COO[a*O+b] -= f * COO[c*O+b];
+	    inv[a*O+b] -= f * inv[c*O+b];
+	  }
+	}
+    }
+    for (a=0 ; a<O ; a++)
+      for (b=0 ; b<O ; b++) {
+	double s = 0.0;
+	for (c=0 ; c<O ; c++)
+	  s += JCO[a*O+c] * inv[c*O+b];
+	Lambda[a*O+b] = s;
+      }
+  }
+
+  // false once the state has left the simplex or a variance has turned negative (the normal closure can diverge)
+  bool valid() const {
+    const int n = rhs.n;
+    for (int i=0 ; i<n ; i++)
+      if (!(ode.y[i] > -0.01 && ode.y[i] < 1.01 && ode.y[n + i*n+i] > -0.01 && ode.y[n + i*n+i] < 1.0 + rhs.Na))
+	return false;
+    return true;
+  }
+
+  // state at time s >= the current time, into Y (n (1 + n) values); false if the solution diverged before s
+  bool at(double s, double* Y) {
+    while (ode.t < s) {
+      ode.step(rhs);
+      if (!valid())
+	return false;
+    }
+    if (ode.t == s || ode.naccept == 0)
+      for (int i=0 ; i<ode.n ; i++)
+	Y[i] = ode.y[i];
+    else
+      ode.dense(s, Y);
+    return true;
+  }
+};
+
+#endif // MOMENT_CLOSURE_H
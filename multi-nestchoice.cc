@@ -0,0 +1,187 @@
+/* Nest choice with K new nests of given qualities and M classes of ants with a discrete distribution
+of acceptance thresholds (the K-nest, M-class model of nest-models.h).
+
+An ant of class m accepts nest j if quality_j >= threshold_m; it recruits only to the nests that it accepts,
+and a visitor of a rejected nest switches to an accepted one at rate alpha_s. The simulation stops when
+a nest reaches the quorum threshold, and the precision is the fraction of trials in which the nest with the
+most ants has the highest quality.
+
+Usage:
+        a.out alpha alpha_s z threshold Na [qualities=1/0] [thresholds=0/0.5] [fractions=0.8/0.2]
+
+qualities, thresholds and fractions are lists of values or ranges separated by "/"; the fractions of the
+classes sum to 1, and they are equal if only thresholds= is given.
+The defaults are the L/H model of finite-nestchoice.cc with H = 0.2 (a good and a poor nest, low-threshold
+ants accepting both and high-threshold ants accepting only the good one), so that
+        a.out 0.1 0.1 0.3 0.5 100
+gives the point H=0.2 of Figure 4 up to sampling error. Examples of richer heterogeneity:
+        a.out 0.1 0.1 0.3 0.5 100 qualities=1/0.8/0.6/0.4 thresholds=0/0.3/0.5/0.7/0.9 fractions=0.2/0.2/0.2/0.2/0.2
+        a.out 0.1 0.1 0.3 0.5 1000 qualities=0.1:1:0.1 thresholds=0:0.95:0.05
+
+The parameters alpha alpha_s z threshold Na can be given as lists or ranges (see sweep.h), one output line
+per grid point:
+        alpha alpha_s z threshold Na <time to quorum> <std> <precision>
+The optional arguments trials=, threads=, seed=, alpha_leak=, method=tau|hybrid, tol= rtol= batch=,
+quantiles=1, output=<file>, checkpoint=<file>, shard=i/N, cache=<dir>, daemon=, connect=, max_events= and
+max_seconds= are those of finite-nestchoice.cc;
+method=ensemble is not available. Networks with more than SSA_TREE_MIN_CHANNELS reactions (e.g., K = 4, M = 2)
+run on the incremental sum trees of ssa-engine.h.
+*/
+
+#include <iostream>
+using namespace std;
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "options.h"
+#include "sweep.h"
+#include "nest-models.h"
+#include "trial-runner.h"
+#include "checkpoint.h"
+#include "trial-cap.h"
+#include "result-cache.h"
+#include "sweep-daemon.h"
+#include "trial-output.h"
+
+// list of values separated by "/", each of which may be a range start:stop:step
+static vector<double> parse_list(const string& spec) {
+  string s(spec);
+  for (size_t i=0 ; i<s.size() ; i++)
+    if (s[i] == '/')
+      s[i] = ',';
+  return parse_values(s.c_str());
+}
+
+static int multi_nestchoice(int argc, char **argv) {
+
+  options opt(argc, argv);
+  if (opt.npos() != 5) {
+    cerr << "multi-nestchoice.out alpha alpha_s z threshold Na [qualities=1/0] [thresholds=0/0.5] [fractions=0.8/0.2]" << endl;
+    cerr << "alpha: rate at which committed ants convert to recruits" << endl;
+    cerr << "alpha_s: rate at which ants visiting a nest that they reject move to a nest that they accept" << endl;
+    cerr << "z: initial fraction of recruiters" << endl;
+    cerr << "threshold: quorum threshold, between 0 and 1" << endl;
+    cerr << "Na: number of ants" << endl;
+    cerr << "qualities: of the new nests; thresholds, fractions: acceptance thresholds and fractions of the classes of ants" << endl;
+    usage_common_options();
+    cerr << "distributions: quantiles=1 (percentiles of the time), output=<file> (binary per-trial records, see trial-dump.cc)" << endl;
+    cerr << "per-trial caps: max_events=<n> max_seconds=<s> (# capped realisations appended, see trial-cap.h)" << endl;
+    exit(8);
+  }
+
+  kq_model md;
+  md.quality = parse_list(opt.get_str("qualities", "1/0"));
+  md.threshold = parse_list(opt.get_str("thresholds", "0/0.5"));
+  if (opt.has("fractions") || !opt.has("thresholds"))
+    md.fraction = parse_list(opt.get_str("fractions", "0.8/0.2"));
+  else
+    md.fraction.assign(md.classes(), 1.0 / md.classes());
+  if (md.nests() < 1 || md.classes() < 1 || md.fraction.size() != md.threshold.size()) {
+    cerr << "qualities= needs at least one nest, and thresholds= and fractions= the same # classes" << endl;
+    exit(8);
+  }
+  double sum = 0.0;
+  for (int m=0 ; m<md.classes() ; m++)
+    sum += md.fraction[m];
+  if (fabs(sum - 1.0) > 1e-6) {
+    cerr << "the fractions of the classes must sum to 1" << endl;
+    exit(8);
+  }
+
+  unsigned long seed = sweep_seed(opt); // seed=, or that of the checkpoint file
+  cerr << "seed = " << seed << endl;
+  double alpha_leak = opt.get("alpha_leak", 0.05);
+  cerr << "leak rate = " << alpha_leak << endl;
+  cerr << "nests = " << md.nests() << ", classes = " << md.classes() << endl;
+
+  // alpha: conversion rate from committed to recruit
+  // alpha_s: rate at which visitors of a rejected nest move to an accepted nest
+  // z: initial fraction of recruiters
+  // threshold: quorum threshold (normalized by N_ant)
+  grid g;
+  for (int i=0 ; i<5 ; i++)
+    g.add(opt.pos[i]);
+  long npoints = g.size();
+  long p;
+  vector<int> x(md.species());
+  int tmp_sum;
+
+  vector<ssa_network> nets;
+  for (p=0 ; p<npoints ; p++) {
+    vector<double> v = g.point(p);
+    int Na = (int)v[4];
+    tmp_sum = kq_init(md, &x[0], v[2], Na); // Na - # ants placed before the rounding correction
+    if (tmp_sum > 0)
+      cerr << "Na - tmp_sum = " << tmp_sum << endl;
+    nets.push_back(kq_network(md, v[0], v[1], alpha_leak, Na));
+  }
+  cerr << "reactions = " << nets[0].channels() << endl;
+
+  stop_rule rule(opt.get_long("batch", 1000), opt.get("tol", 0.0), opt.get("rtol", 0.0), true);
+  sweep_checkpoint* ckpt = sweep_checkpoint_from(opt, "multi-nestchoice", seed, npoints, rule);
+  result_cache* cache = result_cache_from(opt, "multi-nestchoice", seed, g, opt.trials());
+  chunk_store* store = (ckpt != NULL)? (chunk_store*)ckpt : cache;
+
+  int method = opt.method();
+  if (method == SSA_ENSEMBLE) {
+    cerr << "method=ensemble is not available for this model" << endl;
+    exit(8);
+  }
+  trial_cap cap = trial_cap_from(opt);
+  long capped = 0;
+
+  // per-trial binary output and quantiles of the time (see trial-output.h)
+  trial_writer* out = opt.has("output")? new trial_writer(opt.get_str("output", "").c_str(), seed) : NULL;
+  trial_quantiles* quantiles = (opt.get_long("quantiles", 0) != 0)? new trial_quantiles(npoints) : NULL;
+
+  auto make_trial = [&](long p) {
+    vector<double> v = g.point(p);
+    int Na = (int)v[4];
+    kq_trial trial(nets[p], md, v[2], Na, quorum_ants(v[3], Na), method);
+    trial.cap = cap;
+    return trial;
+  };
+  auto emit = [&](long p, const trial_sums& sums) {
+    vector<double> v = g.point(p);
+    cout << v[0] << " " << v[1] << " " << v[2] << " " << v[3] << " " << v[4] << " " << sums.t_ave() << " " << sums.t_std() << " " << sums.s_ave();
+    if (quantiles != NULL) {
+      tdigest d = quantiles->merged(p);
+      const double q[] = {0.05, 0.25, 0.5, 0.75, 0.95};
+      for (int k=0 ; k<5 ; k++)
+	cout << " " << d.quantile(q[k]);
+    }
+    if (rule.adaptive())
+      cout << " " << sums.n;
+    if (cap.active())
+      cout << " " << sums.capped;
+    capped += sums.capped;
+    cout << endl;
+  };
+  if ((out != NULL || quantiles != NULL) && ckpt != NULL) {
+    cerr << "output= and quantiles= are not available with checkpoint=" << endl;
+    exit(8);
+  }
+  if (out != NULL || quantiles != NULL) {
+    auto make_recorded = [&](long p) { return recorded_trial<kq_trial>(make_trial(p), out, quantiles); };
+    run_sweep(make_recorded, npoints, opt.trials(), seed, opt.threads(), emit, rule, 1, store);
+  } else
+    run_sweep(make_trial, npoints, opt.trials(), seed, opt.threads(), emit, rule, 1, store);
+
+  delete out; // flushes the file
+  delete quantiles;
+  if (cap.active() && (ckpt == NULL || !ckpt->sharded()))
+    cerr << capped << " realisations capped" << endl;
+  if (ckpt != NULL && ckpt->sharded())
+    cerr << "shard " << opt.get_str("shard", "") << ": " << ckpt->written << " chunks written to " << opt.get_str("checkpoint", "") << endl;
+  delete ckpt;
+  if (cache != NULL)
+    cerr << cache->hits << " chunks from the cache " << opt.get_str("cache", "") << ", " << cache->simulated << " simulated" << endl;
+  delete cache;
+  ssa_profile_report("multi-nestchoice"); // with -DSSA_PROFILE (see ssa-profile.h)
+  return 0;
+}
+
+int main (int argc, char **argv) {
+  return sweep_main(argc, argv, multi_nestchoice, "multi-nestchoice.out"); // daemon=, connect= (see sweep-daemon.h)
+}
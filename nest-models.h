@@ -0,0 +1,676 @@
+/* Reaction-network descriptions of the nest-choice models, for use with ssa-engine.h.
+
+L/H model (finite-nestchoice.cc, speed-accuracy-coef.cc): low-threshold (L) and high-threshold (H) ants,
+one good nest and one poor nest, 9 compartments.
+
+N-nest model (cohesion-tradeoff.cc): Nnest new nests of equal quality, 1 + 2*Nnest compartments.
+
+K-nest, M-class model (multi-nestchoice.cc): K new nests of given qualities and M classes of ants with given
+acceptance thresholds and fractions, (1 + 2K) M compartments. It contains the L/H model as K = M = 2.
+*/
+
+#ifndef NEST_MODELS_H
+#define NEST_MODELS_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "ssa-engine.h"
+#include "trial-runner.h"
+#include "trial-cap.h"
+#include "trajectory-recorder.h"
+
+// compartments of the L/H model
+enum { L_OLDNEST, H_OLDNEST, L_POOR_COM, L_POOR_REC, H_POOR_VIS, L_GOOD_COM, H_GOOD_COM, L_GOOD_REC, H_GOOD_REC, LH_COMPARTMENTS };
+
+// channels of the L/H model in the order of lh_network; pool 0 = recruiters of the poor nest, 1 = of the good nest
+enum { LH_CHANNELS = 15 };
+static const int lh_channel_from[LH_CHANNELS] = {
+  L_OLDNEST, H_OLDNEST, L_OLDNEST, H_OLDNEST, // recruitment
+  L_POOR_COM, L_GOOD_COM, H_GOOD_COM, // commited -> recruiter
+  H_POOR_VIS, // high-threshold ants switch to the good nest
+  L_POOR_COM, H_POOR_VIS, L_POOR_REC, L_GOOD_COM, H_GOOD_COM, L_GOOD_REC, H_GOOD_REC}; // leak
+static const int lh_channel_to[LH_CHANNELS] = {
+  L_POOR_COM, H_POOR_VIS, L_GOOD_COM, H_GOOD_COM,
+  L_POOR_REC, L_GOOD_REC, H_GOOD_REC,
+  H_GOOD_COM,
+  L_OLDNEST, H_OLDNEST, L_OLDNEST, L_OLDNEST, H_OLDNEST, L_OLDNEST, H_OLDNEST};
+static const int lh_channel_pool[LH_CHANNELS] = {0, 0, 1, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+
+// sets of channels, bit c = channel c
+enum {
+  LH_ALL_CHANNELS = 0x7fff,
+  LH_SWITCH_CHANNEL = 0x0080, // alpha_s
+  LH_LEAK_CHANNELS = 0x7f00, // alpha_leak
+  LH_H_CHANNELS = 0x52ca // channels that move high-threshold ants
+};
+
+inline ssa_network lh_network(double alpha, double alpha_s, double alpha_leak, int Na) {
+  double alpha_g = alpha;
+  double alpha_p = alpha;
+  const double k[LH_CHANNELS] = {1.0, 1.0, 1.0, 1.0, alpha_p, alpha_g, alpha_g, alpha_s,
+				 alpha_leak, alpha_leak, alpha_leak, alpha_leak, alpha_leak, alpha_leak, alpha_leak};
+  ssa_network net(LH_COMPARTMENTS, Na);
+  int pools[2];
+  pools[0] = net.add_pool(std::vector<int>(1, L_POOR_REC));
+  std::vector<int> good;
+  good.push_back(L_GOOD_REC);
+  good.push_back(H_GOOD_REC);
+  pools[1] = net.add_pool(good);
+  for (int c=0 ; c<LH_CHANNELS ; c++)
+    net.add_channel(lh_channel_from[c], lh_channel_to[c], k[c], (lh_channel_pool[c] < 0)? -1 : pools[lh_channel_pool[c]]);
+  return net;
+}
+
+// # ants of a quorum threshold given as a fraction of Na, rounded as in lh_init, so that a threshold of
+// 0.14 computed as 0.13999999999999999 is still 14 ants at Na = 100
+inline int quorum_ants(double threshold, int Na) { return (int)(threshold*Na + 1e-8); }
+
+// initial condition; returns Na minus the # ants placed before the rounding correction
+inline int lh_init(int* x, double H, double z, int Na) {
+  int tmp_sum;
+  x[H_OLDNEST] = (int)(Na*H*(1-z)+1e-8);
+  x[L_OLDNEST] = (int)(Na*(1-z)+1e-8) - x[H_OLDNEST];
+  x[H_POOR_VIS] = x[H_GOOD_COM] = (int)((Na*H*z+1e-8)/2);
+  x[L_POOR_COM] = (int)((Na*z+1e-8)/2) - x[H_POOR_VIS];
+  x[L_GOOD_COM] = (int)((Na*z+1e-8)/2) - x[H_GOOD_COM];
+  x[L_POOR_REC] = x[L_GOOD_REC] = x[H_GOOD_REC] = 0;
+  tmp_sum = x[H_OLDNEST] + x[L_OLDNEST] + x[H_POOR_VIS] + x[L_POOR_COM] + x[H_GOOD_COM] + x[L_GOOD_COM];
+  if (tmp_sum < Na)
+    x[H_OLDNEST] += Na - tmp_sum;
+  return Na - tmp_sum;
+}
+
+/* Rate equations of lh_network with the rates of all the channels, k[c] of channel c (lh_channel_from etc.), in
+   the order of ssa_network::drift, so that they agree to the last bit with double; T may be the dual numbers of
+   ode-sensitivity.h, so that the derivatives with respect to the rates follow. lh_rates sets k from the
+   parameters; unlike lh_network, it keeps the channels of rate 0. */
+template <class T>
+inline void lh_rates(const T& alpha, const T& alpha_s, const T& alpha_leak, T* k) {
+  for (int c=0 ; c<LH_CHANNELS ; c++)
+    k[c] = (c < 4)? T(1.0) : (c < 7)? alpha : (c == 7)? alpha_s : alpha_leak;
+}
+
+template <class T>
+inline void lh_drift(const T* k, const T* y, T* dy) {
+  T P[2], r;
+  P[0] = y[L_POOR_REC];
+  P[1] = y[L_GOOD_REC] + y[H_GOOD_REC];
+  for (int i=0 ; i<LH_COMPARTMENTS ; i++)
+    dy[i] = T(0.0);
+  for (int c=0 ; c<LH_CHANNELS ; c++) {
+    r = k[c] * y[lh_channel_from[c]];
+    if (lh_channel_pool[c] >= 0)
+      r = r * P[lh_channel_pool[c]];
+    dy[lh_channel_from[c]] -= r;
+    dy[lh_channel_to[c]] += r;
+  }
+}
+
+// initial condition of the rate equations (fractions of ants), the Na -> infinity limit of lh_init
+template <class T>
+inline void lh_ode_init(T* y, int stride, const T& H, const T& z) {
+  T L = 1.0 - H;
+  y[L_OLDNEST*stride] = L*(1.0 - z);
+  y[H_OLDNEST*stride] = H*(1.0 - z);
+  y[H_POOR_VIS*stride] = y[H_GOOD_COM*stride] = H*z/2.0;
+  y[L_POOR_COM*stride] = y[L_GOOD_COM*stride] = L*z/2.0;
+  y[L_POOR_REC*stride] = y[L_GOOD_REC*stride] = y[H_GOOD_REC*stride] = T(0.0);
+}
+
+// also used with the vectors of lanes of ensemble-ssa.h as T
+template <class T> inline T lh_oldnest(const T* x) { return x[L_OLDNEST] + x[H_OLDNEST]; }
+template <class T> inline T lh_good(const T* x) { return x[L_GOOD_COM] + x[H_GOOD_COM] + x[L_GOOD_REC] + x[H_GOOD_REC]; }
+template <class T> inline T lh_poor(const T* x) { return x[L_POOR_COM] + x[L_POOR_REC] + x[H_POOR_VIS]; }
+
+// observables of trajectory-recorder.h, in the order of the columns of diffeqn-nestchoice.cc
+inline std::vector<trajectory_observable> lh_observables() {
+  const trajectory_observable obs[4] = {
+    {"good_rec", {L_GOOD_REC, H_GOOD_REC}},
+    {"good", {L_GOOD_COM, H_GOOD_COM, L_GOOD_REC, H_GOOD_REC}},
+    {"poor_rec", {L_POOR_REC}},
+    {"poor", {L_POOR_COM, L_POOR_REC, H_POOR_VIS}}};
+  return std::vector<trajectory_observable>(obs, obs + 4);
+}
+
+// dynamics continue until either new nest reaches the quorum or all ants are back in the old nest
+struct lh_running {
+  int Na, th_quorum;
+  lh_running(int Na_, int th_quorum_) : Na(Na_), th_quorum(th_quorum_) {}
+  bool operator()(const int* x) const {
+    return lh_oldnest(x) < Na && lh_good(x) < th_quorum && lh_poor(x) < th_quorum;
+  }
+  // lanes of ensemble-ssa.h that keep going
+  template <class V>
+  auto lanes(const V* x) const -> decltype(x[0] < 0.0) {
+    return (lh_oldnest(x) < (double)Na) & (lh_good(x) < (double)th_quorum) & (lh_poor(x) < (double)th_quorum);
+  }
+  // # ants that have to move before the dynamics can stop
+  int margin(const int* x) const {
+    return std::min(Na - lh_oldnest(x), std::min(th_quorum - lh_good(x), th_quorum - lh_poor(x)));
+  }
+};
+
+// highest channel of a set
+constexpr int lh_last_channel(unsigned live) { return (live >> 1)? 1 + lh_last_channel(live >> 1) : 0; }
+
+/* Exact SSA of the L/H model specialised at compile time for the set of live channels LIVE. It is the event
+   loop of ssa_engine::run_linear (SSA_LINEAR) with the network known: the loops over the channels are
+   unrolled, the dead channels (alpha_s = 0, alpha_leak = 0, and the channels of the high-threshold ants when
+   there are none) and the recruitment rate 1 are eliminated, and the pool sums are read directly. The live
+   channels are summed in the same order as in run_linear, so that the trajectories are bitwise identical.
+   k[c] is the rate of channel c, index[c] its position in the network (for ssa-profile.h). */
+template <unsigned LIVE>
+struct lh_kernel {
+  template <class Rng, class Cont>
+  static double run(ssa_engine& e, const double* k, const int* index, int* x, Rng& rng, Cont keep_going) {
+    const int last = lh_last_channel(LIVE);
+    const double Na = e.net.Na;
+    double acc[LH_CHANNELS];
+    double psum[2];
+    double t = 0.0;
+    double a0, ra;
+    int c;
+
+    e.events = 0;
+    while (keep_going(x)) {
+      psum[0] = 0.0;
+      psum[0] += x[L_POOR_REC];
+      psum[1] = 0.0;
+      psum[1] += x[L_GOOD_REC];
+      if (LIVE & LH_H_CHANNELS)
+	psum[1] += x[H_GOOD_REC];
+
+      a0 = 0.0;
+#pragma GCC unroll 16 // without it, GCC 12 left the loops of some sets rolled, three times slower
+      for (c=0 ; c<LH_CHANNELS ; c++)
+	if (LIVE >> c & 1) {
+	  if (lh_channel_pool[c] < 0)
+	    a0 += k[c] * x[lh_channel_from[c]];
+	  else
+	    a0 += psum[lh_channel_pool[c]] * x[lh_channel_from[c]] / Na;
+	  acc[c] = a0;
+	}
+      if (a0 <= 0.0) // absorbing state
+	break;
+      SSA_PROF(e.prof.lap(SSA_PROF_PROPENSITY));
+
+      ra = rng.uniform() * a0;
+      SSA_PROF(e.prof.lap(SSA_PROF_RNG));
+#pragma GCC unroll 16
+      for (c=0 ; c<last ; c++)
+	if ((LIVE >> c & 1) && ra < acc[c])
+	  break;
+      SSA_PROF(e.prof.lap(SSA_PROF_SELECTION));
+      x[lh_channel_from[c]]--;
+      x[lh_channel_to[c]]++;
+      e.events++;
+      SSA_PROF(e.prof.channel_events[index[c]]++; e.prof.lap(SSA_PROF_UPDATE));
+      t += 1.0/a0*rng.exponential();
+      ssa_jumped(keep_going, t, lh_channel_from[c], lh_channel_to[c], x, 0);
+      SSA_PROF(e.prof.lap(SSA_PROF_RNG));
+    }
+    return t;
+  }
+};
+
+/* Runtime dispatch to lh_kernel. The channels of the network are those of lh_network with the zero rates
+   dropped; the kernels cover the networks with all the recruitment and commitment channels (alpha > 0), with
+   or without the switching and leak channels, and each of them with or without high-threshold ants, which
+   is checked at the start of every run (the rounding in lh_init may place some with H = 0).
+   Other networks and methods run on the generic engine, as does every run if channels is set to 0. */
+struct lh_kernels {
+  unsigned channels; // live channels of the network, 0 if no kernel applies
+  double k[LH_CHANNELS];
+  int index[LH_CHANNELS];
+
+  lh_kernels(const ssa_engine& e) : channels(0) {
+    const ssa_network& net = e.net;
+    int c, n = 0;
+    unsigned live = 0;
+    for (c=0 ; c<LH_CHANNELS ; c++) {
+      k[c] = 0.0;
+      index[c] = -1;
+      if (n < net.channels() && net.from[n] == lh_channel_from[c] && net.to[n] == lh_channel_to[c]
+	  && (net.pool[n] < 0) == (lh_channel_pool[c] < 0) && (lh_channel_pool[c] < 0 || net.k[n] == 1.0)) {
+	k[c] = net.k[n];
+	index[c] = n++;
+	live |= 1u << c;
+      }
+    }
+    if (e.method != SSA_LINEAR || net.n_species != LH_COMPARTMENTS || n != net.channels() || net.pool_members.size() != 2
+	|| net.pool_members[0] != std::vector<int>(1, L_POOR_REC) || net.pool_members[1].size() != 2
+	|| net.pool_members[1][0] != L_GOOD_REC || net.pool_members[1][1] != H_GOOD_REC
+	|| (live | LH_SWITCH_CHANNEL | LH_LEAK_CHANNELS) != LH_ALL_CHANNELS
+	|| ((live & LH_LEAK_CHANNELS) != 0 && (live & LH_LEAK_CHANNELS) != LH_LEAK_CHANNELS))
+      return;
+    channels = live;
+  }
+
+  template <class Rng, class Cont>
+  double run(ssa_engine& e, int* x, Rng& rng, Cont keep_going) {
+    if (channels == 0)
+      return e.run(x, rng, keep_going);
+    unsigned live = channels;
+    if (x[H_OLDNEST] + x[H_POOR_VIS] + x[H_GOOD_COM] + x[H_GOOD_REC] == 0) // homogeneous colony
+      live &= ~LH_H_CHANNELS;
+    double t;
+    SSA_PROF(e.prof.start());
+    switch (live) {
+    case LH_ALL_CHANNELS:
+      t = lh_kernel<LH_ALL_CHANNELS>::run(e, k, index, x, rng, keep_going);
+      break;
+    case LH_ALL_CHANNELS & ~LH_SWITCH_CHANNEL: // alpha_s = 0
+      t = lh_kernel<LH_ALL_CHANNELS & ~LH_SWITCH_CHANNEL>::run(e, k, index, x, rng, keep_going);
+      break;
+    case LH_ALL_CHANNELS & ~LH_LEAK_CHANNELS: // alpha_leak = 0
+      t = lh_kernel<LH_ALL_CHANNELS & ~LH_LEAK_CHANNELS>::run(e, k, index, x, rng, keep_going);
+      break;
+    case LH_ALL_CHANNELS & ~LH_SWITCH_CHANNEL & ~LH_LEAK_CHANNELS:
+      t = lh_kernel<LH_ALL_CHANNELS & ~LH_SWITCH_CHANNEL & ~LH_LEAK_CHANNELS>::run(e, k, index, x, rng, keep_going);
+      break;
+    case LH_ALL_CHANNELS & ~LH_H_CHANNELS: // H = 0
+      t = lh_kernel<LH_ALL_CHANNELS & ~LH_H_CHANNELS>::run(e, k, index, x, rng, keep_going);
+      break;
+    case LH_ALL_CHANNELS & ~LH_H_CHANNELS & ~LH_LEAK_CHANNELS:
+      t = lh_kernel<LH_ALL_CHANNELS & ~LH_H_CHANNELS & ~LH_LEAK_CHANNELS>::run(e, k, index, x, rng, keep_going);
+      break;
+    default: // not reached
+      return e.run(x, rng, keep_going);
+    }
+    SSA_PROF(e.prof.end_run(e.events, 0));
+    return t;
+  }
+};
+
+// one realisation of the L/H model for trial-runner.h; score = 1 if the good nest reached the quorum.
+// With an active cap (trial-cap.h), a realisation that hits it is discarded and capped() is true;
+// with an active trace, the accepted realisations are added to its trajectory_recorder.
+struct lh_trial {
+  ssa_engine engine;
+  lh_kernels kernels;
+  lh_running running;
+  trial_cap cap;
+  trajectory_trace trace;
+  int x[LH_COMPARTMENTS]; // state of the last realisation
+  double H, z;
+  int Na;
+
+  lh_trial(const ssa_network& net, double H_, double z_, int Na_, int th_quorum, int method = SSA_AUTO)
+    : engine(net, method), kernels(engine), running(Na_, th_quorum), H(H_), z(z_), Na(Na_) {}
+
+  void init(int* x) const { lh_init(x, H, z, Na); }
+
+  // final state of a realisation; false if it is discarded
+  bool finish(const int* x, double& score) const {
+    if (lh_oldnest(x) >= Na) // all ants are back in the old nest
+      return false;
+    // a tau leap (SSA_TAU) may overshoot the quorum, possibly in both nests
+    score = (lh_good(x) >= running.th_quorum && lh_good(x) >= lh_poor(x))? 1.0 : 0.0;
+    return true;
+  }
+
+  // 0 if the good nest has more ants than the poor nest at the end of the last realisation, 1 otherwise
+  int winner() const { return (lh_good(x) >= lh_poor(x))? 0 : 1; }
+
+  bool capped() const { return cap.hit; }
+
+  template <class Rng, class Cont>
+  double run(Rng& rng, Cont keep_going) {
+    if (!cap.active())
+      return kernels.run(engine, x, rng, keep_going);
+    cap.start();
+    return kernels.run(engine, x, rng, capped_running<Cont>(keep_going, &cap));
+  }
+
+  template <class Rng>
+  bool operator()(Rng& rng, double& t, double& score) {
+    init(x);
+    if (!trace.active()) {
+      t = run(rng, running);
+      return !cap.hit && finish(x, score);
+    }
+    trace.begin();
+    t = run(rng, traced_running<lh_running>(running, &trace));
+    bool accepted = !cap.hit && finish(x, score);
+    trace.end(t, x, accepted, Na);
+    return accepted;
+  }
+};
+
+// L/H model with several quorum thresholds in one pass, a multi-output trial for trial-runner.h.
+// The trajectory is simulated in stages up to th[0], th[1], ... (non-decreasing), and output k reports the
+// time and score at which the trial with threshold th[k] would stop on the same trajectory. The draws are
+// the same as in one run up to the largest threshold, because every stage starts from the current state.
+struct lh_multi_trial {
+  ssa_engine engine;
+  lh_kernels kernels;
+  std::vector<int> th;
+  double H, z;
+  int Na;
+
+  lh_multi_trial(const ssa_network& net, double H_, double z_, int Na_, const std::vector<int>& th_, int method = SSA_AUTO)
+    : engine(net, method), kernels(engine), th(th_), H(H_), z(z_), Na(Na_) {}
+
+  int outputs() const { return (int)th.size(); }
+
+  template <class Rng>
+  void operator()(Rng& rng, trial_outcome* out) {
+    int x[LH_COMPARTMENTS];
+    double t = 0.0;
+    size_t k;
+    lh_init(x, H, z, Na);
+    for (k=0 ; k<th.size() ; k++) {
+      lh_running running(Na, th[k]);
+      t += kernels.run(engine, x, rng, running);
+      if (lh_oldnest(x) >= Na) // all ants are back in the old nest before th[k] is reached
+	break;
+      out[k].accepted = true;
+      out[k].t = t;
+      out[k].score = (lh_good(x) >= th[k] && lh_good(x) >= lh_poor(x))? 1.0 : 0.0;
+    }
+    for ( ; k<th.size() ; k++)
+      out[k].accepted = false;
+  }
+};
+
+// N-nest model: x[0] = old nest, x[1+2i] = committed to nest i, x[2+2i] = recruiters of nest i
+inline int nnest_com(int i) { return 1+2*i; }
+inline int nnest_rec(int i) { return 2+2*i; }
+
+inline ssa_network nnest_network(double alpha, double alpha_leak, int Na, int Nnest) {
+  ssa_network net(1+2*Nnest, Na);
+  int i, p;
+  for (i=0 ; i<Nnest ; i++) {
+    p = net.add_pool(std::vector<int>(1, nnest_rec(i)));
+    net.add_channel(0, nnest_com(i), 1.0, p); // recruitment
+    net.add_channel(nnest_com(i), nnest_rec(i), alpha); // a committed ant turns to recruit
+    net.add_channel(nnest_com(i), 0, alpha_leak); // leak from committed to oldnest
+    net.add_channel(nnest_rec(i), 0, alpha_leak); // leak from recruit to oldnest
+  }
+  return net;
+}
+
+// initial condition; returns Na minus the # ants placed before the rounding correction
+inline int nnest_init(int* x, double z, int Na, int Nnest) {
+  int i, tmp_sum;
+  x[0] = (int)(Na*(1-z)+1e-8);
+  tmp_sum = x[0];
+  for (i=0 ; i<Nnest ; i++) {
+    x[nnest_com(i)] = (int)((Na*z+1e-8)/Nnest);
+    x[nnest_rec(i)] = 0;
+    tmp_sum += x[nnest_com(i)];
+  }
+  if (tmp_sum < Na)
+    x[0] += Na - tmp_sum;
+  return Na - tmp_sum;
+}
+
+// dynamics continue until 90% of the ants have left the old nest or all ants are back in the old nest
+struct nnest_running {
+  int Na;
+  nnest_running(int Na_) : Na(Na_) {}
+  bool operator()(const int* x) const { return x[0] < Na && x[0] > 0.1 * Na; }
+  // lanes of ensemble-ssa.h that keep going
+  template <class V>
+  auto lanes(const V* x) const -> decltype(x[0] < 0.0) { return (x[0] < (double)Na) & (x[0] > 0.1 * Na); }
+  // # ants that have to move before the dynamics can stop
+  int margin(const int* x) const { return std::min(Na - x[0], x[0] - (int)floor(0.1 * Na)); }
+};
+
+// observables of trajectory-recorder.h: the old nest and the ants at each new nest
+inline std::vector<trajectory_observable> nnest_observables(int Nnest) {
+  std::vector<trajectory_observable> obs(1+Nnest);
+  obs[0].name = "old";
+  obs[0].compartments.push_back(0);
+  for (int i=0 ; i<Nnest ; i++) {
+    obs[1+i].name = "nest" + std::to_string(i+1);
+    obs[1+i].compartments.push_back(nnest_com(i));
+    obs[1+i].compartments.push_back(nnest_rec(i));
+  }
+  return obs;
+}
+
+// 1 - (entropy of the distribution of emigrated ants over the new nests) / log(Nnest)
+inline double nnest_cohesion(const int* x, int Nnest) {
+  int i, n, tmp_sum = 0;
+  double Entropy = 0.0;
+  for (i=0 ; i<Nnest ; i++)
+    tmp_sum += x[nnest_com(i)] + x[nnest_rec(i)];
+  for (i=0 ; i<Nnest ; i++) {
+    n = x[nnest_com(i)] + x[nnest_rec(i)];
+    if (n > 0)
+      Entropy += - (double)n/tmp_sum * log((double)n/tmp_sum);
+  }
+  return 1 - Entropy/log(Nnest);
+}
+
+// one realisation of the N-nest model for trial-runner.h; score = cohesion. With an active cap (trial-cap.h),
+// a realisation that hits it is discarded and capped() is true; with an active trace, the accepted
+// realisations are added to its trajectory_recorder.
+struct nnest_trial {
+  ssa_engine engine;
+  nnest_running running;
+  trial_cap cap;
+  trajectory_trace trace;
+  std::vector<int> x;
+  double z;
+  int Na, Nnest;
+
+  nnest_trial(const ssa_network& net, double z_, int Na_, int Nnest_, int method = SSA_AUTO)
+    : engine(net, method), running(Na_), x(1+2*Nnest_), z(z_), Na(Na_), Nnest(Nnest_) {}
+
+  void init(int* x0) const { nnest_init(x0, z, Na, Nnest); }
+
+  // final state of a realisation; false if it is discarded
+  bool finish(const int* x0, double& score) const {
+    if (x0[0] == Na) // all ants are back in the old nest
+      return false;
+    score = nnest_cohesion(x0, Nnest);
+    return true;
+  }
+
+  // new nest with the most ants at the end of the last realisation (the first one if tied)
+  int winner() const {
+    int i, best = 0;
+    for (i=1 ; i<Nnest ; i++)
+      if (x[nnest_com(i)] + x[nnest_rec(i)] > x[nnest_com(best)] + x[nnest_rec(best)])
+	best = i;
+    return best;
+  }
+
+  bool capped() const { return cap.hit; }
+
+  template <class Rng, class Cont>
+  double run(Rng& rng, Cont keep_going) {
+    if (!cap.active())
+      return engine.run(&x[0], rng, keep_going);
+    cap.start();
+    return engine.run(&x[0], rng, capped_running<Cont>(keep_going, &cap));
+  }
+
+  template <class Rng>
+  bool operator()(Rng& rng, double& t, double& score) {
+    init(&x[0]);
+    if (!trace.active()) {
+      t = run(rng, running);
+      return !cap.hit && finish(&x[0], score);
+    }
+    trace.begin();
+    t = run(rng, traced_running<nnest_running>(running, &trace));
+    bool accepted = !cap.hit && finish(&x[0], score);
+    trace.end(t, &x[0], accepted, Na);
+    return accepted;
+  }
+};
+
+/* K-nest, M-class model. An ant of class m accepts nest j if quality[j] >= threshold[m]. Recruited to an
+   accepted nest, it commits and turns to a recruiter at rate alpha; recruited to a rejected nest, it only
+   visits it and switches at rate alpha_s, split evenly, to the nests that it accepts (the high-threshold ants
+   of the L/H model). Every ant outside the old nest leaks back at rate alpha_leak.
+   The state is a flat (1 + 2K) x M matrix of counts, location-major: x[l*M + m] is the # ants of class m at
+   location l = 0 (old nest), 1+2j (committed to or visiting nest j) or 2+2j (recruiters of nest j), so that
+   the # ants at a nest is a contiguous sum. A class that accepts a of the K nests has K recruitment,
+   a commitment, (K - a) a switching and K + a leak channels. The networks with more than SSA_TREE_MIN_CHANNELS
+   channels (e.g., K = 4, M = 2) run on the sum trees of ssa-engine.h, whose updates after an event are
+   incremental. */
+struct kq_model {
+  std::vector<double> quality; // of the K nests
+  std::vector<double> threshold, fraction; // of the M classes
+
+  int nests() const { return (int)quality.size(); }
+  int classes() const { return (int)threshold.size(); }
+  int species() const { return (1 + 2*nests()) * classes(); }
+  bool accepts(int m, int j) const { return quality[j] >= threshold[m]; }
+
+  // compartments of class m
+  int oldnest(int m) const { return m; }
+  int com(int j, int m) const { return (1+2*j)*classes() + m; }
+  int rec(int j, int m) const { return (2+2*j)*classes() + m; }
+
+  // nest with the highest quality (the first one if tied)
+  int best() const { return (int)(std::max_element(quality.begin(), quality.end()) - quality.begin()); }
+};
+
+inline ssa_network kq_network(const kq_model& md, double alpha, double alpha_s, double alpha_leak, int Na) {
+  const int K = md.nests(), M = md.classes();
+  ssa_network net(md.species(), Na);
+  std::vector<int> pools(K);
+  int j, jj, m, n;
+  for (j=0 ; j<K ; j++) {
+    std::vector<int> members;
+    for (m=0 ; m<M ; m++)
+      if (md.accepts(m, j))
+	members.push_back(md.rec(j, m));
+    pools[j] = members.empty()? -1 : net.add_pool(members);
+  }
+  for (m=0 ; m<M ; m++) {
+    for (j=0 ; j<K ; j++) // recruitment
+      if (pools[j] >= 0)
+	net.add_channel(md.oldnest(m), md.com(j, m), 1.0, pools[j]);
+    for (n=0, j=0 ; j<K ; j++)
+      n += md.accepts(m, j);
+    for (j=0 ; j<K ; j++)
+      if (md.accepts(m, j))
+	net.add_channel(md.com(j, m), md.rec(j, m), alpha); // commited -> recruiter
+      else
+	for (jj=0 ; jj<K ; jj++)
+	  if (md.accepts(m, jj))
+	    net.add_channel(md.com(j, m), md.com(jj, m), alpha_s / n); // visitors switch to an accepted nest
+    for (j=0 ; j<K ; j++) { // leak
+      net.add_channel(md.com(j, m), md.oldnest(m), alpha_leak);
+      if (md.accepts(m, j))
+	net.add_channel(md.rec(j, m), md.oldnest(m), alpha_leak);
+    }
+  }
+  return net;
+}
+
+// initial condition as in lh_init and nnest_init: a fraction z of the ants is spread evenly over the nests,
+// and each location holds the fractions of the classes; returns Na minus the # ants placed before the rounding
+// correction, which goes to the old nest of the last class
+inline int kq_init(const kq_model& md, int* x, double z, int Na) {
+  const int K = md.nests(), M = md.classes();
+  int j, m, n, tmp_sum = 0;
+  for (m=0 ; m<md.species() ; m++)
+    x[m] = 0;
+  for (j=-1 ; j<K ; j++) { // j = -1: old nest
+    int total = (j < 0)? (int)(Na*(1-z)+1e-8) : (int)((Na*z+1e-8)/K);
+    int* loc = (j < 0)? x + md.oldnest(0) : x + md.com(j, 0);
+    for (m=1 ; m<M ; m++) {
+      n = (j < 0)? (int)(Na*md.fraction[m]*(1-z)+1e-8) : (int)((Na*md.fraction[m]*z+1e-8)/K);
+      loc[m] = n;
+      total -= n;
+    }
+    loc[0] = total;
+    for (m=0 ; m<M ; m++)
+      tmp_sum += loc[m];
+  }
+  if (tmp_sum < Na)
+    x[md.oldnest(M-1)] += Na - tmp_sum;
+  return Na - tmp_sum;
+}
+
+// # ants at nest j (committed, visiting and recruiting)
+inline int kq_nest(const kq_model& md, const int* x, int j) {
+  const int M = md.classes();
+  const int* loc = x + md.com(j, 0);
+  int n = 0;
+  for (int i=0 ; i<2*M ; i++)
+    n += loc[i];
+  return n;
+}
+
+// dynamics continue until a new nest reaches the quorum or all ants are back in the old nest
+struct kq_running {
+  const kq_model* md;
+  int Na, th_quorum;
+  kq_running(const kq_model& md_, int Na_, int th_quorum_) : md(&md_), Na(Na_), th_quorum(th_quorum_) {}
+  int oldnest(const int* x) const {
+    int n = 0;
+    for (int m=0 ; m<md->classes() ; m++)
+      n += x[m];
+    return n;
+  }
+  bool operator()(const int* x) const {
+    if (oldnest(x) >= Na)
+      return false;
+    for (int j=0 ; j<md->nests() ; j++)
+      if (kq_nest(*md, x, j) >= th_quorum)
+	return false;
+    return true;
+  }
+  // # ants that have to move before the dynamics can stop
+  int margin(const int* x) const {
+    int n = Na - oldnest(x);
+    for (int j=0 ; j<md->nests() ; j++)
+      n = std::min(n, th_quorum - kq_nest(*md, x, j));
+    return n;
+  }
+};
+
+// one realisation of the K-nest, M-class model for trial-runner.h; score = 1 if the nest with the most ants
+// (which reached the quorum) has the highest quality. With an active cap (trial-cap.h), a realisation that
+// hits it is discarded and capped() is true.
+struct kq_trial {
+  ssa_engine engine;
+  kq_running running;
+  trial_cap cap;
+  std::vector<int> x; // state of the last realisation
+  double z;
+  int Na;
+
+  kq_trial(const ssa_network& net, const kq_model& md, double z_, int Na_, int th_quorum, int method = SSA_AUTO)
+    : engine(net, method), running(md, Na_, th_quorum), x(md.species()), z(z_), Na(Na_) {}
+
+  const kq_model& model() const { return *running.md; }
+
+  // nest with the most ants at the end of the last realisation (the first one if tied)
+  int winner() const {
+    int j, best = 0;
+    for (j=1 ; j<model().nests() ; j++)
+      if (kq_nest(model(), &x[0], j) > kq_nest(model(), &x[0], best))
+	best = j;
+    return best;
+  }
+
+  bool capped() const { return cap.hit; }
+
+  template <class Rng>
+  bool operator()(Rng& rng, double& t, double& score) {
+    kq_init(model(), &x[0], z, Na);
+    if (!cap.active())
+      t = engine.run(&x[0], rng, running);
+    else {
+      cap.start();
+      t = engine.run(&x[0], rng, capped_running<kq_running>(running, &cap));
+    }
+    if (cap.hit || running.oldnest(&x[0]) >= Na) // capped, or all ants are back in the old nest
+      return false;
+    int w = winner();
+    score = (kq_nest(model(), &x[0], w) >= running.th_quorum && model().quality[w] == model().quality[model().best()])? 1.0 : 0.0;
+    return true;
+  }
+};
+
+#endif // NEST_MODELS_H
@@ -0,0 +1,244 @@
+/* Batched version of the Dormand-Prince integrator of ode-solver.h for parameter scans of the mean-field models.
+
+W lanes, one per reaction network, are integrated at once. All variables are stored in structure-of-arrays
+layout (variable i of lane l at index i*W + l) and every inner loop runs over the lanes without branches, so
+that the compiler vectorises the right-hand side and the stages (e.g. g++ -O3 -march=native gives AVX2 or AVX-512 code).
+Each lane has its own time, step size and accept/reject decision; events are located per lane by bisection
+on the continuous extension, as in dopri5::event.
+*/
+
+#ifndef ODE_BATCH_H
+#define ODE_BATCH_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "ssa-engine.h"
+
+// rate equations (ssa_network::drift) of W networks with the same species and pools. The channels are the union
+// of the channels of the networks, identified by (from, to, pool), with rate 0 in the lanes that lack them.
+struct network_batch {
+  int n_species, W;
+  std::vector<int> from, to, pool;
+  std::vector<std::vector<int> > pool_members;
+  std::vector<double> k; // rate of channel c in lane l at c*W + l
+  std::vector<double> P; // pool sums
+
+  // lanes nlanes..W-1 repeat network 0
+  network_batch(const ssa_network* nets, int nlanes, int W_)
+    : n_species(nets[0].n_species), W(W_), pool_members(nets[0].pool_members), P(nets[0].pool_members.size()*W_) {
+    int l, c, d;
+    for (l=0 ; l<W ; l++) {
+      const ssa_network& net = nets[(l < nlanes)? l : 0];
+      for (c=0 ; c<net.channels() ; c++) {
+	for (d=0 ; d<(int)from.size() ; d++)
+	  if (from[d]==net.from[c] && to[d]==net.to[c] && pool[d]==net.pool[c])
+	    break;
+	if (d == (int)from.size()) {
+	  from.push_back(net.from[c]);
+	  to.push_back(net.to[c]);
+	  pool.push_back(net.pool[c]);
+	  k.resize(k.size() + W, 0.0);
+	}
+	k[d*W + l] = net.k[c];
+      }
+    }
+  }
+
+  void drift(const double* __restrict y, double* __restrict dy) {
+    int i, l, c;
+    size_t m;
+    for (i=0 ; i<n_species*W ; i++)
+      dy[i] = 0.0;
+    for (i=0 ; i<(int)pool_members.size() ; i++) {
+      double* __restrict Pi = &P[i*W];
+      for (l=0 ; l<W ; l++)
+	Pi[l] = 0.0;
+      for (m=0 ; m<pool_members[i].size() ; m++) {
+	const double* __restrict ym = y + pool_members[i][m]*W;
+	for (l=0 ; l<W ; l++)
+	  Pi[l] += ym[l];
+      }
+    }
+    for (c=0 ; c<(int)from.size() ; c++) {
+      const double* __restrict kc = &k[c*W];
+      const double* __restrict yf = y + from[c]*W;
+      double* __restrict df = dy + from[c]*W;
+      double* __restrict dt = dy + to[c]*W;
+      if (pool[c] >= 0) {
+	const double* __restrict Pc = &P[pool[c]*W];
+	for (l=0 ; l<W ; l++) {
+	  double r = kc[l] * yf[l] * Pc[l];
+	  df[l] -= r;
+	  dt[l] += r;
+	}
+      } else {
+	for (l=0 ; l<W ; l++) {
+	  double r = kc[l] * yf[l];
+	  df[l] -= r;
+	  dt[l] += r;
+	}
+      }
+    }
+  }
+};
+
+struct dopri5_batch {
+  int n, W;
+  double rtol, atol;
+  std::vector<double> t, h, t_old, h_old; // per lane, as in dopri5
+  std::vector<double> y, y_old, k1, k2, k3, k4, k5, k6, k7, ytmp, err, fac;
+  std::vector<char> accepted; // lane accepted its last step attempt
+  std::vector<char> rejected; // lane rejected a step since its last accepted one
+  std::vector<char> active; // lanes still being integrated; retired lanes have h = 0
+  long nfev; // # batched right-hand side evaluations
+  mutable std::vector<double> ys, ye; // scratch for event
+
+  dopri5_batch(int n_, int W_, double rtol_ = 1e-6, double atol_ = 1e-9)
+    : n(n_), W(W_), rtol(rtol_), atol(atol_), t(W_), h(W_), t_old(W_), h_old(W_),
+      y(n_*W_), y_old(n_*W_), k1(n_*W_), k2(n_*W_), k3(n_*W_), k4(n_*W_), k5(n_*W_), k6(n_*W_), k7(n_*W_), ytmp(n_*W_),
+      err(W_), fac(W_), accepted(W_), rejected(W_), active(W_), nfev(0), ys(n_), ye(n_) {}
+
+  // y0 in structure-of-arrays layout
+  template <class Rhs>
+  void init(Rhs& f, double t0, const double* y0) {
+    int i, l;
+    double sk;
+    std::vector<double> d0(W, 0.0), d1(W, 0.0);
+    std::copy(y0, y0 + n*W, y.begin());
+    f.drift(&y[0], &k1[0]);
+    nfev++;
+    for (i=0 ; i<n ; i++)
+      for (l=0 ; l<W ; l++) {
+	sk = atol + rtol * fabs(y[i*W+l]);
+	d0[l] += (y[i*W+l]/sk) * (y[i*W+l]/sk);
+	d1[l] += (k1[i*W+l]/sk) * (k1[i*W+l]/sk);
+      }
+    for (l=0 ; l<W ; l++) {
+      t[l] = t0;
+      h[l] = (d0[l] < 1e-10 || d1[l] < 1e-10)? 1e-6 : 0.01 * sqrt(d0[l]/d1[l]);
+      accepted[l] = rejected[l] = 0;
+      active[l] = 1;
+    }
+  }
+
+  void retire(int l) {
+    active[l] = 0;
+    h[l] = 0.0;
+  }
+
+  bool any_active() const {
+    for (int l=0 ; l<W ; l++)
+      if (active[l])
+	return true;
+    return false;
+  }
+
+  // one step attempt in every lane; accepted[l] tells whether lane l advanced. The right-hand side must be autonomous.
+  template <class Rhs>
+  void step(Rhs& f) {
+    static const double a21=1.0/5;
+    static const double a31=3.0/40, a32=9.0/40;
+    static const double a41=44.0/45, a42=-56.0/15, a43=32.0/9;
+    static const double a51=19372.0/6561, a52=-25360.0/2187, a53=64448.0/6561, a54=-212.0/729;
+    static const double a61=9017.0/3168, a62=-355.0/33, a63=46732.0/5247, a64=49.0/176, a65=-5103.0/18656;
+    static const double a71=35.0/384, a73=500.0/1113, a74=125.0/192, a75=-2187.0/6784, a76=11.0/84;
+    static const double e1=71.0/57600, e3=-71.0/16695, e4=71.0/1920, e5=-17253.0/339200, e6=22.0/525, e7=-1.0/40;
+    int i, l, j;
+    double sk, e;
+
+    for (i=0 ; i<n ; i++) // first same as last
+      for (l=0 ; l<W ; l++)
+	k1[i*W+l] = accepted[l]? k7[i*W+l] : k1[i*W+l];
+
+    for (i=0 ; i<n ; i++) for (l=0 ; l<W ; l++) { j = i*W+l; ytmp[j] = y[j] + h[l]*a21*k1[j]; }
+    f.drift(&ytmp[0], &k2[0]);
+    for (i=0 ; i<n ; i++) for (l=0 ; l<W ; l++) { j = i*W+l; ytmp[j] = y[j] + h[l]*(a31*k1[j] + a32*k2[j]); }
+    f.drift(&ytmp[0], &k3[0]);
+    for (i=0 ; i<n ; i++) for (l=0 ; l<W ; l++) { j = i*W+l; ytmp[j] = y[j] + h[l]*(a41*k1[j] + a42*k2[j] + a43*k3[j]); }
+    f.drift(&ytmp[0], &k4[0]);
+    for (i=0 ; i<n ; i++) for (l=0 ; l<W ; l++) { j = i*W+l; ytmp[j] = y[j] + h[l]*(a51*k1[j] + a52*k2[j] + a53*k3[j] + a54*k4[j]); }
+    f.drift(&ytmp[0], &k5[0]);
+    for (i=0 ; i<n ; i++) for (l=0 ; l<W ; l++) { j = i*W+l; ytmp[j] = y[j] + h[l]*(a61*k1[j] + a62*k2[j] + a63*k3[j] + a64*k4[j] + a65*k5[j]); }
+    f.drift(&ytmp[0], &k6[0]);
+    for (i=0 ; i<n ; i++) for (l=0 ; l<W ; l++) { j = i*W+l; ytmp[j] = y[j] + h[l]*(a71*k1[j] + a73*k3[j] + a74*k4[j] + a75*k5[j] + a76*k6[j]); }
+    f.drift(&ytmp[0], &k7[0]);
+    nfev += 6;
+
+    for (l=0 ; l<W ; l++)
+      err[l] = 0.0;
+    for (i=0 ; i<n ; i++)
+      for (l=0 ; l<W ; l++) {
+	j = i*W+l;
+	sk = atol + rtol * std::max(fabs(y[j]), fabs(ytmp[j]));
+	e = h[l]*(e1*k1[j] + e3*k3[j] + e4*k4[j] + e5*k5[j] + e6*k6[j] + e7*k7[j]) / sk;
+	err[l] += e*e;
+      }
+    for (l=0 ; l<W ; l++) {
+      err[l] = sqrt(err[l]/n);
+      fac[l] = (err[l] > 0.0)? 0.9 * pow(err[l], -0.2) : 5.0;
+      fac[l] = std::min(5.0, std::max(0.2, fac[l]));
+      accepted[l] = active[l] && err[l] <= 1.0;
+    }
+
+    for (i=0 ; i<n ; i++)
+      for (l=0 ; l<W ; l++) {
+	j = i*W+l;
+	y_old[j] = accepted[l]? y[j] : y_old[j];
+	y[j] = accepted[l]? ytmp[j] : y[j];
+      }
+    for (l=0 ; l<W ; l++) {
+      if (accepted[l]) {
+	t_old[l] = t[l];
+	h_old[l] = h[l];
+	t[l] += h[l];
+	h[l] *= rejected[l]? std::min(fac[l], 1.0) : fac[l];
+	rejected[l] = 0;
+      } else if (active[l]) {
+	h[l] *= fac[l];
+	rejected[l] = 1;
+      }
+    }
+  }
+
+  // state of lane l at time s in [t_old[l], t[l]] after an accepted step (4th-order continuous extension)
+  void dense(int l, double s, double* ys) const {
+    static const double d1=-12715105075.0/11282082432, d3=87487479700.0/32700410799, d4=-10690763975.0/1880347072,
+      d5=701980252875.0/199316789632, d6=-1453857185.0/822651844, d7=69997945.0/29380423;
+    double th = (s - t_old[l]) / h_old[l], th1 = 1.0 - th, hl = h_old[l];
+    double ydiff, bspl, r4, r5;
+    int j;
+    for (int i=0 ; i<n ; i++) {
+      j = i*W+l;
+      ydiff = y[j] - y_old[j];
+      bspl = hl*k1[j] - ydiff;
+      r4 = ydiff - hl*k7[j] - bspl;
+      r5 = hl*(d1*k1[j] + d3*k3[j] + d4*k4[j] + d5*k5[j] + d6*k6[j] + d7*k7[j]);
+      ys[i] = y_old[j] + th*(ydiff + th1*(bspl + th*(r4 + th1*r5)));
+    }
+  }
+
+  // dopri5::event for lane l, which must have accepted its last step
+  template <class G>
+  bool event(int l, G g, double& t_event) const {
+    double lo = t_old[l], hi = t[l], mid;
+    for (int i=0 ; i<n ; i++) {
+      ys[i] = y_old[i*W+l];
+      ye[i] = y[i*W+l];
+    }
+    if (!(g(&ys[0]) < 0.0 && g(&ye[0]) >= 0.0))
+      return false;
+    while (hi - lo > 1e-13 * std::max(1.0, fabs(hi))) {
+      mid = 0.5*(lo + hi);
+      dense(l, mid, &ys[0]);
+      if (g(&ys[0]) < 0.0)
+	lo = mid;
+      else
+	hi = mid;
+    }
+    t_event = hi;
+    return true;
+  }
+};
+
+#endif // ODE_BATCH_H
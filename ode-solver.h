@@ -0,0 +1,145 @@
+/* Adaptive Runge-Kutta integrator for the mean-field models.
+
+Dormand-Prince 5(4) pair with step-size control (Hairer, Norsett and Wanner,
+Solving Ordinary Differential Equations I, Sec. II.5), first-same-as-last, and
+the 4th-order continuous extension for dense output, which is used to print the
+solution on a fixed time grid and to locate events (zeros of a function of the state)
+within a step.
+
+A right-hand side is an object with void operator()(double t, const double* y, double* dy).
+Runge-Kutta methods conserve linear invariants, so the total fraction of ants stays 1
+up to rounding without renormalisation.
+*/
+
+#ifndef ODE_SOLVER_H
+#define ODE_SOLVER_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+struct dopri5 {
+  int n; // # variables
+  double rtol, atol; // relative and absolute tolerance
+  double t, h; // current time and next step size
+  double t_old, h_old; // the last accepted step covers [t_old, t_old + h_old]
+  long nfev, naccept, nreject; // # right-hand side evaluations, accepted and rejected steps
+  std::vector<double> y, y_old, k1, k2, k3, k4, k5, k6, k7, ytmp, rcont;
+
+  dopri5(int n_, double rtol_ = 1e-6, double atol_ = 1e-9)
+    : n(n_), rtol(rtol_), atol(atol_), t(0.0), h(0.0), t_old(0.0), h_old(0.0), nfev(0), naccept(0), nreject(0),
+      y(n_), y_old(n_), k1(n_), k2(n_), k3(n_), k4(n_), k5(n_), k6(n_), k7(n_), ytmp(n_), rcont(5*n_) {}
+
+  template <class Rhs>
+  void init(Rhs& f, double t0, const double* y0) {
+    int i;
+    double d0 = 0.0, d1 = 0.0, sk;
+    t = t0;
+    for (i=0 ; i<n ; i++)
+      y[i] = y0[i];
+    f(t, &y[0], &k1[0]);
+    nfev++;
+    for (i=0 ; i<n ; i++) { // initial step size (Hairer et al., Sec. II.4)
+      sk = atol + rtol * fabs(y[i]);
+      d0 += (y[i]/sk) * (y[i]/sk);
+      d1 += (k1[i]/sk) * (k1[i]/sk);
+    }
+    h = (d0 < 1e-10 || d1 < 1e-10)? 1e-6 : 0.01 * sqrt(d0/d1);
+  }
+
+  // advances by one accepted step
+  template <class Rhs>
+  void step(Rhs& f) {
+    static const double c2=1.0/5, c3=3.0/10, c4=4.0/5, c5=8.0/9;
+    static const double a21=1.0/5;
+    static const double a31=3.0/40, a32=9.0/40;
+    static const double a41=44.0/45, a42=-56.0/15, a43=32.0/9;
+    static const double a51=19372.0/6561, a52=-25360.0/2187, a53=64448.0/6561, a54=-212.0/729;
+    static const double a61=9017.0/3168, a62=-355.0/33, a63=46732.0/5247, a64=49.0/176, a65=-5103.0/18656;
+    static const double a71=35.0/384, a73=500.0/1113, a74=125.0/192, a75=-2187.0/6784, a76=11.0/84;
+    static const double e1=71.0/57600, e3=-71.0/16695, e4=71.0/1920, e5=-17253.0/339200, e6=22.0/525, e7=-1.0/40;
+    static const double d1=-12715105075.0/11282082432, d3=87487479700.0/32700410799, d4=-10690763975.0/1880347072,
+      d5=701980252875.0/199316789632, d6=-1453857185.0/822651844, d7=69997945.0/29380423;
+    int i;
+    double err, sk, fac, ydiff, bspl;
+    bool rejected = false;
+
+    while (true) {
+      for (i=0 ; i<n ; i++) ytmp[i] = y[i] + h*a21*k1[i];
+      f(t+c2*h, &ytmp[0], &k2[0]);
+      for (i=0 ; i<n ; i++) ytmp[i] = y[i] + h*(a31*k1[i] + a32*k2[i]);
+      f(t+c3*h, &ytmp[0], &k3[0]);
+      for (i=0 ; i<n ; i++) ytmp[i] = y[i] + h*(a41*k1[i] + a42*k2[i] + a43*k3[i]);
+      f(t+c4*h, &ytmp[0], &k4[0]);
+      for (i=0 ; i<n ; i++) ytmp[i] = y[i] + h*(a51*k1[i] + a52*k2[i] + a53*k3[i] + a54*k4[i]);
+      f(t+c5*h, &ytmp[0], &k5[0]);
+      for (i=0 ; i<n ; i++) ytmp[i] = y[i] + h*(a61*k1[i] + a62*k2[i] + a63*k3[i] + a64*k4[i] + a65*k5[i]);
+      f(t+h, &ytmp[0], &k6[0]);
+      for (i=0 ; i<n ; i++) ytmp[i] = y[i] + h*(a71*k1[i] + a73*k3[i] + a74*k4[i] + a75*k5[i] + a76*k6[i]);
+      f(t+h, &ytmp[0], &k7[0]);
+      nfev += 6;
+
+      err = 0.0;
+      for (i=0 ; i<n ; i++) {
+	sk = atol + rtol * std::max(fabs(y[i]), fabs(ytmp[i]));
+	fac = h*(e1*k1[i] + e3*k3[i] + e4*k4[i] + e5*k5[i] + e6*k6[i] + e7*k7[i]) / sk;
+	err += fac*fac;
+      }
+      err = sqrt(err/n);
+      fac = (err > 0.0)? 0.9 * pow(err, -0.2) : 5.0;
+      fac = std::min(5.0, std::max(0.2, fac));
+      if (err <= 1.0)
+	break;
+      nreject++;
+      rejected = true;
+      h *= fac;
+    }
+
+    for (i=0 ; i<n ; i++) { // continuous extension
+      ydiff = ytmp[i] - y[i];
+      bspl = h*k1[i] - ydiff;
+      rcont[i] = y[i];
+      rcont[n+i] = ydiff;
+      rcont[2*n+i] = bspl;
+      rcont[3*n+i] = ydiff - h*k7[i] - bspl;
+      rcont[4*n+i] = h*(d1*k1[i] + d3*k3[i] + d4*k4[i] + d5*k5[i] + d6*k6[i] + d7*k7[i]);
+    }
+    y_old = y;
+    y = ytmp;
+    k1 = k7; // first same as last
+    t_old = t;
+    h_old = h;
+    t += h;
+    naccept++;
+    h *= rejected? std::min(fac, 1.0) : fac;
+  }
+
+  // state at time s in [t_old, t] from the continuous extension
+  void dense(double s, double* ys) const {
+    double th = (s - t_old) / h_old, th1 = 1.0 - th;
+    for (int i=0 ; i<n ; i++)
+      ys[i] = rcont[i] + th*(rcont[n+i] + th1*(rcont[2*n+i] + th*(rcont[3*n+i] + th1*rcont[4*n+i])));
+  }
+
+  // If g(y) changes sign from negative to non-negative in the last step, returns true and the time of
+  // the zero, located by bisection on the continuous extension.
+  template <class G>
+  bool event(G g, double& t_event) const {
+    std::vector<double> ys(n);
+    double lo = t_old, hi = t, mid;
+    if (!(g(&y_old[0]) < 0.0 && g(&y[0]) >= 0.0))
+      return false;
+    while (hi - lo > 1e-13 * std::max(1.0, fabs(hi))) {
+      mid = 0.5*(lo + hi);
+      dense(mid, &ys[0]);
+      if (g(&ys[0]) < 0.0)
+	lo = mid;
+      else
+	hi = mid;
+    }
+    t_event = hi;
+    return true;
+  }
+};
+
+#endif // ODE_SOLVER_H
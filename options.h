@@ -0,0 +1,89 @@
+/* Command-line parsing shared by the drivers.
+   Positional arguments come first; optional arguments are given as key=value in any order.
+*/
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>
+#include <thread>
+#include <chrono>
+#include <unistd.h> // getpid
+#include "ssa-engine.h"
+
+struct options {
+  std::vector<const char*> pos; // positional arguments
+  std::map<std::string, std::string> kv; // optional key=value arguments
+
+  options(int argc, char **argv) {
+    for (int i=1 ; i<argc ; i++) {
+      const char* eq = strchr(argv[i], '=');
+      if (eq == NULL)
+	pos.push_back(argv[i]);
+      else
+	kv[std::string(argv[i], eq-argv[i])] = eq+1;
+    }
+  }
+
+  int npos() const { return (int)pos.size(); }
+  bool has(const char* key) const { return kv.count(key) > 0; }
+
+  double get(const char* key, double def) const {
+    std::map<std::string, std::string>::const_iterator it = kv.find(key);
+    return (it == kv.end())? def : atof(it->second.c_str());
+  }
+  long get_long(const char* key, long def) const {
+    std::map<std::string, std::string>::const_iterator it = kv.find(key);
+    return (it == kv.end())? def : atol(it->second.c_str());
+  }
+  std::string get_str(const char* key, const char* def) const {
+    std::map<std::string, std::string>::const_iterator it = kv.find(key);
+    return (it == kv.end())? def : it->second;
+  }
+
+  // options common to the stochastic drivers
+  long trials() const { return get_long("trials", 10000); }
+  int threads() const {
+    int n = (int)get_long("threads", (long)std::thread::hardware_concurrency());
+    return (n > 0)? n : 1;
+  }
+  // seed=, or a fresh seed from the time, the process id and a high-resolution clock, so that processes
+  // started in the same second differ; positive, so that it can be given back as seed=
+  unsigned long seed() const {
+    uint64_t fresh = mix64((uint64_t)time(NULL) ^ mix64((uint64_t)getpid())
+			   ^ (uint64_t)std::chrono::high_resolution_clock::now().time_since_epoch().count());
+    return (unsigned long)get_long("seed", (long)(fresh >> 1));
+  }
+
+  // simulation method of ssa-engine.h: exact (SSA_AUTO), tau (SSA_TAU), hybrid (SSA_HYBRID)
+  // or the exact lockstep ensemble of ensemble-ssa.h (SSA_ENSEMBLE)
+  int method() const {
+    std::string m = get_str("method", "exact");
+    if (m == "exact")
+      return SSA_AUTO;
+    else if (m == "tau")
+      return SSA_TAU;
+    else if (m == "hybrid")
+      return SSA_HYBRID;
+    else if (m == "ensemble")
+      return SSA_ENSEMBLE;
+    std::cerr << "method must be exact, tau, hybrid, or ensemble" << std::endl;
+    exit(8);
+  }
+};
+
+inline void usage_common_options() {
+  std::cerr << "optional: trials=10000 threads=#cores seed=random" << std::endl;
+  std::cerr << "leak rate: alpha_leak=0.05 (0 for Figs. S1 and S6)" << std::endl;
+  std::cerr << "approximate methods for large Na: method=tau or method=hybrid (default: method=exact)" << std::endl;
+  std::cerr << "exact SSA of many trials in lockstep: method=ensemble" << std::endl;
+  std::cerr << "adaptive mode: tol=<CI half-width of the mean score> rtol=<relative CI half-width of the mean time> batch=1000" << std::endl;
+}
+
+#endif // OPTIONS_H
@@ -0,0 +1,31 @@
+# Training runs for profile-guided optimisation, run by "cmake --build <dir> --target pgo-train" in a build
+# configured with -DANT_PGO=GENERATE (see CMakeLists.txt): the workloads of Figures 4 and 9 (exact SSA), of
+# Figure 6 (single_pass=1) and of tau leaping at a large colony, with a fixed seed and fewer trials than
+# the paper. The profiles are written to ANT_PGO_DIR and used by the build configured with -DANT_PGO=USE.
+#
+#     cmake -DBIN_DIR=<dir of the executables> -P pgo-train.cmake
+
+cmake_minimum_required(VERSION 3.13)
+
+if(NOT BIN_DIR)
+  message(FATAL_ERROR "usage: cmake -DBIN_DIR=<dir of the executables> -P pgo-train.cmake")
+endif()
+
+set(runs
+  "finite-nestchoice 0.1 0.1 0.06667,0.13334,0.2,0.26667,0.33334,0.4 0.3 0.5 100 trials=10000 seed=12345"
+  "finite-nestchoice 0.1 0.1 0.2 0.3 0.5 10000 method=hybrid trials=100 seed=12345"
+  "cohesion-tradeoff 0.1 0.02:0.4:0.02 100 2 trials=2000 seed=12345"
+  "cohesion-tradeoff 0.1 0.06:0.36:0.06 100 6 trials=2000 seed=12345"
+  "speed-accuracy-coef 0 alpha_s=0.1 single_pass=1 trials=1000 seed=12345"
+  "bench-ssa 1000")
+
+foreach(r ${runs})
+  separate_arguments(argv UNIX_COMMAND "${r}")
+  list(GET argv 0 program)
+  list(REMOVE_AT argv 0)
+  message("${r}")
+  execute_process(COMMAND ${BIN_DIR}/${program}.out ${argv} RESULT_VARIABLE rc OUTPUT_QUIET ERROR_QUIET)
+  if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "${program}.out failed (${rc})")
+  endif()
+endforeach()
@@ -0,0 +1,162 @@
+/* Rare-event estimators for the L/H model (rare-nestchoice.cc): fixed-effort multilevel splitting for the
+probability that the poor nest reaches the quorum first and for the tail P(T > t) of the time to quorum.
+
+Brute force needs ~100/p trials to estimate a probability p to 10%. Splitting instead writes p as a product of
+conditional probabilities that are not small: each estimate starts N trajectories (the effort) from the initial
+condition and runs them to the first level; the N trajectories of the next stage restart from states drawn
+uniformly among those that reached it, and so on. The product of the fractions that reach each level is an
+unbiased estimate of p (Garvels, PhD thesis, 2000; Cerou and Guyader, Stoch. Anal. Appl. 25, 417 (2007)),
+because the dynamics are Markov in the compartment counts x (and the time, for the tail).
+
+Poor nest: the levels are numbers of ants at the poor nest, lh_poor(x), increasing up to the quorum. A stage
+ends when the poor nest reaches the next level, or when the trial stops otherwise (the good nest reaches the
+quorum or all ants are back in the old nest). The estimate is that of P(the poor nest reaches the quorum first),
+including the realisations discarded by finite-nestchoice.cc; 1 - precision = P / (1 - P(all ants back)).
+
+Tail: the levels are times t_1 < ... < t_K = t, and a stage ends when the trial stops or at the next time level,
+which the trajectory reaches if it is still running. The estimate is that of P(the trial has not stopped by t).
+
+The independent estimates are the realisations of a multi-output trial for trial-runner.h, output 0 for the
+poor nest and output 1 for the tail, so their mean, standard error, parallel runs and checkpoints are those of
+the other drivers. The time of a realisation is the # SSA events that it took.
+*/
+
+#ifndef RARE_EVENT_H
+#define RARE_EVENT_H
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "ssa-engine.h"
+#include "nest-models.h"
+#include "trial-runner.h"
+
+/* Direct-method SSA from x until keep_going(x) becomes false, no reaction can occur or the elapsed time t
+   reaches horizon; returns true in the last case. The waiting times are exponential, so the state at the
+   horizon is that after the last event before it. Generic (engine.propensities), for the short runs of the
+   splitting stages. */
+template <class Rng, class Cont>
+bool ssa_until(ssa_engine& e, int* x, Rng& rng, Cont keep_going, double horizon, double& t) {
+  const int nc = e.net.channels();
+  double a0, ra, dt;
+  int c;
+  t = 0.0;
+  while (keep_going(x)) {
+    a0 = e.propensities(x);
+    if (a0 <= 0.0) // absorbing state
+      return false;
+    dt = rng.exponential() / a0;
+    if (t + dt >= horizon) {
+      t = horizon;
+      return true;
+    }
+    t += dt;
+    ra = rng.uniform() * a0;
+    for (c=0 ; c<nc-1 && ra >= e.accum[c] ; c++)
+      ra -= e.accum[c];
+    x[e.net.from[c]]--;
+    x[e.net.to[c]]++;
+    e.events++;
+  }
+  return false;
+}
+
+/* Fixed-effort multilevel splitting over the states (n states of ns compartments each). advance(x, k) runs
+   state x through stage k and returns true if it reached level k; the states of stage k+1 are drawn uniformly
+   among those. Returns the product of the fractions, 0 if a stage has no successes. */
+template <class Rng, class Advance>
+double split_fixed_effort(std::vector<int>& states, int ns, int stages, Rng& rng, Advance advance) {
+  const int n = (int)states.size() / ns;
+  std::vector<int> reached;
+  double p = 1.0;
+  int i, k, m, r;
+  for (k=0 ; k<stages ; k++) {
+    reached.clear();
+    for (i=0 ; i<n ; i++)
+      if (advance(&states[i*ns], k))
+	reached.insert(reached.end(), states.begin() + i*ns, states.begin() + (i+1)*ns);
+    m = (int)reached.size() / ns;
+    if (m == 0)
+      return 0.0;
+    p *= (double)m / n;
+    if (k == stages-1)
+      break;
+    for (i=0 ; i<n ; i++) {
+      r = std::min((int)(rng.uniform() * m), m-1);
+      std::copy(reached.begin() + r*ns, reached.begin() + (r+1)*ns, states.begin() + i*ns);
+    }
+  }
+  return p;
+}
+
+// the L/H model stops as lh_running, and also when the poor nest reaches level
+struct lh_level_running {
+  lh_running running;
+  int level;
+  lh_level_running(const lh_running& running_, int level_) : running(running_), level(level_) {}
+  bool operator()(const int* x) const { return running(x) && lh_poor(x) < level; }
+};
+
+/* One splitting estimate of each probability (see the header), a multi-output trial for trial-runner.h: output 0
+   has score = estimate of P(the poor nest reaches the quorum first), output 1 (if tail > 0) that of P(T > tail).
+   levels: # poor-nest levels, evenly spaced from the initial poor-nest population to the quorum (0: one per ant,
+   at most 20); tail_levels: # time levels, evenly spaced up to tail. */
+struct lh_rare_trial {
+  ssa_engine engine;
+  lh_running running;
+  std::vector<int> levels;
+  std::vector<double> times;
+  std::vector<int> states;
+  int effort;
+  double H, z;
+  int Na;
+
+  lh_rare_trial(const ssa_network& net, double H_, double z_, int Na_, int th_quorum, int effort_, int nlevels,
+		double tail, int tail_levels)
+    : engine(net, SSA_LINEAR), running(Na_, th_quorum), effort(effort_), H(H_), z(z_), Na(Na_) {
+    int x[LH_COMPARTMENTS], k;
+    lh_init(x, H, z, Na);
+    int poor0 = lh_poor(x);
+    if (nlevels <= 0)
+      nlevels = std::min(th_quorum - poor0, 20);
+    nlevels = std::max(1, std::min(nlevels, th_quorum - poor0));
+    for (k=1 ; k<=nlevels ; k++)
+      levels.push_back(poor0 + (int)ceil((double)k * (th_quorum - poor0) / nlevels - 1e-9));
+    if (tail > 0.0)
+      for (k=1 ; k<=tail_levels ; k++)
+	times.push_back(tail * k / tail_levels);
+  }
+
+  int outputs() const { return times.empty()? 1 : 2; }
+
+  void init() {
+    states.resize(effort * LH_COMPARTMENTS);
+    for (int i=0 ; i<effort ; i++)
+      lh_init(&states[i*LH_COMPARTMENTS], H, z, Na);
+  }
+
+  template <class Rng>
+  void operator()(Rng& rng, trial_outcome* out) {
+    double t;
+    engine.events = 0;
+    init();
+    auto to_level = [&](int* x, int k) {
+      ssa_until(engine, x, rng, lh_level_running(running, levels[k]), std::numeric_limits<double>::infinity(), t);
+      return lh_poor(x) >= levels[k];
+    };
+    out[0].score = split_fixed_effort(states, LH_COMPARTMENTS, (int)levels.size(), rng, to_level);
+    out[0].t = (double)engine.events;
+    out[0].accepted = true;
+    if (times.empty())
+      return;
+    engine.events = 0;
+    init();
+    auto to_time = [&](int* x, int k) { return ssa_until(engine, x, rng, running, times[k] - ((k > 0)? times[k-1] : 0.0), t); };
+    out[1].score = split_fixed_effort(states, LH_COMPARTMENTS, (int)times.size(), rng, to_time);
+    out[1].t = (double)engine.events;
+    out[1].accepted = true;
+  }
+};
+
+#endif // RARE_EVENT_H
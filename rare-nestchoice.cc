@@ -0,0 +1,116 @@
+/* Rare-event estimates for the L/H model of finite-nestchoice.cc: the probability that the poor nest reaches
+the quorum first (the wrong decision) and the tail of the time to quorum, by fixed-effort multilevel splitting
+(see rare-event.h), for the corners of the parameter space where they are too small for brute force.
+
+Usage:
+        a.out alpha alpha_s H z threshold Na [effort=100] [levels=0] [tail=<t>] [tail_levels=10]
+
+The arguments are those of finite-nestchoice.cc, and can be given as lists or ranges (see sweep.h), one output
+line per grid point:
+        H alpha_s z threshold <P(poor nest first)> <standard error> [<P(T > tail)> <standard error>] <events per estimate>
+Each of the trials= (1000 by default) independent estimates runs effort= trajectories per level; levels= is
+the # levels of the poor-nest population (0: one per ant up to 20), and tail=<t> adds the estimate of
+P(the trial has not stopped by t) with tail_levels= time levels. For example,
+        a.out 0.1 0.1 0.2 0.3 0.5 100
+gives 1 - precision of Figure 4 at H=0.2 (about 0.11, up to the discarded trials), and
+        a.out 0.1 0.1 0.4 0.3 0.5 200 tail=25
+a wrong decision of about 3e-5 and P(T > 25) of about 4e-4 (the mean time is 12), which brute force would
+need ~10^7 trials to resolve. The optional arguments threads=, seed=, alpha_leak=, tol= batch=,
+checkpoint=<file>, shard=i/N, cache=<dir>, daemon= and
+connect= are those of finite-nestchoice.cc (tol= is the half-width of the CI of
+P(poor nest first)); the trajectories always run on the exact SSA.
+*/
+
+#include <iostream>
+using namespace std;
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include "options.h"
+#include "sweep.h"
+#include "nest-models.h"
+#include "trial-runner.h"
+#include "checkpoint.h"
+#include "result-cache.h"
+#include "sweep-daemon.h"
+#include "rare-event.h"
+
+static int rare_nestchoice(int argc, char **argv) {
+
+  options opt(argc, argv);
+  if (opt.npos() != 6) {
+    cerr << "rare-nestchoice.out alpha alpha_s H z threshold Na [effort=100] [levels=0] [tail=<t>] [tail_levels=10]" << endl;
+    cerr << "alpha alpha_s H z threshold Na: as finite-nestchoice.out" << endl;
+    cerr << "effort: # trajectories per level; levels: # levels of the poor-nest population (0: automatic)" << endl;
+    cerr << "tail: also estimate P(time to quorum > tail), with tail_levels time levels" << endl;
+    cerr << "optional: trials=1000 (# independent estimates) threads=#cores seed=random alpha_leak=0.05 tol= batch=1000" << endl;
+    exit(8);
+  }
+
+  unsigned long seed = sweep_seed(opt); // seed=, or that of the checkpoint file
+  cerr << "seed = " << seed << endl;
+  double alpha_leak = opt.get("alpha_leak", 0.05);
+  cerr << "leak rate = " << alpha_leak << endl;
+  int effort = (int)opt.get_long("effort", 100);
+  int nlevels = (int)opt.get_long("levels", 0);
+  double tail = opt.get("tail", 0.0);
+  int tail_levels = (int)opt.get_long("tail_levels", 10);
+  if (effort < 1 || tail_levels < 1) {
+    cerr << "effort and tail_levels must be positive" << endl;
+    exit(8);
+  }
+  if (opt.has("method") && opt.method() != SSA_AUTO) {
+    cerr << "the splitting estimators run on the exact SSA only" << endl;
+    exit(8);
+  }
+
+  grid g;
+  for (int i=0 ; i<6 ; i++)
+    g.add(opt.pos[i]);
+  long npoints = g.size();
+  long p;
+
+  vector<ssa_network> nets;
+  for (p=0 ; p<npoints ; p++) {
+    vector<double> v = g.point(p);
+    nets.push_back(lh_network(v[0], v[1], alpha_leak, (int)v[5]));
+  }
+
+  stop_rule rule(opt.get_long("batch", 1000), opt.get("tol", 0.0), 0.0, false);
+  sweep_checkpoint* ckpt = sweep_checkpoint_from(opt, "rare-nestchoice", seed, npoints, rule);
+  result_cache* cache = result_cache_from(opt, "rare-nestchoice", seed, g, opt.get_long("trials", 1000));
+  chunk_store* store = (ckpt != NULL)? (chunk_store*)ckpt : cache;
+
+  auto make_trial = [&](long p) {
+    vector<double> v = g.point(p);
+    int Na = (int)v[5];
+    return lh_rare_trial(nets[p], v[2], v[3], Na, quorum_ants(v[4], Na), effort, nlevels, tail, tail_levels);
+  };
+  auto emit = [&](long p, const vector<trial_sums>& sums) {
+    vector<double> v = g.point(p);
+    double events = 0.0;
+    cout << v[2] << " " << v[1] << " " << v[3] << " " << v[4];
+    for (size_t k=0 ; k<sums.size() ; k++) {
+      cout << " " << sums[k].s_ave() << " " << sums[k].s_std() / sqrt((double)sums[k].n);
+      events += sums[k].t_ave();
+    }
+    cout << " " << events;
+    if (rule.adaptive())
+      cout << " " << sums[0].n;
+    cout << endl;
+  };
+  run_sweep_outputs(make_trial, npoints, opt.get_long("trials", 1000), seed, opt.threads(), emit, rule, 1, store);
+
+  if (ckpt != NULL && ckpt->sharded())
+    cerr << "shard " << opt.get_str("shard", "") << ": " << ckpt->written << " chunks written to " << opt.get_str("checkpoint", "") << endl;
+  delete ckpt;
+  if (cache != NULL)
+    cerr << cache->hits << " chunks from the cache " << opt.get_str("cache", "") << ", " << cache->simulated << " simulated" << endl;
+  delete cache;
+  ssa_profile_report("rare-nestchoice"); // with -DSSA_PROFILE (see ssa-profile.h)
+  return 0;
+}
+
+int main (int argc, char **argv) {
+  return sweep_main(argc, argv, rare_nestchoice, "rare-nestchoice.out"); // daemon=, connect= (see sweep-daemon.h)
+}
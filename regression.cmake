@@ -0,0 +1,72 @@
+# Fixed-seed regression checks, run by "cmake --build <dir> --target regression" and by ctest (see CMakeLists.txt).
+#
+# Every check below runs two commands of the drivers with the same seed and requires their outputs to be
+# identical: the same results reached by two routes (an engine and the exact SSA at points where the answer
+# does not depend on the random numbers, a grid given as a range and as a list, a point from the cache). Prints one line per check,
+#     <check> PASS|FAIL
+# and fails if a check failed.
+#
+#     cmake -DBIN_DIR=<dir of the executables> [-DCHECKS=<names>] -P regression.cmake
+#
+# CHECKS is a ;-separated list of names (all by default).
+
+cmake_minimum_required(VERSION 3.13)
+
+if(NOT BIN_DIR)
+  message(FATAL_ERROR "usage: cmake -DBIN_DIR=<dir of the executables> -P regression.cmake")
+endif()
+set(SEED 5)
+set(WORK_DIR ${BIN_DIR}/regression)
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+# name|driver|arguments A|arguments B: the outputs of A and B must be identical; @WORK_DIR@ is the directory of the checks
+set(checks
+  # trials that start at the quorum (z=0.9 > threshold) or with 90% of the ants out of the old nest stop at t=0
+  "ensemble-stopped-at-start|finite-nestchoice|0.1 0.1 0.2 0.9 0.4 100 method=exact|0.1 0.1 0.2 0.9 0.4 100 method=ensemble"
+  "ensemble-stopped-at-start-nnest|cohesion-tradeoff|0.1 0.95 100 2 method=exact|0.1 0.95 100 2 method=ensemble"
+  # a grid given as ranges is the grid of the same values given as lists (the quorum thresholds of Fig. S2)
+  "range-as-list|finite-nestchoice|0.1 0.1 0.2 0.1:0.4:0.1 0.02:0.4:0.02 100|0.1 0.1 0.2 0.1,0.2,0.3,0.4 0.02,0.04,0.06,0.08,0.1,0.12,0.14,0.16,0.18,0.2,0.22,0.24,0.26,0.28,0.3,0.32,0.34,0.36,0.38,0.4 100"
+  # with cache=, the chunks of a point are simulated with generators of its key, so B prints the rows of A only
+  # if its points hit the entries of A: a range-derived z=0.3 and a z=0.3 off in the last bit are the point 0.3
+  "cache-range-hits-list|finite-nestchoice|0.1 0.1 0.2 0.1,0.2,0.3 0.5 100 cache=@WORK_DIR@/cache|0.1 0.1 0.2 0.1:0.3:0.1 0.5 100 cache=@WORK_DIR@/cache"
+  "cache-last-bit|finite-nestchoice|0.1 0.1 0.2 0.3 0.5 100 cache=@WORK_DIR@/cache|0.1 0.1 0.2 0.30000000000000004 0.5 100 cache=@WORK_DIR@/cache")
+
+# runs driver with argv and the seed, writing the output to out
+function(run_check driver argv out)
+  execute_process(COMMAND ${BIN_DIR}/${driver}.out ${argv} trials=2000 seed=${SEED}
+    RESULT_VARIABLE rc OUTPUT_FILE ${out} ERROR_QUIET)
+  if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "${driver}.out ${argv} failed (${rc})")
+  endif()
+endfunction()
+
+set(failed_checks)
+foreach(c ${checks})
+  string(REPLACE "|" ";" fields "${c}")
+  list(GET fields 0 name)
+  list(GET fields 1 driver)
+  list(GET fields 2 args_a)
+  list(GET fields 3 args_b)
+  if(CHECKS AND NOT name IN_LIST CHECKS)
+    continue()
+  endif()
+  string(REPLACE "@WORK_DIR@" "${WORK_DIR}" args_a "${args_a}")
+  string(REPLACE "@WORK_DIR@" "${WORK_DIR}" args_b "${args_b}")
+  separate_arguments(argv_a UNIX_COMMAND "${args_a}")
+  separate_arguments(argv_b UNIX_COMMAND "${args_b}")
+  run_check(${driver} "${argv_a}" ${WORK_DIR}/${name}-a.txt)
+  run_check(${driver} "${argv_b}" ${WORK_DIR}/${name}-b.txt)
+  file(READ ${WORK_DIR}/${name}-a.txt a)
+  file(READ ${WORK_DIR}/${name}-b.txt b)
+  if(a STREQUAL b)
+    message("${name} PASS")
+  else()
+    message("${name} FAIL\n  ${driver}.out ${args_a}:\n${a}  ${driver}.out ${args_b}:\n${b}")
+    list(APPEND failed_checks ${name})
+  endif()
+endforeach()
+
+if(failed_checks)
+  message(FATAL_ERROR "regression checks failed: ${failed_checks}")
+endif()
@@ -0,0 +1,240 @@
+/* Content-addressed cache of the results of the sweep drivers, for interactive exploration and figure grids
+that revisit the same points.
+
+With
+        cache=<dir>
+the partial sums of every finished chunk of trials are kept in <dir>, one file per grid point, named by a
+64-bit key of what determines the trials of the point: the driver, the parameter values of the point (to 12
+significant digits, so that a value computed by a range and the same value written out share a key), the
+other options (except threads=, seed=, trials=, tol=, rtol=, batch= and those of the cache and checkpoints),
+the seed, ANT_CACHE_VERSION, the generator (SSA_RNG) and TRIAL_CHUNK. Chunk c of a point is simulated with
+the generator Rng::for_chunk(seed, key, c) instead of Rng::for_chunk(seed, p, c) (chunk_store::stream), so
+its trials do not depend on the position of the point in the grid: any later run with the same seed, in any
+grid containing the point, finds the chunk in the cache instead of simulating it, and a run with more
+trials= (or a tighter tol=) simulates only the chunks that are missing. The output is reduced from the
+chunks in order as always, so it is identical whether the chunks come from the cache or not, but it is not
+that of the same run without cache= (other generators). Without seed=, cache= uses seed=1, so that runs
+share their chunks by default.
+
+Files (<dir>/<key>.antc) are in the format of checkpoint.h, with the key as the signature, npoints = 1 and
+the # trials of the chunk in place of the point of a record, so that the last chunk of trials=150 (50 trials)
+is not mistaken for the full chunk of trials=1000. Processes running at the same time append to the files
+under flock(); a record cut short by a killed process is dropped. The cache only grows; remove <dir> (or
+files of it) to reclaim the space, and bump ANT_CACHE_VERSION when a change of the models or of the
+engines changes the trials of a given generator, so that stale results are never served.
+
+The per-trial outputs (output=, quantiles=, record=) need every realisation and are not cached; checkpoint=
+and shard= are the tools for a single long sweep. sweep-daemon.h keeps the index of a cache resident in a
+server process.
+*/
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/file.h> // flock
+#include <sys/stat.h>
+#include <dirent.h>
+#include "options.h"
+#include "sweep.h"
+#include "trial-runner.h"
+#include "checkpoint.h"
+
+#define ANT_CACHE_VERSION 3
+
+#define ANT_CACHE_STR(x) #x
+#define ANT_CACHE_XSTR(x) ANT_CACHE_STR(x)
+
+// chunks of the points of a cache directory: key -> (# trials, chunk) -> sums
+struct result_cache_index {
+  std::string dir;
+  std::map<uint64_t, std::map<std::pair<long, long>, std::vector<trial_sums> > > chunks;
+  std::map<uint64_t, long> loaded; // bytes of each file already read
+
+  result_cache_index(const std::string& dir_) : dir(dir_) {}
+
+  std::string path(uint64_t key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.antc", (unsigned long long)key);
+    return dir + name;
+  }
+
+  // (re)reads the file of key if it changed since it was last read
+  void load(uint64_t key) {
+    std::string f = path(key);
+    struct stat st;
+    if (stat(f.c_str(), &st) != 0 || (loaded.count(key) && loaded[key] == (long)st.st_size))
+      return;
+    checkpoint_header head;
+    long valid_bytes;
+    int version;
+    std::map<std::pair<long, long>, std::vector<trial_sums> > c;
+    if (!sweep_checkpoint::read(f.c_str(), head, c, valid_bytes, version) || head.signature != key) {
+      std::cerr << "ignoring " << f << ": not a cache file of this key" << std::endl;
+      return;
+    }
+    chunks[key].swap(c);
+    loaded[key] = (long)st.st_size;
+  }
+
+  // reads the new or changed files of the directory
+  void scan() {
+    DIR* d = opendir(dir.c_str());
+    struct dirent* e;
+    unsigned long long key;
+    char tail;
+    if (d == NULL)
+      return;
+    while ((e = readdir(d)) != NULL)
+      if (sscanf(e->d_name, "%16llx.ant%c", &key, &tail) == 2 && tail == 'c')
+	load((uint64_t)key);
+    closedir(d);
+  }
+
+  // appends a chunk to the file of key, creating it if needed
+  bool append(uint64_t key, unsigned long seed, long count, long c, const std::vector<trial_sums>& sums) {
+    std::string f = path(key);
+    FILE* g = fopen(f.c_str(), "ab");
+    if (g == NULL)
+      return false;
+    flock(fileno(g), LOCK_EX);
+    fseek(g, 0, SEEK_END);
+    long size = ftell(g);
+    if (size == 0) {
+      checkpoint_header head = {key, (uint64_t)seed, 1, 0};
+      sweep_checkpoint::write_header(g, head);
+    } else { // drop a record cut short by a killed process
+      checkpoint_header head;
+      long valid_bytes;
+      int version;
+      std::map<std::pair<long, long>, std::vector<trial_sums> > old;
+      if (sweep_checkpoint::read(f.c_str(), head, old, valid_bytes, version) && valid_bytes < size
+	  && ftruncate(fileno(g), valid_bytes) != 0) {
+	fclose(g);
+	return false;
+      }
+    }
+    sweep_checkpoint::write_record(g, count, c, sums);
+    fflush(g);
+    flock(fileno(g), LOCK_UN);
+    fclose(g);
+    return true;
+  }
+};
+
+// index of the resident cache of sweep-daemon.h, shared by the requests it serves
+static result_cache_index* resident_cache = NULL;
+
+struct result_cache : chunk_store {
+  result_cache_index* index;
+  bool own; // index is not the resident one
+  unsigned long seed;
+  long trials;
+  std::vector<uint64_t> keys; // of the grid points
+  long hits, simulated;
+  std::mutex mtx;
+
+  result_cache(const std::string& dir, unsigned long seed_, long trials_, const std::vector<uint64_t>& keys_)
+    : seed(seed_), trials(trials_), keys(keys_), hits(0), simulated(0) {
+    own = (resident_cache == NULL || resident_cache->dir != dir);
+    index = own? new result_cache_index(dir) : resident_cache;
+    mkdir(dir.c_str(), 0777);
+    struct stat st;
+    if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+      std::cerr << "cannot create the cache directory " << dir << std::endl;
+      exit(8);
+    }
+    for (size_t p=0 ; p<keys.size() ; p++)
+      index->load(keys[p]);
+  }
+
+  ~result_cache() {
+    if (own)
+      delete index;
+  }
+
+  bool sharded() const { return false; }
+  bool mine(long) const { return true; }
+  uint64_t stream(long p, long) const { return keys[p]; }
+
+  long count(long c) const { return (c+1)*TRIAL_CHUNK <= trials? TRIAL_CHUNK : trials - c*TRIAL_CHUNK; }
+
+  // copied, not moved: points of a grid with equal values share their key
+  bool restore(long p, long c, std::vector<trial_sums>& sums) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::map<uint64_t, std::map<std::pair<long, long>, std::vector<trial_sums> > >::const_iterator it = index->chunks.find(keys[p]);
+    if (it == index->chunks.end())
+      return false;
+    std::map<std::pair<long, long>, std::vector<trial_sums> >::const_iterator jt = it->second.find(std::make_pair(count(c), c));
+    if (jt == it->second.end())
+      return false;
+    sums = jt->second;
+    hits++;
+    return true;
+  }
+
+  void save(long p, long c, const std::vector<trial_sums>& sums) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!index->append(keys[p], seed, count(c), c, sums))
+      std::cerr << "cannot write " << index->path(keys[p]) << std::endl;
+    simulated++;
+  }
+};
+
+// key of grid point v of a driver: 64-bit FNV-1a hash of everything that determines its trials
+inline uint64_t result_cache_key(const options& opt, const char* driver, unsigned long seed, const std::vector<double>& v) {
+  static const char* const ignored[] = {"threads", "seed", "trials", "tol", "rtol", "batch", "cache", "checkpoint", "shard", "connect", "daemon"};
+  std::string s(driver);
+  char buf[64];
+  uint64_t h = 14695981039346656037ULL;
+  size_t i, k;
+  for (i=0 ; i<v.size() ; i++) { // 12 significant digits, so that 0.30000000000000004 is the point 0.3
+    snprintf(buf, sizeof(buf), " %.12g", v[i]);
+    s += buf;
+  }
+  for (std::map<std::string, std::string>::const_iterator it=opt.kv.begin() ; it!=opt.kv.end() ; ++it) {
+    for (k=0 ; k<sizeof(ignored)/sizeof(ignored[0]) && it->first != ignored[k] ; k++)
+      ;
+    if (k == sizeof(ignored)/sizeof(ignored[0]))
+      s += " " + it->first + "=" + it->second;
+  }
+  snprintf(buf, sizeof(buf), " seed=%lu version=%d chunk=%d", seed, ANT_CACHE_VERSION, (int)TRIAL_CHUNK);
+  s += buf;
+  s += " rng=" ANT_CACHE_XSTR(SSA_RNG);
+  for (i=0 ; i<s.size() ; i++)
+    h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+  return h;
+}
+
+// cache of the option cache=<dir> for the given parameter values of the points, NULL without it
+inline result_cache* result_cache_from(const options& opt, const char* driver, unsigned long seed,
+				       const std::vector<std::vector<double> >& points, long trials) {
+  if (!opt.has("cache"))
+    return NULL;
+  if (opt.has("checkpoint") || opt.has("shard") || opt.has("output") || opt.get_long("quantiles", 0) != 0 || opt.has("record")) {
+    std::cerr << "cache= is not available with checkpoint=, shard=, output=, quantiles= and record=" << std::endl;
+    exit(8);
+  }
+  std::vector<uint64_t> keys(points.size());
+  for (size_t p=0 ; p<points.size() ; p++)
+    keys[p] = result_cache_key(opt, driver, seed, points[p]);
+  return new result_cache(opt.get_str("cache", ""), seed, trials, keys);
+}
+
+// cache of the option cache=<dir> for the points of grid g, NULL without it
+inline result_cache* result_cache_from(const options& opt, const char* driver, unsigned long seed, const grid& g, long trials) {
+  std::vector<std::vector<double> > points(opt.has("cache")? g.size() : 0);
+  for (size_t p=0 ; p<points.size() ; p++)
+    points[p] = g.point((long)p);
+  return result_cache_from(opt, driver, seed, points, trials);
+}
+
+#endif // RESULT_CACHE_H
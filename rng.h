@@ -0,0 +1,203 @@
+/* Random number generators for the simulation engines.
+
+A generator provides
+    double uniform()            deviate in (0,1)
+    uint64_t bits()             64 random bits
+    double exponential()        exponential deviate with mean 1
+    void fill(double* u, int n) n uniform deviates
+    static G for_chunk(seed, point, chunk)
+                                the generator of chunk "chunk" of the trials at grid point "point"
+
+mt_stream is the Mersenne Twister of mt19937ar.c, with exponential() = -log(uniform()) so that the engines
+reproduce the original codes. xoshiro_stream (xoshiro256++, Blackman and Vigna) is about twice as fast and
+samples exponential deviates by the ziggurat method. The drivers use SSA_RNG, selected at compile time:
+        g++ -DSSA_RNG=xoshiro_stream ...
+*/
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+#include <cmath>
+#include <random>
+
+// splitmix64 finaliser, used to derive independent seeds
+inline uint64_t mix64(uint64_t z) {
+  z += 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// seed of the generator used for chunk "chunk" of the trials at grid point "point"; 64 bits, since among
+// the 10^5-10^6 chunks of a large sweep, 32-bit seeds would give some pairs of chunks the same stream
+inline uint64_t stream_seed(uint64_t seed, uint64_t point, uint64_t chunk) {
+  return mix64(mix64(mix64(seed) ^ point) ^ chunk);
+}
+
+// tables of the 256-layer ziggurat for the exponential distribution (Marsaglia and Tsang, J. Stat. Softw. 5(8), 2000).
+// Layer i >= 1 is the rectangle [0, x[i]) x [f[i], f[i+1]), f = exp(-x); layer 0 is [0, x[0]) x [0, f[1]),
+// whose part beyond x[1] = r stands for the tail.
+struct exp_ziggurat_tables {
+  double x[257], f[257];
+  exp_ziggurat_tables() {
+    const double r = 7.69711747013104972, v = 3.949659822581572e-3; // v = area of each layer
+    x[0] = v * exp(r);
+    x[1] = r;
+    for (int i=2 ; i<256 ; i++)
+      x[i] = -log(v/x[i-1] + exp(-x[i-1]));
+    x[256] = 0.0;
+    for (int i=0 ; i<257 ; i++)
+      f[i] = exp(-x[i]);
+  }
+};
+
+inline const exp_ziggurat_tables& exp_ziggurat() {
+  static const exp_ziggurat_tables tab;
+  return tab;
+}
+
+template <class Rng>
+double exponential_ziggurat(Rng& rng) {
+  const exp_ziggurat_tables& z = exp_ziggurat();
+  uint64_t b;
+  int i;
+  double x;
+  while (true) {
+    b = rng.bits();
+    i = (int)(b & 0xff);
+    x = ((b >> 11) + 0.5) * (1.0/9007199254740992.0) * z.x[i];
+    if (x < z.x[i+1]) // inside the rectangle below the curve
+      return x;
+    if (i == 0) // tail
+      return z.x[1] - log(rng.uniform());
+    if (z.f[i] + rng.uniform() * (z.f[i+1] - z.f[i]) < exp(-x)) // wedge
+      return x;
+  }
+}
+
+// Mersenne Twister with its own state. std::mt19937 seeded with s produces the same
+// stream as genrand_int32() of mt19937ar.c after init_genrand(s); the chunks are seeded
+// with both words of their 64-bit seed through std::seed_seq.
+struct mt_stream {
+  std::mt19937 mt;
+  mt_stream(uint32_t seed) : mt(seed) {}
+  mt_stream(std::seed_seq& seq) : mt(seq) {}
+  static mt_stream for_chunk(uint64_t seed, uint64_t point, uint64_t chunk) {
+    uint64_t s = stream_seed(seed, point, chunk);
+    std::seed_seq seq{(uint32_t)s, (uint32_t)(s >> 32)};
+    return mt_stream(seq);
+  }
+  double uniform() { return (mt()+0.5)/4294967296.0; }
+  uint64_t bits() {
+    uint64_t hi = mt();
+    return (hi << 32) | mt();
+  }
+  double exponential() { return -log(uniform()); }
+  void fill(double* u, int n) {
+    for (int i=0 ; i<n ; i++)
+      u[i] = uniform();
+  }
+};
+
+// xoshiro256++ with state seeded by splitmix64
+struct xoshiro_stream {
+  uint64_t s[4];
+
+  xoshiro_stream(uint64_t seed) {
+    for (int i=0 ; i<4 ; i++)
+      s[i] = mix64(seed + i*0x9e3779b97f4a7c15ULL);
+  }
+  static xoshiro_stream for_chunk(uint64_t seed, uint64_t point, uint64_t chunk) {
+    return xoshiro_stream(stream_seed(seed, point, chunk));
+  }
+
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+  uint64_t bits() {
+    const uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+    const uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+  }
+  double uniform() { return ((bits() >> 11) + 0.5) * (1.0/9007199254740992.0); }
+  double exponential() { return exponential_ziggurat(*this); }
+  void fill(double* u, int n) {
+    for (int i=0 ; i<n ; i++)
+      u[i] = uniform();
+  }
+
+  // advances by 2^128 draws, giving a non-overlapping stream
+  void jump() {
+    static const uint64_t J[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+    uint64_t t[4] = {0, 0, 0, 0};
+    for (int i=0 ; i<4 ; i++)
+      for (int b=0 ; b<64 ; b++) {
+	if (J[i] & (1ULL << b))
+	  for (int j=0 ; j<4 ; j++)
+	    t[j] ^= s[j];
+	bits();
+      }
+    for (int j=0 ; j<4 ; j++)
+      s[j] = t[j];
+  }
+};
+
+#ifndef SSA_RNG
+#define SSA_RNG mt_stream
+#endif
+
+// log(k!) from a table for k < 10 and the Stirling series otherwise (error < 1e-12), as in the reference
+// implementation of PTRS; unlike lgamma, it writes no global (signgam) and is safe in the worker threads
+inline double log_factorial(long k) {
+  static const double table[10] = {0.0, 0.0, 0.69314718055994531, 1.791759469228055, 3.1780538303479458,
+				   4.7874917427820458, 6.5792512120101012, 8.5251613610654147, 10.604602902745251,
+				   12.801827480081469};
+  if (k < 10)
+    return table[k];
+  double n = (double)k, r = 1.0/n, r2 = r*r;
+  return (n + 0.5)*log(n) - n + 0.91893853320467274 + r*(1.0/12 - r2*(1.0/360 - r2*(1.0/1260 - r2/1680)));
+}
+
+// Poisson deviate with the given mean: multiplication method for small means,
+// transformed rejection (PTRS, Hormann 1993) otherwise
+template <class Rng>
+long poisson(Rng& rng, double mean) {
+  if (mean <= 0.0)
+    return 0;
+  if (mean < 10.0) {
+    double L = exp(-mean), p = 1.0;
+    long k = -1;
+    do {
+      k++;
+      p *= rng.uniform();
+    } while (p > L);
+    return k;
+  }
+  double slam = sqrt(mean), loglam = log(mean);
+  double b = 0.931 + 2.53*slam;
+  double a = -0.059 + 0.02483*b;
+  double invalpha = 1.1239 + 1.1328/(b-3.4);
+  double vr = 0.9277 - 3.6224/(b-2);
+  double U, V, us;
+  long k;
+  while (true) {
+    U = rng.uniform() - 0.5;
+    V = rng.uniform();
+    us = 0.5 - fabs(U);
+    k = (long)floor((2*a/us + b)*U + mean + 0.43);
+    if (us >= 0.07 && V <= vr)
+      return k;
+    if (k < 0 || (us < 0.013 && V > us))
+      continue;
+    if (log(V) + log(invalpha) - log(a/(us*us) + b) <= -mean + k*loglam - log_factorial(k))
+      return k;
+  }
+}
+
+#endif // RNG_H
@@ -1,106 +1,126 @@
 /* Speed-accuracy trade-off: Pearson correlation coefficient between the time to quorum and the accuracy when one parameter is varied.
 
-Mersenne Twister pseudo-random number generator code mt19937ar.c is needed. 
-One can download mt19937ar.c from various websites.
-One needs to correct the folder's name in
-    #include "../lib/stat/mt19937ar.c"
-below to your local folder's name.
-
-In the following, p={a,b,c} means that one needs to run the code with parameter p=a, p=b, and p=c, and collect results.
+The value of alpha_s (to_vary=0, 1, 3) or z (to_vary=2) is given by the optional argument
+        alpha_s=1 or z=0.3
+which accepts a list of values (see sweep.h). For a list, one block of output is produced per value,
+blocks being separated by two blank lines.
+
+Trials run in parallel on all cores (see trial-runner.h), and all points of all blocks are scheduled
+in one pool of threads. The optional arguments
+        trials=10000 threads=#cores seed=random
+set the number of trials per point, the number of threads and the seed. The output depends only on the seed.
+alpha_leak=0.05 sets the rate at which ants leak back to the old nest.
+
+Adaptive mode: with the optional arguments
+        tol=<x> rtol=<y> batch=1000
+the trials of each point are run in batches of "batch" trials until the 95% confidence interval (Wilson interval)
+of the precision has half-width <= x and that of the mean time to quorum has half-width <= y times the mean.
+trials= is then the maximum # trials per point, and the total # trials used for the correlation
+coefficient is appended to each line.
+
+Faster sweeps: with the optional argument
+        single_pass=1
+the quorum thresholds of a point share their trajectories: each trajectory is simulated once up to the
+largest threshold, and the time and outcome are recorded as each smaller threshold is passed, which gives
+the results of all thresholds for the cost of the largest one. With
+        crn=1
+the points that differ only in the varied parameter (H, z or alpha_s) use common random numbers, so that the
+correlation coefficient across them is less noisy. With single_pass=1 and to_vary=3, the varied parameter is
+the threshold, whose values then share their trajectories anyway. Both options change the random numbers,
+not the distribution of the results.
 
 Produce the results shown in Figure 6 by running
-        a.out speed-accuracy-coef.out 0
-        Note: We need to run this code three times and collect the results by setting alpha_s={0.01,0.1,1} within the first "if (to_vary==0)" loop
+        a.out 0 alpha_s=0.01,0.1,1
 
 Produce the results shown in Figure 8 by running
-        a.out speed-accuracy-coef.out 1
-        Note: We need to run this code three times and collect the results by setting alpha_s={0.01,0.1,1} within the first "if (to_vary==0)" loop
+        a.out 1 alpha_s=0.01,0.1,1
 
 Produce the results shown in Figure S1 by running
 
-        a.out speed-accuracy-coef.out 0
-        Note: We need to run this code three times and collect the results by setting alpha_s={0.01,0.1,1} within the first "if (to_vary==0)" loop and setting alpha_leak=0
-
-        a.out speed-accuracy-coef.out 1
-        Note: We need to run this code three times and collect the results by setting alpha_s={0.01,0.1,1} within the first "if (to_vary==1)" loop and setting alpha_leak=0
-
-        a.out speed-accuracy-coef.out 3
-        Note: We need to run this code three times and collect the results by setting alpha_s={0.01,0.1,1} within the first "if (to_vary==3)" loop and setting alpha_leak=0
-
-        a.out speed-accuracy-coef.out 2
-        Note: We need to run this code three times and collect the results by setting z={0.1,0.3} within the first "if (to_vary==2)" loop and setting alpha_leak=0
+        a.out 0 alpha_s=0.01,0.1,1 alpha_leak=0
+        a.out 1 alpha_s=0.01,0.1,1 alpha_leak=0
+        a.out 3 alpha_s=0.01,0.1,1 alpha_leak=0
+        a.out 2 z=0.1,0.3 alpha_leak=0
 
 Produce the results shown in Figure S3 by running
-        a.out speed-accuracy-coef.out 3
-        Note: We need to run this code three times and collect the results by setting alpha_s={0.01,0.1,1} within the first "if (to_vary==3)" loop
+        a.out 3 alpha_s=0.01,0.1,1
 
 Produce the results shown in Figure S5 by running
-        a.out speed-accuracy-coef.out 2
-        Note: We need to run this code three times and collect the results by setting z={0.1,0.3} within the first "if (to_vary==2)" loop
+        a.out 2 z=0.1,0.3
+
+Long sweeps: checkpoint=<file> saves every finished chunk of trials to <file> and resumes from it when it exists,
+and shard=i/N checkpoint=<file> seed=<seed> runs the i-th of N slices of the sweep, e.g., on a cluster;
+sweep-merge.cc merges the files of the shards (see checkpoint.h).
 
+Result cache: cache=<dir> keeps the partial sums of every chunk of trials in <dir>, keyed by the parameter values
+of the point (alpha, alpha_s, H, z and the quorum threshold) rather than by its position, so that a point is
+simulated once whatever block and figure it appears in; Figs. 8 and S3, for instance, cover the same points
+(see result-cache.h). It is not available with single_pass=1 and crn=1, whose
+chunks are shared by several points.
 */
 #include <iostream>
 using namespace std;
 #include <fstream>
 #include <cstdlib> // atoi
 #include <cmath> // cos, sin
-#include "../lib/stat/mt19937ar.c"
 #include <ctime>
+#include <vector>
+#include "options.h"
+#include "sweep.h"
+#include "nest-models.h"
+#include "trial-runner.h"
+#include "checkpoint.h"
+#include "result-cache.h"
+
+// Pearson correlation coefficient between x and y
+static double corr_coef(const double* x, const double* y, int samples) {
+  int i, ind;
+  double tmp[5];
+  for (i=0 ; i<5 ; i++) tmp[i] = 0.0;
+  for (ind=0 ; ind < samples ; ind++) {
+    tmp[0] += x[ind];
+    tmp[1] += y[ind];
+    tmp[2] += x[ind] * x[ind];
+    tmp[3] += y[ind] * y[ind];
+    tmp[4] += x[ind] * y[ind];
+  }
+  tmp[0] /= samples;
+  tmp[1] /= samples;
+  return (tmp[4]/samples - tmp[0]*tmp[1]) / sqrt(tmp[2]/samples - tmp[0]*tmp[0]) / sqrt(tmp[3]/samples - tmp[1]*tmp[1]);
+}
 
 int main (int argc, char **argv) {
 
-  if (argc != 2) {
-    cerr << "speed-accuracy-coef.out to_vary" << endl;
+  options opt(argc, argv);
+  if (opt.npos() != 1) {
+    cerr << "speed-accuracy-coef.out to_vary [alpha_s=1] [z=0.3]" << endl;
     cerr << "to_vary is the parameter to vary. 0: H, 1: z, 2: alpha_s, 3: quorum threshold" << endl;
+    usage_common_options();
     exit(8);
   }
 
-  init_genrand(time(NULL));
+  unsigned long seed = sweep_seed(opt); // seed=, or that of the checkpoint file
+  cerr << "seed = " << seed << endl;
   int Na = 100; // # ants
-  int to_vary = atoi(argv[1]); // vary H if to_vary=0, vary z if to_vary=1, vary alpha_s if to_vary=2
-  double alpha_s; // rate at which high-threshold ants visiting the poor nest move to the good nest
-  double z; // initial fraction of recruiters
-  double H; // fraction of high-threshold ants
+  int to_vary = atoi(opt.pos[0]); // vary H if to_vary=0, vary z if to_vary=1, vary alpha_s if to_vary=2
+  vector<double> fixed; // alpha_s (to_vary=0, 1, 3) or z (to_vary=2), one block of output per value
   int samples; // # values for the varied var
   if (to_vary==0) { // vary H
-    z = 0.3;
-    alpha_s = 1; // alpha_s = 0.01, 0.1, 1
+    fixed = parse_values(opt.get_str("alpha_s", "1").c_str()); // alpha_s = 0.01, 0.1, 1
     samples = 6;
-    cerr << "alpha_s = " << alpha_s << endl;
   } else if (to_vary==1) { // vary z
-    H = 0.2;
-    alpha_s = 1; // alpha_s = 0.01, 0.1, 1
+    fixed = parse_values(opt.get_str("alpha_s", "1").c_str()); // alpha_s = 0.01, 0.1, 1
     samples = 4;
-    cerr << "alpha_s = " << alpha_s << endl;
   } else if (to_vary==2) { // vary alpha_s
-    H = 0.2;
-    z = 0.3; // z = 0.1 or 0.3
+    fixed = parse_values(opt.get_str("z", "0.3").c_str()); // z = 0.1 or 0.3
     samples = 6;
   } else if (to_vary==3) { // vary quorum threshold
-    H = 0.2;
-    alpha_s = 1; // alpha_s = 0.01, 0.1, 1
+    fixed = parse_values(opt.get_str("alpha_s", "1").c_str()); // alpha_s = 0.01, 0.1, 1
     samples = 6; // quorum threshold = 0.25, 0.3, 0.35, 0.4, 0.45, 0.5
   } else {
-    cerr << "to_vary must be 0, 1, or 2" << endl;
+    cerr << "to_vary must be 0, 1, 2, or 3" << endl;
     exit(8);
   }
-  double L = 1-H; // fraction of low-threshold ants
-
-  int tmp_sum;
-  double corr; // Pearson correlation coefficient
-  double tmp[5];
-
-  double th_quorum_frac;
-  int th_quorum; // quorum threshold
-  double t;
-  
-  int i;
-  double accum_rate[15], ra;
-
-  int trials = 10000;
-  int tr;
-
-  int L_oldnest, H_oldnest, L_poor_com, L_poor_rec, H_poor_vis, L_good_com, H_good_com, L_good_rec, H_good_rec;
 
   int samples_alpha = 15;
   int samples_y;
@@ -108,161 +128,164 @@ int main (int argc, char **argv) {
     samples_y = 6; // vary quorum threshold on the y-axis
   else
     samples_y = 4; // vary z on the y-axis
-  int ind, ind_alpha, ind_y;
-  double alpha, alpha_g, alpha_p; // conversion rate from committed to recruit
-  double alpha_leak = 0.05; // = 0.0 in Fig. S1
-  double t_quorum[samples];
-  double precision[samples]; // % correct collective decision
-
-  for (ind_alpha = -1 ; ind_alpha < samples_alpha ; ind_alpha++) { // -1: dummy
-    alpha = 0.1 * (ind_alpha+1);
-    alpha_g = alpha;
-    alpha_p = alpha;
-    for (ind_y = -1 ; ind_y < samples_y ; ind_y++) { // -1: dummy
-      if (to_vary==0 || to_vary==1 || to_vary==2) {
-	th_quorum_frac = 0.25 + 0.05 * ind_y;
-	th_quorum = (int)(th_quorum_frac*Na); // quorum threshold
-      } else { // to_vary==3
-	z = 0.1*(ind_y+1);
-      }
-
-      if (ind_alpha == -1 || ind_y == -1) { // dummy
-	corr = -10.0;
-      } else { // really calculate the corr coef
+  double alpha_leak = opt.get("alpha_leak", 0.05); // = 0.0 in Fig. S1
+  // the quorum threshold is the y-axis (to_vary=0, 1, 2) or the varied parameter (to_vary=3)
+  int samples_th = (to_vary < 3)? samples_y : samples;
+  bool single_pass = opt.get_long("single_pass", 0) != 0;
+  bool crn = opt.get_long("crn", 0) != 0;
+  int method = opt.method();
+
+  // tables of the current (alpha_s or z, alpha) block
+  vector<vector<double> > t_quorum(samples_y, vector<double>(samples));
+  vector<vector<double> > precision(samples_y, vector<double>(samples)); // % correct collective decision
+  vector<long> trials_used(samples_y);
+  int block_done = 0;
+
+  /* grid point p = ((ind_fixed*samples_alpha + ind_alpha)*samples_y + ind_y)*samples + ind
+     With single_pass, the threshold index is dropped from p and becomes the output index of a multi-output trial:
+     p = (ind_fixed*samples_alpha + ind_alpha)*samples + ind (to_vary=0, 1, 2) or
+     p = (ind_fixed*samples_alpha + ind_alpha)*samples_y + ind_y (to_vary=3). */
+  long npoints = (long)fixed.size()*samples_alpha*samples_y*samples / (single_pass? samples_th : 1);
+  long p;
+  int x[LH_COMPARTMENTS];
+  int tmp_sum;
 
-  for (ind = 0 ; ind < samples ; ind++) {
+  struct point {
+    double alpha; // conversion rate from committed to recruit
+    double alpha_s; // rate at which high-threshold ants visiting the poor nest move to the good nest
+    double z; // initial fraction of recruiters
+    double H; // fraction of high-threshold ants
+    double th_quorum_frac;
+    int ind, ind_y, ind_alpha, ind_fixed;
+  };
+  // parameters of the full grid; in single-pass mode, the threshold index is ind_th
+  auto point_of = [&](long p, int ind_th) {
+    point q;
+    if (single_pass && to_vary < 3)
+      p = (p / samples * samples_y + ind_th) * samples + p % samples;
+    else if (single_pass)
+      p = p * samples + ind_th;
+    q.ind = p % samples;
+    q.ind_y = (p / samples) % samples_y;
+    q.ind_alpha = (p / samples / samples_y) % samples_alpha;
+    q.ind_fixed = p / samples / samples_y / samples_alpha;
+    q.alpha = 0.1 * (q.ind_alpha+1);
+    q.H = 0.2;
+    q.z = (to_vary==2)? fixed[q.ind_fixed] : 0.3;
+    q.alpha_s = (to_vary==2)? 0.0 : fixed[q.ind_fixed];
+    if (to_vary==0 || to_vary==1 || to_vary==2)
+      q.th_quorum_frac = 0.25 + 0.05 * q.ind_y;
+    else // to_vary==3
+      q.z = 0.1*(q.ind_y+1);
     if (to_vary==0)
-      H = (double)(ind+1)/15+1e-8;
+      q.H = (double)(q.ind+1)/15+1e-8;
     else if (to_vary==1)
-      z = 0.1*(ind+1);
+      q.z = 0.1*(q.ind+1);
     else if (to_vary==2)
-      alpha_s = 0.1 * ind;
-    else if (to_vary==3) {
-      th_quorum_frac = 0.25 + 0.05 * ind;
-      th_quorum = (int)(th_quorum_frac*Na); // quorum threshold
-    }
-
-    t_quorum[ind] = precision[ind] = 0.0;
-
-    tr = 0;
-    while (tr < trials) {
-    // initialization
-    t = 0.0;
-    H_oldnest = (int)(Na*H*(1-z)+1e-8);
-    L_oldnest = (int)(Na*(1-z)+1e-8) - H_oldnest;
-    H_poor_vis = H_good_com = (int)((Na*H*z+1e-8)/2);
-    L_poor_com = (int)((Na*z+1e-8)/2) - H_poor_vis;
-    L_good_com = (int)((Na*z+1e-8)/2) - H_good_com;
-    L_poor_rec = L_good_rec = H_good_rec = 0;
-    tmp_sum = H_oldnest + L_oldnest + H_poor_vis + L_poor_com + H_good_com + L_good_com;
-    if (tmp_sum < Na)
-      H_oldnest += Na - tmp_sum;
-    if (tr==0 && Na - tmp_sum > 0)
-      cerr << "Na - tmp_sum = " << Na - tmp_sum << "; " << H_oldnest << " " << L_oldnest << " " << H_poor_vis << " " << L_poor_com << " " << H_good_com << " " << L_good_com << endl;
-
-    while (L_oldnest + H_oldnest < Na && L_good_com + H_good_com + L_good_rec + H_good_rec < th_quorum && L_poor_com + L_poor_rec + H_poor_vis < th_quorum) {
-
-	accum_rate[0] = (double)L_poor_rec * L_oldnest / Na;
-      	accum_rate[1] = accum_rate[0] + (double)L_poor_rec * H_oldnest / Na;
-	accum_rate[2] = accum_rate[1] + (double)(L_good_rec + H_good_rec) * L_oldnest / Na;
-	accum_rate[3] = accum_rate[2] + (double)(L_good_rec + H_good_rec) * H_oldnest / Na;
-	accum_rate[4] = accum_rate[3] + alpha_p * L_poor_com; // commited -> recruiter
-	accum_rate[5] = accum_rate[4] + alpha_g * L_good_com;
-	accum_rate[6] = accum_rate[5] + alpha_g * H_good_com;
-	accum_rate[7] = accum_rate[6] + alpha_s * H_poor_vis;
-	accum_rate[8] = accum_rate[7] + alpha_leak * L_poor_com;
-	accum_rate[9] = accum_rate[8] + alpha_leak * H_poor_vis;
-	accum_rate[10] = accum_rate[9] + alpha_leak * L_poor_rec;
-	accum_rate[11] = accum_rate[10] + alpha_leak * L_good_com;
-	accum_rate[12] = accum_rate[11] + alpha_leak * H_good_com;
-	accum_rate[13] = accum_rate[12] + alpha_leak * L_good_rec;
-	accum_rate[14] = accum_rate[13] + alpha_leak * H_good_rec;
-
-	ra = (genrand_int32()+0.5)/4294967296.0 * accum_rate[14];
-
-	if (ra < accum_rate[0]) {
-	  L_oldnest--;
-	  L_poor_com++;
-	} else if (ra < accum_rate[1]) {
-	  H_oldnest--;
-	  H_poor_vis++;
-	} else if (ra < accum_rate[2]) {
-	  L_oldnest--;
-	  L_good_com++;
-	} else if (ra < accum_rate[3]) {
-	  H_oldnest--;
-	  H_good_com++;
-	} else if (ra < accum_rate[4]) {
-	  L_poor_com--;
-	  L_poor_rec++;
-	} else if (ra < accum_rate[5]) {
-	  L_good_com--;
-	  L_good_rec++;
-	} else if (ra < accum_rate[6]) {
-	  H_good_com--;
-	  H_good_rec++;
-	} else if (ra < accum_rate[7]) { 
-	  H_poor_vis--;
-	  H_good_com++;
-	} else if (ra < accum_rate[8]) { // leak
-	  L_poor_com--;
-	  L_oldnest++;
-	} else if (ra < accum_rate[9]) {
-	  H_poor_vis--;
-	  H_oldnest++;
-	} else if (ra < accum_rate[10]) {
-	  L_poor_rec--;
-	  L_oldnest++;
-	} else if (ra < accum_rate[11]) {
-	  L_good_com--;
-	  L_oldnest++;
-	} else if (ra < accum_rate[12]) {
-	  H_good_com--;
-	  H_oldnest++;
-	} else if (ra < accum_rate[13]) {
-	  L_good_rec--;
-	  L_oldnest++;
-	} else if (ra < accum_rate[14]) {
-	  H_good_rec--;
-	  H_oldnest++;
-	}
-	t += -1.0/accum_rate[14]*log((genrand_int32()+0.5)/4294967296.0);
-    } // dynamics done
-
-    if (L_oldnest + H_oldnest < Na) { // quorum reached in either new site
-      tr++;
-      t_quorum[ind] += t;
-      if (L_good_com + H_good_com + L_good_rec + H_good_rec == th_quorum)
-	precision[ind] += 1.0;
-    }
-    } // all trials done
-      
-      t_quorum[ind] /= trials;
-      precision[ind] /= trials;
-      //            cerr << z << " " << th_quorum_frac << " " << t_quorum[ind] << " " << precision[ind] << endl;
-  } // all samples necessary for calculating the corr coeff done
-
-  // calculate Pearson's correlation coefficient
-  for (i=0 ; i<5 ; i++) tmp[i] = 0.0;
-  for (ind=0 ; ind < samples ; ind++) {
-    tmp[0] += t_quorum[ind];
-    tmp[1] += precision[ind];
-    tmp[2] += t_quorum[ind] * t_quorum[ind];
-    tmp[3] += precision[ind] * precision[ind];
-    tmp[4] += t_quorum[ind] * precision[ind];
+      q.alpha_s = 0.1 * q.ind;
+    else if (to_vary==3)
+      q.th_quorum_frac = 0.25 + 0.05 * q.ind;
+    return q;
+  };
+
+  vector<ssa_network> nets;
+  for (p=0 ; p<npoints ; p++) {
+    point q = point_of(p, 0);
+    tmp_sum = lh_init(x, q.H, q.z, Na); // Na - # ants placed before the rounding correction
+    if (tmp_sum > 0 && q.ind_alpha == 0)
+      cerr << "Na - tmp_sum = " << tmp_sum << "; " << x[H_OLDNEST] << " " << x[L_OLDNEST] << " " << x[H_POOR_VIS] << " " << x[L_POOR_COM] << " " << x[H_GOOD_COM] << " " << x[L_GOOD_COM] << endl;
+    nets.push_back(lh_network(q.alpha, q.alpha_s, alpha_leak, Na));
   }
-  tmp[0] /= samples;
-  tmp[1] /= samples;
-  //  for (i=0 ; i<5 ; i++)
-  //    cerr << " " << tmp[i];
-  //  cerr << endl;
-  corr = (tmp[4]/samples - tmp[0]*tmp[1]) / sqrt(tmp[2]/samples - tmp[0]*tmp[0]) / sqrt(tmp[3]/samples - tmp[1]*tmp[1]);
-      }
 
-  cout << alpha << " " << ((to_vary < 3)? th_quorum_frac : z) << " " << corr <<  " " << alpha + 0.05 << " " <<  ((to_vary < 3)? th_quorum_frac + 0.025 : z + 0.05) << endl;
-    } // all y samples (qthresh if to_vary==0, 1, or 2; z if to_vary==3) done
+  stop_rule rule(opt.get_long("batch", 1000), opt.get("tol", 0.0), opt.get("rtol", 0.0), true);
+  sweep_checkpoint* ckpt = sweep_checkpoint_from(opt, "speed-accuracy-coef", seed, npoints, rule);
+  // the chunks of single_pass=1 and crn=1 are shared by several points and cannot be keyed by one of them
+  if (opt.has("cache") && (single_pass || crn)) {
+    cerr << "cache= is not available with single_pass=1 and crn=1" << endl;
+    exit(8);
+  }
+  // a point is keyed by its parameter values, so the lists alpha_s= and z= of the blocks are left out of the key
+  options key_opt = opt;
+  key_opt.kv.erase("alpha_s");
+  key_opt.kv.erase("z");
+  vector<vector<double> > key_points(opt.has("cache")? npoints : 0);
+  for (p=0 ; p<(long)key_points.size() ; p++) {
+    point q = point_of(p, 0);
+    key_points[p] = {q.alpha, q.alpha_s, q.H, q.z, q.th_quorum_frac};
+  }
+  result_cache* cache = result_cache_from(key_opt, "speed-accuracy-coef", seed, key_points, opt.trials());
+  chunk_store* store = (ckpt != NULL)? (chunk_store*)ckpt : cache;
+
+  // one output line; the y-axis is the quorum threshold if to_vary==0, 1, or 2 and z if to_vary==3
+  auto print_row = [&](double alpha, int ind_y, double corr, long trials_used) {
+    double y = (to_vary < 3)? 0.25 + 0.05 * ind_y : 0.1*(ind_y+1);
+    cout << alpha << " " << y << " " << corr <<  " " << alpha + 0.05 << " " <<  ((to_vary < 3)? y + 0.025 : y + 0.05);
+    if (rule.adaptive())
+      cout << " " << trials_used;
     cout << endl;
-  } // all alpha samples done
+  };
+
+  // stores the result of one point of the full grid and prints the block of rows of an alpha once it is complete
+  auto record = [&](const point& q, const trial_sums& sums) {
+    int ind_y;
+    t_quorum[q.ind_y][q.ind] = sums.t_ave();
+    precision[q.ind_y][q.ind] = sums.s_ave();
+    if (++block_done < samples_y * samples)
+      return;
+    block_done = 0;
+    if (q.ind_alpha == 0) { // new block
+      cerr << ((to_vary==2)? "z = " : "alpha_s = ") << fixed[q.ind_fixed] << endl;
+      if (q.ind_fixed > 0)
+	cout << endl << endl;
+      for (ind_y = -1 ; ind_y < samples_y ; ind_y++) // dummy alpha
+	print_row(0.0, ind_y, -10.0, 0);
+      cout << endl;
+    }
+    print_row(q.alpha, -1, -10.0, 0); // dummy y
+    for (ind_y = 0 ; ind_y < samples_y ; ind_y++) {
+      print_row(q.alpha, ind_y, corr_coef(&t_quorum[ind_y][0], &precision[ind_y][0], samples), trials_used[ind_y]);
+      trials_used[ind_y] = 0;
+    }
+    cout << endl;
+  };
+
+  unsigned long seed_run = seed;
+  if (single_pass) {
+    auto make_trial = [&](long p) {
+      vector<int> th(samples_th);
+      for (int k=0 ; k<samples_th ; k++)
+	th[k] = quorum_ants(point_of(p, k).th_quorum_frac, Na);
+      point q = point_of(p, 0);
+      return lh_multi_trial(nets[p], q.H, q.z, Na, th, method);
+    };
+    auto emit = [&](long p, const vector<trial_sums>& sums) {
+      for (int k=0 ; k<samples_th ; k++) {
+	point q = point_of(p, k);
+	trials_used[q.ind_y] += sums[k].n;
+	record(q, sums[k]);
+      }
+    };
+    // ind is the fastest index of p for to_vary=0, 1, 2; for to_vary=3 it is the threshold, common to a trajectory anyway
+    run_sweep_outputs(make_trial, npoints, opt.trials(), seed_run, opt.threads(), emit, rule, (crn && to_vary < 3)? samples : 1, store);
+  } else {
+    auto make_trial = [&](long p) {
+      point q = point_of(p, 0);
+      return lh_trial(nets[p], q.H, q.z, Na, quorum_ants(q.th_quorum_frac, Na), method);
+    };
+    auto emit = [&](long p, const trial_sums& sums) {
+      point q = point_of(p, 0);
+      trials_used[q.ind_y] += sums.n;
+      record(q, sums);
+    };
+    run_sweep(make_trial, npoints, opt.trials(), seed_run, opt.threads(), emit, rule, crn? samples : 1, store);
+  }
 
+  if (ckpt != NULL && ckpt->sharded())
+    cerr << "shard " << opt.get_str("shard", "") << ": " << ckpt->written << " chunks written to " << opt.get_str("checkpoint", "") << endl;
+  delete ckpt;
+  if (cache != NULL)
+    cerr << cache->hits << " chunks from the cache " << opt.get_str("cache", "") << ", " << cache->simulated << " simulated" << endl;
+  delete cache;
+  ssa_profile_report("speed-accuracy-coef"); // with -DSSA_PROFILE (see ssa-profile.h)
   return 0;
 }
@@ -0,0 +1,511 @@
+/* Gillespie stochastic simulation engine shared by the stochastic drivers.
+
+A model is described as a reaction network in which every reaction moves one ant
+from compartment "from" to compartment "to". The propensity of a reaction is
+
+    k * x[from]                     (first-order reaction, e.g., commitment, leak)
+    k * P * x[from] / Na            (recruitment, P = # ants in the recruiter pool)
+
+where a recruiter pool is a set of compartments whose ants recruit to the same nest.
+Reactions with k=0 are dropped when the network is built, so that they cost nothing
+in the event loop.
+
+Two selection methods are implemented.
+SSA_LINEAR recomputes all propensities after every event and scans their cumulative sum,
+in the order in which the reactions were added. This is the fastest for the 9-compartment model.
+SSA_TREE groups the reactions by the compartment they consume, so that the propensity of a group
+is x[from] times the sum of the per-ant rates of its reactions. The group propensities and the
+per-ant rates within each group are kept in binary sum trees that are updated incrementally:
+an event changes two compartments and the recruiter pools containing them, so only O(1) leaves
+are updated and selection takes O(log # reactions). A change in the old-nest population, on which
+all recruitment reactions depend, updates a single leaf.
+SSA_AUTO selects SSA_TREE for networks with more than SSA_TREE_MIN_CHANNELS reactions.
+
+For large colonies, two approximate methods advance the state by leaps of length tau, during which
+each reaction fires a Poisson number of times (Cao, Gillespie and Petzold, J. Chem. Phys. 124, 044109 (2006)).
+tau is chosen so that the expected relative change of every compartment stays below leap_eps.
+Reactions whose compartment holds fewer than leap_ncrit ants are critical and fire at most once per
+leap, and a leap that would make a compartment negative is retried with half the step. When the step
+would be shorter than a few exact events, leap_ssa_steps exact events are simulated instead.
+SSA_TAU stops at the end of the leap during which keep_going(x) becomes false, so the stopping time
+and state are approximate. SSA_HYBRID in addition shortens the leaps so that the # events in a leap
+stays 4 standard deviations below keep_going.margin(x), the # ants that have to move before the
+dynamics can stop. Close to the end, the leaps become shorter than a few events and the exact SSA
+takes over, so that the stopping time and which stopping condition is met are not distorted by
+overshooting. (Rejecting the leaps that overshoot would bias the accepted leaps towards small changes.)
+*/
+
+#ifndef SSA_ENGINE_H
+#define SSA_ENGINE_H
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "rng.h"
+#include "ssa-profile.h"
+
+#define SSA_TREE_MIN_CHANNELS 24
+
+// SSA_ENSEMBLE is the lockstep ensemble of ensemble-ssa.h; ssa_engine treats it as SSA_AUTO.
+enum { SSA_LINEAR, SSA_TREE, SSA_AUTO, SSA_TAU, SSA_HYBRID, SSA_ENSEMBLE };
+
+struct ssa_network {
+  int n_species; // # compartments
+  int Na; // # ants
+  std::vector<int> from, to, pool; // pool = -1 for first-order reactions
+  std::vector<double> k;
+  std::vector<std::vector<int> > pool_members;
+
+  ssa_network(int n_species_, int Na_) : n_species(n_species_), Na(Na_) {}
+
+  int add_pool(const std::vector<int>& members) {
+    pool_members.push_back(members);
+    return (int)pool_members.size() - 1;
+  }
+
+  void add_channel(int from_, int to_, double k_, int pool_ = -1) {
+    if (k_ == 0.0)
+      return;
+    from.push_back(from_);
+    to.push_back(to_);
+    k.push_back(k_);
+    pool.push_back(pool_);
+  }
+
+  int channels() const { return (int)from.size(); }
+
+  // rate equations of the mean-field model: y and dy are fractions of ants (the Na -> infinity limit)
+  void drift(const double* y, double* dy) const {
+    int c;
+    size_t i;
+    double r, P;
+    for (i=0 ; i<(size_t)n_species ; i++)
+      dy[i] = 0.0;
+    for (c=0 ; c<channels() ; c++) {
+      r = k[c] * y[from[c]];
+      if (pool[c] >= 0) {
+	P = 0.0;
+	for (i=0 ; i<pool_members[pool[c]].size() ; i++)
+	  P += y[pool_members[pool[c]][i]];
+	r *= P;
+      }
+      dy[from[c]] -= r;
+      dy[to[c]] += r;
+    }
+  }
+};
+
+// binary tree of partial sums over n non-negative weights
+struct sum_tree {
+  int cap; // # leaves, a power of 2
+  std::vector<double> node; // node[1] is the root, leaves are node[cap], ..., node[2*cap-1]
+
+  void resize(int n) {
+    cap = 1;
+    while (cap < n)
+      cap *= 2;
+    node.assign(2*cap, 0.0);
+  }
+
+  double total() const { return node[1]; }
+
+  void set(int i, double w) {
+    i += cap;
+    node[i] = w;
+    for (i/=2 ; i>=1 ; i/=2)
+      node[i] = node[2*i] + node[2*i+1];
+  }
+
+  // leaf i such that the sum of the weights before i is <= r < that sum plus weight i;
+  // on return, r is the remainder within leaf i
+  int find(double& r) const {
+    int i = 1;
+    while (i < cap) {
+      if (r < node[2*i] || node[2*i+1] <= 0.0)
+	i = 2*i;
+      else {
+	r -= node[2*i];
+	i = 2*i+1;
+      }
+    }
+    return i - cap;
+  }
+};
+
+// keep_going.moved(a, b) is called after every event of the exact methods, which moves one ant from
+// compartment a to b, if keep_going defines it (the agents of agent-ssa.h); otherwise the call compiles to nothing
+template <class Cont>
+inline auto ssa_moved(Cont& keep_going, int a, int b, int) -> decltype(keep_going.moved(a, b), void()) { keep_going.moved(a, b); }
+template <class Cont>
+inline void ssa_moved(Cont&, int, int, long) {}
+
+// likewise, keep_going.jumped(t, a, b, x) is called after every event of the exact methods with the time t of
+// the event and the state x after it (the trajectory recorder of trajectory-recorder.h); always inlined, since
+// GCC otherwise calls it from the unrolled loops of lh_kernel
+template <class Cont>
+__attribute__((always_inline)) inline auto ssa_jumped(Cont& keep_going, double t, int a, int b, const int* x, int) -> decltype(keep_going.jumped(t, a, b, x), void()) {
+  keep_going.jumped(t, a, b, x);
+}
+template <class Cont>
+inline void ssa_jumped(Cont&, double, int, int, const int*, long) {}
+
+// Direct-method SSA. run() advances x until keep_going(x) becomes false or no reaction can occur,
+// and returns the elapsed time. Rng must provide double uniform() in (0,1).
+// keep_going must also provide int margin(x) for SSA_HYBRID.
+struct ssa_engine {
+  const ssa_network& net;
+  int method; // SSA_LINEAR or SSA_TREE
+  std::vector<double> accum; // cumulative propensities
+  std::vector<double> psum; // # ants in each recruiter pool
+  std::vector<int> pool_begin, pool_idx; // members of pool p are pool_idx[pool_begin[p]..pool_begin[p+1]-1]
+  long events; // # events in the last run
+
+  // SSA_TAU, SSA_HYBRID
+  double leap_eps;
+  int leap_ncrit, leap_ssa_steps;
+  long leaps; // # leaps in the last run
+  std::vector<int> order; // highest order of the reactions consuming species s
+  std::vector<int> x_save;
+  std::vector<double> mu, sig; // expected change of each species per unit time and its variance
+
+  // SSA_TREE
+  std::vector<int> group_of; // group of the reactions consuming species s, -1 if none
+  std::vector<int> group_species; // species consumed by group g
+  std::vector<std::vector<int> > group_channels; // reactions of group g
+  std::vector<int> slot; // position of reaction c in its group
+  std::vector<std::vector<int> > pool_channels; // reactions whose propensity depends on pool p
+  std::vector<std::vector<int> > species_pools; // pools containing species s
+  std::vector<sum_tree> inner; // per-ant rates of the reactions of group g
+  sum_tree top; // propensities of the groups
+
+#ifdef SSA_PROFILE
+  ssa_profile prof; // see ssa-profile.h
+  ~ssa_engine() { prof.flush(net.from, net.to, net.pool); }
+#endif
+
+  ssa_engine(const ssa_network& net_, int method_ = SSA_AUTO)
+    : net(net_), accum(net_.channels()), psum(net_.pool_members.size()+1), events(0),
+      leap_eps(0.03), leap_ncrit(10), leap_ssa_steps(100), leaps(0) {
+    int c, g, p, s;
+    SSA_PROF(prof = ssa_profile(net.channels()));
+    method = method_;
+    if (method == SSA_AUTO || method == SSA_ENSEMBLE)
+      method = (net.channels() > SSA_TREE_MIN_CHANNELS)? SSA_TREE : SSA_LINEAR;
+
+    pool_begin.push_back(0);
+    for (p=0 ; p<(int)net.pool_members.size() ; p++) {
+      pool_idx.insert(pool_idx.end(), net.pool_members[p].begin(), net.pool_members[p].end());
+      pool_begin.push_back((int)pool_idx.size());
+    }
+    pool_idx.push_back(0);
+
+    if (method == SSA_TAU || method == SSA_HYBRID) {
+      order.assign(net.n_species, 1);
+      for (c=0 ; c<net.channels() ; c++)
+	if (net.pool[c] >= 0) {
+	  order[net.from[c]] = 2;
+	  for (size_t i=0 ; i<net.pool_members[net.pool[c]].size() ; i++)
+	    order[net.pool_members[net.pool[c]][i]] = 2;
+	}
+      x_save.resize(net.n_species);
+      mu.resize(net.n_species);
+      sig.resize(net.n_species);
+    }
+    if (method != SSA_TREE)
+      return;
+    group_of.assign(net.n_species, -1);
+    slot.resize(net.channels());
+    pool_channels.resize(net.pool_members.size());
+    species_pools.resize(net.n_species);
+    for (c=0 ; c<net.channels() ; c++) {
+      s = net.from[c];
+      if (group_of[s] < 0) {
+	group_of[s] = (int)group_species.size();
+	group_species.push_back(s);
+	group_channels.push_back(std::vector<int>());
+      }
+      g = group_of[s];
+      slot[c] = (int)group_channels[g].size();
+      group_channels[g].push_back(c);
+      if (net.pool[c] >= 0)
+	pool_channels[net.pool[c]].push_back(c);
+    }
+    for (p=0 ; p<(int)net.pool_members.size() ; p++)
+      for (size_t i=0 ; i<net.pool_members[p].size() ; i++)
+	species_pools[net.pool_members[p][i]].push_back(p);
+    inner.resize(group_species.size());
+    for (g=0 ; g<(int)group_species.size() ; g++)
+      inner[g].resize((int)group_channels[g].size());
+    top.resize((int)group_species.size());
+  }
+
+  template <class Rng, class Cont>
+  double run(int* x, Rng& rng, Cont keep_going) {
+    double t;
+    SSA_PROF(prof.start());
+    if (method == SSA_TREE)
+      t = run_tree(x, rng, keep_going);
+    else if (method == SSA_TAU || method == SSA_HYBRID)
+      t = run_leap(x, rng, keep_going);
+    else
+      t = run_linear(x, rng, keep_going);
+    SSA_PROF(prof.end_run(events, leaps));
+    return t;
+  }
+
+  template <class Rng, class Cont>
+  double run_linear(int* x, Rng& rng, Cont keep_going) {
+    const int nc = net.channels();
+    const int np = (int)pool_begin.size() - 1;
+    const int* pb = &pool_begin[0];
+    const int* pi = &pool_idx[0];
+    double* ps = &psum[0];
+    const int* from = &net.from[0];
+    const int* to = &net.to[0];
+    const int* pool = &net.pool[0];
+    const double* k = &net.k[0];
+    double* acc = &accum[0];
+    const double Na = net.Na;
+    double t = 0.0;
+    double a0, ra;
+    int i, p;
+
+    events = 0;
+    while (keep_going(x)) {
+      for (p=0 ; p<np ; p++) {
+	ps[p] = 0.0;
+	for (i=pb[p] ; i<pb[p+1] ; i++)
+	  ps[p] += x[pi[i]];
+      }
+
+      a0 = 0.0;
+      for (i=0 ; i<nc ; i++) {
+	if (pool[i] < 0)
+	  a0 += k[i] * x[from[i]];
+	else
+	  a0 += k[i] * ps[pool[i]] * x[from[i]] / Na;
+	acc[i] = a0;
+      }
+      if (a0 <= 0.0) // absorbing state
+	break;
+      SSA_PROF(prof.lap(SSA_PROF_PROPENSITY));
+
+      ra = rng.uniform() * a0;
+      SSA_PROF(prof.lap(SSA_PROF_RNG));
+      i = 0;
+      while (i < nc-1 && ra >= acc[i])
+	i++;
+      SSA_PROF(prof.lap(SSA_PROF_SELECTION));
+      x[from[i]]--;
+      x[to[i]]++;
+      events++;
+      ssa_moved(keep_going, from[i], to[i], 0);
+      SSA_PROF(prof.channel_events[i]++; prof.lap(SSA_PROF_UPDATE));
+      t += 1.0/a0*rng.exponential();
+      ssa_jumped(keep_going, t, from[i], to[i], x, 0);
+      SSA_PROF(prof.lap(SSA_PROF_RNG));
+    }
+    return t;
+  }
+
+  // propensities of all reactions into accum[], returns their sum
+  double propensities(const int* x) {
+    int c, p;
+    double a0 = 0.0;
+    for (p=0 ; p<(int)psum.size()-1 ; p++) {
+      psum[p] = 0.0;
+      for (int i=pool_begin[p] ; i<pool_begin[p+1] ; i++)
+	psum[p] += x[pool_idx[i]];
+    }
+    for (c=0 ; c<net.channels() ; c++) {
+      accum[c] = (net.pool[c] < 0)? net.k[c] * x[net.from[c]] : net.k[c] * psum[net.pool[c]] * x[net.from[c]] / net.Na;
+      a0 += accum[c];
+    }
+    return a0;
+  }
+
+  template <class Rng, class Cont>
+  double run_leap(int* x, Rng& rng, Cont keep_going) {
+    const int nc = net.channels();
+    const int ns = net.n_species;
+    const double inf = std::numeric_limits<double>::infinity();
+    double t = 0.0;
+    double a0, a0c, ra, tau, tau1, tau2, bound;
+    long k, fired;
+    int c, i, exact = 0;
+    bool negative;
+
+    events = leaps = 0;
+    while (keep_going(x)) {
+      a0 = propensities(x);
+      if (a0 <= 0.0) // absorbing state
+	break;
+      SSA_PROF(prof.lap(SSA_PROF_PROPENSITY));
+
+      if (exact > 0) { // one exact event
+	ra = rng.uniform() * a0;
+	SSA_PROF(prof.lap(SSA_PROF_RNG));
+	for (c=0 ; c<nc-1 && ra >= accum[c] ; c++)
+	  ra -= accum[c];
+	SSA_PROF(prof.lap(SSA_PROF_SELECTION));
+	x[net.from[c]]--;
+	x[net.to[c]]++;
+	events++;
+	exact--;
+	SSA_PROF(prof.channel_events[c]++; prof.lap(SSA_PROF_UPDATE));
+	t += 1.0/a0*rng.exponential();
+	SSA_PROF(prof.lap(SSA_PROF_RNG));
+	continue;
+      }
+
+      // step size from the non-critical reactions
+      a0c = 0.0;
+      for (i=0 ; i<ns ; i++)
+	mu[i] = sig[i] = 0.0;
+      for (c=0 ; c<nc ; c++) {
+	if (x[net.from[c]] < leap_ncrit)
+	  a0c += accum[c];
+	else {
+	  mu[net.from[c]] -= accum[c];
+	  mu[net.to[c]] += accum[c];
+	  sig[net.from[c]] += accum[c];
+	  sig[net.to[c]] += accum[c];
+	}
+      }
+      tau1 = inf;
+      for (i=0 ; i<ns ; i++) {
+	bound = std::max(leap_eps * x[i] / order[i], 1.0);
+	if (mu[i] != 0.0)
+	  tau1 = std::min(tau1, bound / fabs(mu[i]));
+	if (sig[i] > 0.0)
+	  tau1 = std::min(tau1, bound * bound / sig[i]);
+      }
+      if (method == SSA_HYBRID) { // a0*tau + 4*sqrt(a0*tau) <= margin
+	bound = (-4.0 + sqrt(16.0 + 4.0*keep_going.margin(x))) / 2;
+	tau1 = std::min(tau1, bound*bound/a0);
+      }
+      if (tau1 < 10.0/a0) {
+	exact = leap_ssa_steps;
+	continue;
+      }
+
+      for (i=0 ; i<ns ; i++)
+	x_save[i] = x[i];
+      do { // leap
+	tau2 = (a0c > 0.0)? rng.exponential()/a0c : inf;
+	tau = std::min(tau1, tau2);
+	fired = 0;
+	for (c=0 ; c<nc ; c++)
+	  if (x_save[net.from[c]] >= leap_ncrit && (k = poisson(rng, accum[c]*tau)) > 0) {
+	    x[net.from[c]] -= (int)k;
+	    x[net.to[c]] += (int)k;
+	    fired += k;
+	    SSA_PROF(prof.pending[c] += k);
+	  }
+	if (tau2 <= tau1) { // one critical reaction
+	  ra = rng.uniform() * a0c;
+	  for (c=0, i=-1 ; c<nc ; c++)
+	    if (x_save[net.from[c]] < leap_ncrit) {
+	      i = c;
+	      if (ra < accum[c])
+		break;
+	      ra -= accum[c];
+	    }
+	  x[net.from[i]]--; // a negative count, possible only by rounding, is rejected below
+	  x[net.to[i]]++;
+	  fired++;
+	  SSA_PROF(prof.pending[i]++);
+	}
+	negative = false;
+	for (i=0 ; i<ns ; i++)
+	  if (x[i] < 0)
+	    negative = true;
+	if (negative) {
+	  for (i=0 ; i<ns ; i++)
+	    x[i] = x_save[i];
+	  tau1 /= 2;
+	  SSA_PROF(prof.settle(false));
+	}
+      } while (negative);
+
+      t += tau;
+      events += fired;
+      leaps++;
+      SSA_PROF(prof.settle(true); prof.lap(SSA_PROF_LEAP));
+    }
+    return t;
+  }
+
+  // per-ant rate of reaction c
+  double rate(int c) const {
+    return (net.pool[c] < 0)? net.k[c] : net.k[c] * psum[net.pool[c]] / net.Na;
+  }
+
+  void update_group(const int* x, int g) {
+    top.set(g, x[group_species[g]] * inner[g].total());
+  }
+
+  // species s has changed by d
+  void update_species(const int* x, int s, int d) {
+    int c, p;
+    for (size_t i=0 ; i<species_pools[s].size() ; i++) {
+      p = species_pools[s][i];
+      psum[p] += d;
+      for (size_t j=0 ; j<pool_channels[p].size() ; j++) {
+	c = pool_channels[p][j];
+	inner[group_of[net.from[c]]].set(slot[c], rate(c));
+	update_group(x, group_of[net.from[c]]);
+      }
+    }
+    if (group_of[s] >= 0)
+      update_group(x, group_of[s]);
+  }
+
+  template <class Rng, class Cont>
+  double run_tree(int* x, Rng& rng, Cont keep_going) {
+    double t = 0.0;
+    double a0, ra;
+    int c, g, p, a, b;
+
+    for (p=0 ; p<(int)psum.size()-1 ; p++) {
+      psum[p] = 0.0;
+      for (int i=pool_begin[p] ; i<pool_begin[p+1] ; i++)
+	psum[p] += x[pool_idx[i]];
+    }
+    for (c=0 ; c<net.channels() ; c++)
+      inner[group_of[net.from[c]]].set(slot[c], rate(c));
+    for (g=0 ; g<(int)group_species.size() ; g++)
+      update_group(x, g);
+
+    events = 0;
+    while (keep_going(x)) {
+      a0 = top.total();
+      if (a0 <= 0.0) // absorbing state
+	break;
+
+      ra = rng.uniform() * a0;
+      SSA_PROF(prof.lap(SSA_PROF_RNG));
+      g = top.find(ra);
+      ra /= x[group_species[g]];
+      c = group_channels[g][inner[g].find(ra)];
+      SSA_PROF(prof.lap(SSA_PROF_SELECTION));
+      a = net.from[c];
+      b = net.to[c];
+      x[a]--;
+      x[b]++;
+      ssa_moved(keep_going, a, b, 0);
+      SSA_PROF(prof.channel_events[c]++; prof.lap(SSA_PROF_UPDATE));
+      update_species(x, a, -1);
+      update_species(x, b, 1);
+      events++;
+      SSA_PROF(prof.lap(SSA_PROF_PROPENSITY));
+      t += 1.0/a0*rng.exponential();
+      ssa_jumped(keep_going, t, a, b, x, 0);
+      SSA_PROF(prof.lap(SSA_PROF_RNG));
+    }
+    return t;
+  }
+};
+
+#endif // SSA_ENGINE_H
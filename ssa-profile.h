@@ -0,0 +1,198 @@
+/* Optional instrumentation of the SSA engine, compiled in with -DSSA_PROFILE and out (no cost) otherwise.
+
+Each ssa_engine counts
+    the events of every reaction channel,
+    the # runs and the # events per run (mean, standard deviation, maximum),
+    the # leaps of SSA_TAU and SSA_HYBRID,
+    the time spent in the sections of the event loop, read from the time-stamp counter:
+        propensity   stopping test, pool sums and (cumulative) propensities, or sum-tree updates (SSA_TREE)
+        rng          drawing the uniform and exponential deviates
+        selection    finding the reaction that fires
+        update       changing the compartments
+        leap         step-size selection and Poisson draws of SSA_TAU and SSA_HYBRID
+and adds its counts to the totals of the process when it is destroyed (at the end of every chunk of trials).
+trial-runner.h adds the # accepted and rejected realisations (those in which the dynamics stopped without a
+quorum, e.g., all ants back in the old nest). The drivers call ssa_profile_report at the end of the run,
+which writes the totals as one JSON object to stderr, or appends it to the file named by the environment
+variable SSA_PROFILE_FILE. The channels are identified by (from, to, pool), so the counts of the grid points
+of a sweep, which share the structure of their networks, add up. The lockstep ensemble (method=ensemble)
+is not instrumented.
+
+Reading the time-stamp counter costs some 20 cycles per section, so the profiled build is slower, and the
+times are to be compared with each other rather than with an unprofiled build.
+*/
+
+#ifndef SSA_PROFILE_H
+#define SSA_PROFILE_H
+
+#ifdef SSA_PROFILE
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define SSA_PROF(stmt) stmt
+
+inline uint64_t ssa_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+enum { SSA_PROF_PROPENSITY, SSA_PROF_RNG, SSA_PROF_SELECTION, SSA_PROF_UPDATE, SSA_PROF_LEAP, SSA_PROF_SECTIONS };
+static const char* const ssa_prof_section_names[SSA_PROF_SECTIONS] = {"propensity", "rng", "selection", "update", "leap"};
+
+// totals of the process
+struct ssa_profile_totals {
+  std::mutex mtx;
+  std::map<std::vector<int>, long> channel_events; // (from, to, pool) -> # events
+  long runs, max_events, leaps, accepted, rejected;
+  double events, events2;
+  uint64_t ticks[SSA_PROF_SECTIONS];
+  uint64_t tick0;
+  std::chrono::steady_clock::time_point time0;
+
+  ssa_profile_totals() : runs(0), max_events(0), leaps(0), accepted(0), rejected(0), events(0.0), events2(0.0) {
+    for (int s=0 ; s<SSA_PROF_SECTIONS ; s++)
+      ticks[s] = 0;
+    tick0 = ssa_ticks();
+    time0 = std::chrono::steady_clock::now();
+  }
+};
+
+inline ssa_profile_totals& ssa_profile_global() {
+  static ssa_profile_totals g;
+  return g;
+}
+
+// counters of one engine; a copy starts from zero, so that the engine of a copied trial is not counted twice
+struct ssa_profile {
+  std::vector<long> channel_events;
+  std::vector<long> pending; // events of the current leap, which may be rejected
+  long runs, max_events, leaps;
+  double events, events2;
+  uint64_t ticks[SSA_PROF_SECTIONS];
+  uint64_t last;
+
+  void clear() {
+    std::fill(channel_events.begin(), channel_events.end(), 0L);
+    std::fill(pending.begin(), pending.end(), 0L);
+    runs = max_events = leaps = 0;
+    events = events2 = 0.0;
+    for (int s=0 ; s<SSA_PROF_SECTIONS ; s++)
+      ticks[s] = 0;
+    last = 0;
+  }
+
+  ssa_profile(int channels = 0) : channel_events(channels), pending(channels) { clear(); }
+  ssa_profile(const ssa_profile& o) : channel_events(o.channel_events.size()), pending(o.pending.size()) { clear(); }
+  ssa_profile& operator=(const ssa_profile& o) {
+    channel_events.assign(o.channel_events.size(), 0L);
+    pending.assign(o.pending.size(), 0L);
+    clear();
+    return *this;
+  }
+
+  void start() { last = ssa_ticks(); }
+  // the time since the last lap was spent in section s
+  void lap(int s) {
+    uint64_t now = ssa_ticks();
+    ticks[s] += now - last;
+    last = now;
+  }
+  // counts the events of a leap if it is accepted
+  void settle(bool accepted) {
+    for (size_t c=0 ; c<pending.size() ; c++) {
+      if (accepted)
+	channel_events[c] += pending[c];
+      pending[c] = 0;
+    }
+  }
+  void end_run(long ev, long lp) {
+    runs++;
+    events += ev;
+    events2 += (double)ev*ev;
+    max_events = std::max(max_events, ev);
+    leaps += lp;
+  }
+
+  void flush(const std::vector<int>& from, const std::vector<int>& to, const std::vector<int>& pool) {
+    if (runs == 0)
+      return;
+    ssa_profile_totals& g = ssa_profile_global();
+    std::lock_guard<std::mutex> lock(g.mtx);
+    for (size_t c=0 ; c<channel_events.size() ; c++) {
+      std::vector<int> key(3);
+      key[0] = from[c];
+      key[1] = to[c];
+      key[2] = pool[c];
+      g.channel_events[key] += channel_events[c];
+    }
+    g.runs += runs;
+    g.events += events;
+    g.events2 += events2;
+    g.max_events = std::max(g.max_events, max_events);
+    g.leaps += leaps;
+    for (int s=0 ; s<SSA_PROF_SECTIONS ; s++)
+      g.ticks[s] += ticks[s];
+    clear();
+  }
+};
+
+inline void ssa_profile_trials(long accepted, long rejected) {
+  ssa_profile_totals& g = ssa_profile_global();
+  std::lock_guard<std::mutex> lock(g.mtx);
+  g.accepted += accepted;
+  g.rejected += rejected;
+}
+
+// writes the totals as one JSON object (one line)
+inline void ssa_profile_report(const char* driver) {
+  ssa_profile_totals& g = ssa_profile_global();
+  std::lock_guard<std::mutex> lock(g.mtx);
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - g.time0).count();
+  double sec_per_tick = wall / (double)(ssa_ticks() - g.tick0); // counter rate calibrated against the clock
+  double mean = (g.runs > 0)? g.events / g.runs : 0.0;
+  double sd = (g.runs > 0)? sqrt(std::max(0.0, g.events2 / g.runs - mean*mean)) : 0.0;
+  std::ofstream file;
+  const char* path = getenv("SSA_PROFILE_FILE");
+  if (path != NULL)
+    file.open(path, std::ios::app);
+  std::ostream& out = (path != NULL && file)? file : std::cerr;
+  int s;
+  out << "{\"driver\": \"" << driver << "\", \"wall_sec\": " << wall
+      << ", \"trials\": {\"accepted\": " << g.accepted << ", \"rejected\": " << g.rejected << "}"
+      << ", \"runs\": " << g.runs << ", \"events\": " << (long long)g.events << ", \"events_per_run\": {\"mean\": " << mean
+      << ", \"sd\": " << sd << ", \"max\": " << g.max_events << "}, \"leaps\": " << g.leaps << ", \"sections_sec\": {";
+  for (s=0 ; s<SSA_PROF_SECTIONS ; s++)
+    out << (s? ", " : "") << "\"" << ssa_prof_section_names[s] << "\": " << g.ticks[s] * sec_per_tick;
+  out << "}, \"channels\": [";
+  s = 0;
+  for (std::map<std::vector<int>, long>::const_iterator it=g.channel_events.begin() ; it!=g.channel_events.end() ; ++it, s++)
+    out << (s? ", " : "") << "{\"from\": " << it->first[0] << ", \"to\": " << it->first[1] << ", \"pool\": " << it->first[2]
+	<< ", \"events\": " << it->second << "}";
+  out << "]}" << std::endl;
+}
+
+#else // SSA_PROFILE
+
+#define SSA_PROF(stmt)
+
+inline void ssa_profile_trials(long, long) {}
+inline void ssa_profile_report(const char*) {}
+
+#endif // SSA_PROFILE
+
+#endif // SSA_PROFILE_H
@@ -0,0 +1,255 @@
+/* Resident server for the sweep drivers, so that interactive exploration and the scripts of figures run their
+queries against one process that keeps the index of the result cache (result-cache.h) and simulates only
+what is missing.
+
+Usage (for any driver with cache=, e.g. finite-nestchoice.out):
+        a.out daemon=<socket> cache=<dir>
+serves requests on the Unix socket <socket> until it is killed, and
+        a.out <arguments> connect=<socket>
+runs the driver with <arguments> in the server instead of in the process: the client passes its working
+directory and its standard input, output and error (SCM_RIGHTS) with the arguments, so the output goes where
+that of a local run would, and exits with the exit status of the run. The requests run with cache=<dir> of
+the server unless they give a cache= of their own, so a query whose points are all in the cache prints at
+once, and one that extends a sweep simulates only the new chunks (with threads= as in a local run).
+
+Every request runs in a process forked from the server, after the server has re-read the cache files that
+changed, so that the request starts with the resident index and a request that exits on an error does not
+take the server down; requests run concurrently. A request whose client goes away (e.g. Ctrl-C) is killed;
+the chunks it finished stay in the cache. The server and the clients must be built from the same sources:
+the cache keys (ANT_CACHE_VERSION) do not cover a driver of another version.
+*/
+
+#ifndef SWEEP_DAEMON_H
+#define SWEEP_DAEMON_H
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h> // lstat
+#include <sys/wait.h>
+#include "options.h"
+#include "result-cache.h"
+
+typedef int (*sweep_driver)(int argc, char** argv);
+
+inline bool sweep_socket_address(const std::string& path, struct sockaddr_un& addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "socket path too long: " << path << std::endl;
+    return false;
+  }
+  strcpy(addr.sun_path, path.c_str());
+  return true;
+}
+
+inline bool sweep_write_all(int fd, const char* buf, size_t n) {
+  while (n > 0) {
+    ssize_t k = write(fd, buf, n);
+    if (k <= 0)
+      return false;
+    buf += k;
+    n -= (size_t)k;
+  }
+  return true;
+}
+
+inline bool sweep_read_all(int fd, char* buf, size_t n) {
+  while (n > 0) {
+    ssize_t k = read(fd, buf, n);
+    if (k <= 0)
+      return false;
+    buf += k;
+    n -= (size_t)k;
+  }
+  return true;
+}
+
+// client: sends the request (working directory, then the arguments but connect=, '\0'-terminated) with the
+// descriptors 0, 1, 2, and returns the exit status of the run
+inline int sweep_client(const std::string& path, int argc, char** argv) {
+  struct sockaddr_un addr;
+  int s = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (!sweep_socket_address(path, addr) || s < 0 || connect(s, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    std::cerr << "cannot connect to the server at " << path << std::endl;
+    return 8;
+  }
+  std::vector<char> cwd(4096);
+  if (getcwd(&cwd[0], cwd.size()) == NULL) {
+    std::cerr << "cannot get the working directory" << std::endl;
+    return 8;
+  }
+  std::string req(&cwd[0]);
+  req += '\0';
+  for (int i=1 ; i<argc ; i++)
+    if (strncmp(argv[i], "connect=", 8) != 0) {
+      req += argv[i];
+      req += '\0';
+    }
+
+  uint32_t len = (uint32_t)req.size();
+  int fds[3] = {0, 1, 2};
+  char control[CMSG_SPACE(sizeof(fds))];
+  struct iovec iov = {&len, sizeof(len)};
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  memset(control, 0, sizeof(control));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+  cm->cmsg_level = SOL_SOCKET;
+  cm->cmsg_type = SCM_RIGHTS;
+  cm->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+  int32_t status;
+  if (sendmsg(s, &msg, 0) != (ssize_t)sizeof(len) || !sweep_write_all(s, req.data(), req.size())
+      || !sweep_read_all(s, (char*)&status, sizeof(status))) {
+    std::cerr << "the server at " << path << " did not complete the request" << std::endl;
+    return 8;
+  }
+  close(s);
+  return status;
+}
+
+// runs one request on connection s in a process of its own and sends its exit status; never returns
+inline void sweep_serve_request(int s, sweep_driver run, const char* name, const std::string& cache) {
+  signal(SIGCHLD, SIG_DFL);
+  uint32_t len;
+  int fds[3];
+  char control[CMSG_SPACE(sizeof(fds))];
+  struct iovec iov = {&len, sizeof(len)};
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  struct cmsghdr* cm;
+  if (recvmsg(s, &msg, 0) != (ssize_t)sizeof(len) || (cm = CMSG_FIRSTHDR(&msg)) == NULL || cm->cmsg_type != SCM_RIGHTS
+      || cm->cmsg_len != CMSG_LEN(sizeof(fds)) || len > (1u << 24))
+    _exit(1);
+  memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+  std::string req(len, '\0');
+  if (len == 0 || !sweep_read_all(s, &req[0], len) || req[len-1] != '\0')
+    _exit(1);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    std::vector<std::string> args;
+    std::vector<char*> av;
+    bool has_cache = false;
+    for (size_t i=0 ; i<len ; i+=args.back().size()+1) {
+      args.push_back(std::string(&req[i]));
+      has_cache = has_cache || args.back().compare(0, 6, "cache=") == 0;
+    }
+    if (!has_cache)
+      args.push_back("cache=" + cache);
+    close(s);
+    signal(SIGPIPE, SIG_DFL);
+    for (int k=0 ; k<3 ; k++) {
+      dup2(fds[k], k);
+      close(fds[k]);
+    }
+    if (chdir(args[0].c_str()) != 0) {
+      std::cerr << "cannot change to " << args[0] << std::endl;
+      exit(8);
+    }
+    av.push_back((char*)name);
+    for (size_t i=1 ; i<args.size() ; i++)
+      av.push_back(&args[i][0]);
+    av.push_back(NULL);
+    exit(run((int)av.size()-1, &av[0]));
+  }
+  for (int k=0 ; k<3 ; k++)
+    close(fds[k]);
+
+  int32_t status = 8;
+  int w, wait_ms = 1;
+  struct pollfd pf = {s, POLLIN, 0};
+  while (pid > 0) {
+    if (waitpid(pid, &w, WNOHANG) == pid) {
+      status = WIFEXITED(w)? WEXITSTATUS(w) : 128 + WTERMSIG(w);
+      break;
+    }
+    if (poll(&pf, 1, wait_ms) > 0) { // the client went away
+      kill(pid, SIGTERM);
+      waitpid(pid, &w, 0);
+      _exit(0);
+    }
+    wait_ms = std::min(2*wait_ms, 100);
+  }
+  sweep_write_all(s, (const char*)&status, sizeof(status));
+  _exit(0);
+}
+
+// server of daemon=<socket> cache=<dir>; returns only on an error
+inline int sweep_daemon(const options& opt, sweep_driver run, const char* name) {
+  std::string path = opt.get_str("daemon", ""), cache = opt.get_str("cache", "");
+  struct sockaddr_un addr;
+  if (cache.empty()) {
+    std::cerr << "daemon= needs cache=<dir>" << std::endl;
+    return 8;
+  }
+  mkdir(cache.c_str(), 0777);
+  char* abs = realpath(cache.c_str(), NULL); // the requests run in the directories of their clients
+  if (abs == NULL) {
+    std::cerr << "cannot create the cache directory " << cache << std::endl;
+    return 8;
+  }
+  cache = abs;
+  free(abs);
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0) { // the socket of an earlier server, never another file
+    if (!S_ISSOCK(st.st_mode)) {
+      std::cerr << path << ": not a socket" << std::endl;
+      return 8;
+    }
+    unlink(path.c_str());
+  }
+  int l = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (!sweep_socket_address(path, addr) || l < 0 || bind(l, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(l, 16) != 0) {
+    std::cerr << "cannot listen on " << path << std::endl;
+    return 8;
+  }
+  resident_cache = new result_cache_index(cache);
+  resident_cache->scan();
+  std::cerr << name << ": serving " << path << " with " << resident_cache->chunks.size() << " points in " << cache << std::endl;
+  signal(SIGCHLD, SIG_IGN); // the request processes are reaped by the system
+  signal(SIGPIPE, SIG_IGN);
+  while (true) {
+    int s = accept(l, NULL, NULL);
+    if (s < 0)
+      continue;
+    resident_cache->scan();
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(l);
+      sweep_serve_request(s, run, name, cache);
+    }
+    close(s);
+  }
+}
+
+// main() of a driver: the server with daemon=, a client with connect=, else the driver itself
+inline int sweep_main(int argc, char** argv, sweep_driver run, const char* name) {
+  options opt(argc, argv);
+  if (opt.has("daemon"))
+    return sweep_daemon(opt, run, name);
+  if (opt.has("connect"))
+    return sweep_client(opt.get_str("connect", ""), argc, argv);
+  return run(argc, argv);
+}
+
+#endif // SWEEP_DAEMON_H
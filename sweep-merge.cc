@@ -0,0 +1,62 @@
+/* Merges the checkpoint files of the shards of a sweep (shard=i/N checkpoint=<file>, see checkpoint.h) into one.
+
+All the files must come from the same driver with the same arguments and seed. A chunk found in several files
+is kept once. The # chunks still missing for the complete sweep is reported; running the driver with the
+same arguments and checkpoint=<merged file> prints the results and simulates only the missing chunks.
+The merged file is written in the current format, also from files of the first version.
+
+Usage:
+        a.out merged_file shard_file1 shard_file2 ...
+*/
+
+#include <iostream>
+using namespace std;
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+#include "checkpoint.h"
+
+int main (int argc, char **argv) {
+
+  if (argc < 3) {
+    cerr << "sweep-merge.out merged_file shard_file1 shard_file2 ..." << endl;
+    exit(8);
+  }
+
+  checkpoint_header head, h;
+  map<pair<long, long>, vector<trial_sums> > all, chunks;
+  long valid_bytes;
+  int version;
+  for (int i=2 ; i<argc ; i++) {
+    chunks.clear();
+    if (!sweep_checkpoint::read(argv[i], h, chunks, valid_bytes, version)) {
+      cerr << argv[i] << " is not a checkpoint file" << endl;
+      exit(8);
+    }
+    if (i == 2)
+      head = h;
+    else if (h.signature != head.signature || h.seed != head.seed || h.npoints != head.npoints || h.trials != head.trials) {
+      cerr << argv[i] << " is from another sweep than " << argv[2] << " (different arguments or seed)" << endl;
+      exit(8);
+    }
+    cerr << argv[i] << ": " << chunks.size() << " chunks" << endl;
+    all.insert(chunks.begin(), chunks.end()); // keeps the first copy of a chunk
+  }
+
+  FILE* f = fopen(argv[1], "wb");
+  if (f == NULL) {
+    cerr << "cannot write " << argv[1] << endl;
+    exit(8);
+  }
+  sweep_checkpoint::write_header(f, head);
+  for (map<pair<long, long>, vector<trial_sums> >::const_iterator it=all.begin() ; it!=all.end() ; ++it)
+    sweep_checkpoint::write_record(f, it->first.first, it->first.second, it->second);
+  fclose(f);
+
+  long expected = head.npoints * ((head.trials + TRIAL_CHUNK - 1) / TRIAL_CHUNK);
+  cerr << argv[1] << ": " << all.size() << " chunks of " << expected << " (seed = " << head.seed << ")" << endl;
+  if ((long)all.size() < expected)
+    cerr << expected - all.size() << " chunks are missing; they are simulated when the driver is run with this checkpoint" << endl;
+  return 0;
+}
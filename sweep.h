@@ -0,0 +1,88 @@
+/* Parameter grids for the sweep mode of the drivers.
+
+Each parameter is given as a comma-separated list of values or ranges, e.g.
+    0.1                 a single value
+    0.1,0.2,0.5         a list
+    0.02:0.4:0.02       start:stop:step, stop included
+    0.01,0.1:1:0.3      both
+The values of a range are rounded to the decimal places of its start and step, so that they are the
+values of the same list (0.02:0.4:0.02 gives 0.14, not 0.02 + 6*0.02 = 0.13999999999999999).
+The grid is the Cartesian product of the parameters, the first parameter varying slowest.
+*/
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// # decimal places of a number as written, e.g. 2 for 0.02 and 5 for 1.5e-4
+inline int decimal_places(const std::string& num) {
+  size_t e = num.find_first_of("eE"), dot = num.find('.');
+  std::string mantissa = num.substr(0, e);
+  int d = (dot == std::string::npos || dot > mantissa.size())? 0 : (int)(mantissa.size() - dot - 1);
+  if (e != std::string::npos)
+    d -= atoi(num.c_str() + e + 1);
+  return (d > 0)? d : 0;
+}
+
+inline std::vector<double> parse_values(const char* spec) {
+  std::vector<double> v;
+  std::string s(spec), item;
+  size_t begin = 0, end;
+  double start, stop, step;
+  long i, n;
+
+  while (begin <= s.size()) {
+    end = s.find(',', begin);
+    if (end == std::string::npos)
+      end = s.size();
+    item = s.substr(begin, end-begin);
+    if (sscanf(item.c_str(), "%lf:%lf:%lf", &start, &stop, &step) == 3) {
+      if (step <= 0.0 || stop < start) {
+	std::cerr << "invalid range " << item << std::endl;
+	exit(8);
+      }
+      n = (long)floor((stop-start)/step + 1e-8);
+      size_t c1 = item.find(':'), c2 = item.find(':', c1+1);
+      int d = std::max(decimal_places(item.substr(0, c1)), decimal_places(item.substr(c2+1)));
+      double scale = (d <= 15)? pow(10.0, d) : 0.0; // beyond, the values are left as computed
+      for (i=0 ; i<=n ; i++)
+	v.push_back((scale > 0.0)? round((start + i*step) * scale) / scale : start + i*step);
+    } else
+      v.push_back(atof(item.c_str()));
+    begin = end+1;
+  }
+  return v;
+}
+
+struct grid {
+  std::vector<std::vector<double> > axes;
+
+  void add(const char* spec) { axes.push_back(parse_values(spec)); }
+
+  long size() const {
+    long n = 1;
+    for (size_t a=0 ; a<axes.size() ; a++)
+      n *= (long)axes[a].size();
+    return n;
+  }
+
+  // parameter values of grid point p
+  std::vector<double> point(long p) const {
+    std::vector<double> v(axes.size());
+    for (int a=(int)axes.size()-1 ; a>=0 ; a--) {
+      v[a] = axes[a][p % axes[a].size()];
+      p /= (long)axes[a].size();
+    }
+    return v;
+  }
+};
+
+#endif // SWEEP_H
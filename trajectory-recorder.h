@@ -0,0 +1,341 @@
+/* Time-resolved ensemble of the trajectories of the stochastic drivers (record=<file> of finite-nestchoice.cc and
+cohesion-tradeoff.cc), to be compared with the rate equations of diffeqn-nestchoice.cc.
+
+Every accepted realisation is sampled at the grid times j*dt, j = 0, ..., G-1 (record_dt=1, record_tmax=100):
+the state at a grid time is that after the last event before it, and once the realisation has stopped (quorum,
+emigration or return), its final state. The observables are sums of compartments, e.g. the ants at the good
+nest (lh_observables, nnest_observables in nest-models.h). For each grid time and observable, the recorder
+keeps the sum of the values and of their squares and a histogram of the values (one bin per value up to
+Na = 255, 256 bins above), from which the mean, the standard deviation and the 5, 25, 50, 75 and 95 percentiles
+are computed, and the # realisations still running.
+
+Cost: the trajectories are piecewise constant, so an observable that changes at time t closes its current
+segment, the grid times since its last change, and the segments are added to difference arrays over the grid
+(two updates per segment, whatever its length), which are summed over the grid only when the file is written.
+An event that crosses no grid time and changes only observables that have changed since the last one costs a
+comparison and a mask (from a table of the moves) in the loop of the SSA; otherwise it closes segments. The
+segments of a realisation are buffered, so that those of discarded realisations are dropped. Each thread has
+its own accumulators per grid point, holding integers, so that their sum does not depend on the # threads.
+The cost is thus about that of a segment per grid time and observable that a realisation spans: at Na = 100
+(12 events per unit time), about 5% with record_dt=1 and 50% with record_dt=0.1; at Na = 1000, 0 and 15%.
+
+Output: for each grid point of the sweep, a comment line with its parameters and the names of the columns, then
+G lines
+        t <mean of each observable> <fraction of the realisations still running> <std of each observable>
+          <5, 25, 50, 75 and 95 percentiles of each observable>
+with the observables as fractions of Na; the blocks are separated by two blank lines (gnuplot "index"). For the
+L/H model, columns 2-5 are those of diffeqn-nestchoice.cc (recruiters of the good nest, ants at the good nest,
+recruiters of the poor nest, ants at the poor nest), so that both can be plotted on the same axes.
+
+Only the exact methods call the event hook (ssa_jumped in ssa-engine.h), so record= is not available with
+method=tau, hybrid or ensemble, nor with checkpoint= (restored chunks are not simulated again).
+*/
+
+#ifndef TRAJECTORY_RECORDER_H
+#define TRAJECTORY_RECORDER_H
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <stdint.h>
+#include "options.h"
+#include "ssa-engine.h"
+
+struct trajectory_observable {
+  std::string name;
+  std::vector<int> compartments;
+};
+
+// accumulators of one grid point in one thread, as differences over the grid time j, which varies fastest so that
+// the successive segments of an observable fall in the same cache lines
+struct trajectory_acc {
+  std::thread::id owner;
+  int G, Na, bins;
+  long n; // # realisations
+  std::vector<int64_t> moment; // O x (G+1) x (sum of the values, of their squares)
+  std::vector<int64_t> running; // G+1
+  std::vector<int32_t> hist; // O x (G+1) x bins
+
+  trajectory_acc(std::thread::id owner_, int G_, int O, int Na_)
+    : owner(owner_), G(G_), Na(Na_), bins(std::min(Na_+1, 256)), n(0), moment((size_t)(G+1)*O*2), running(G+1),
+      hist((size_t)(G+1)*O*bins) {}
+
+  int bin(int v) const { return (int)((int64_t)v * bins / (Na+1)); }
+  size_t m(int j, int o) const { return 2 * ((size_t)o*(G+1) + j); }
+  size_t h(int j, int o, int b) const { return ((size_t)o*(G+1) + j)*bins + b; }
+};
+
+// observable o has value v at the grid times begin, ..., end-1
+struct trajectory_segment {
+  int o, begin, end, value;
+};
+
+// a move changes observable o by delta
+struct trajectory_change {
+  int o, delta;
+};
+
+struct trajectory_recorder {
+  double dt;
+  int G, O;
+  std::vector<trajectory_observable> obs;
+  std::vector<int> comp_first, comp; // compartments of observable o: comp[comp_first[o] ...]
+  int n_species;
+  // observables changed by a move from a to b: change[first[a*n_species + b] ...], with the change of their value
+  std::vector<int> first;
+  std::vector<trajectory_change> change;
+  std::vector<uint64_t> changes; // changes[a*n_species + b]: mask of the observables changed by the move
+  std::vector<std::vector<trajectory_acc*> > acc; // per grid point, one per thread
+  std::mutex mtx;
+
+  trajectory_recorder(double dt_, double tmax, const std::vector<trajectory_observable>& obs_, int n_species_, long npoints)
+    : dt(dt_), G((int)floor(tmax/dt_ + 1e-9) + 1), O((int)obs_.size()), obs(obs_), n_species(n_species_), acc(npoints) {
+    std::vector<char> member(O * n_species, 0);
+    for (int o=0 ; o<O ; o++) {
+      comp_first.push_back((int)comp.size());
+      for (size_t i=0 ; i<obs[o].compartments.size() ; i++) {
+	member[o*n_species + obs[o].compartments[i]] = 1;
+	comp.push_back(obs[o].compartments[i]);
+      }
+    }
+    comp_first.push_back((int)comp.size());
+    for (int a=0 ; a<n_species ; a++)
+      for (int b=0 ; b<n_species ; b++) {
+	first.push_back((int)change.size());
+	changes.push_back(0);
+	for (int o=0 ; o<O ; o++)
+	  if (member[o*n_species + a] != member[o*n_species + b]) {
+	    trajectory_change c = {o, member[o*n_species + b] - member[o*n_species + a]};
+	    change.push_back(c);
+	    changes.back() |= (uint64_t)1 << o;
+	  }
+      }
+    first.push_back((int)change.size());
+  }
+
+  ~trajectory_recorder() {
+    for (size_t p=0 ; p<acc.size() ; p++)
+      for (size_t i=0 ; i<acc[p].size() ; i++)
+	delete acc[p][i];
+  }
+
+  // accumulators of point p for the calling thread
+  trajectory_acc* local(long p, int Na) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::thread::id me = std::this_thread::get_id();
+    for (size_t i=0 ; i<acc[p].size() ; i++)
+      if (acc[p][i]->owner == me)
+	return acc[p][i];
+    acc[p].push_back(new trajectory_acc(me, G, O, Na));
+    return acc[p].back();
+  }
+
+  // writes the blocks of all grid points; label[p] describes point p
+  bool write(const char* path, const std::vector<std::string>& label) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL)
+      return false;
+    const double q[5] = {0.05, 0.25, 0.5, 0.75, 0.95};
+    int j, o, b, k;
+    for (size_t p=0 ; p<acc.size() ; p++) {
+      if (acc[p].empty())
+	continue;
+      // sum of the threads, then of the differences over the grid
+      trajectory_acc total(std::thread::id(), G, O, acc[p][0]->Na);
+      for (size_t i=0 ; i<acc[p].size() ; i++) {
+	const trajectory_acc& a = *acc[p][i];
+	total.n += a.n;
+	for (size_t m=0 ; m<total.moment.size() ; m++)
+	  total.moment[m] += a.moment[m];
+	for (j=0 ; j<=G ; j++)
+	  total.running[j] += a.running[j];
+	for (size_t m=0 ; m<total.hist.size() ; m++)
+	  total.hist[m] += a.hist[m];
+      }
+      for (j=1 ; j<G ; j++) {
+	total.running[j] += total.running[j-1];
+	for (o=0 ; o<O ; o++) {
+	  total.moment[total.m(j, o)] += total.moment[total.m(j-1, o)];
+	  total.moment[total.m(j, o)+1] += total.moment[total.m(j-1, o)+1];
+	  for (b=0 ; b<total.bins ; b++)
+	    total.hist[total.h(j, o, b)] += total.hist[total.h(j-1, o, b)];
+	}
+      }
+
+      const double n = (double)total.n, Na = total.Na;
+      const double width = (double)(total.Na+1) / total.bins; // values per bin
+      fprintf(f, "# %s, %ld realisations\n# t", label[p].c_str(), total.n);
+      for (o=0 ; o<O ; o++)
+	fprintf(f, " %s", obs[o].name.c_str());
+      fprintf(f, " running");
+      for (o=0 ; o<O ; o++)
+	fprintf(f, " %s_std", obs[o].name.c_str());
+      for (o=0 ; o<O ; o++)
+	fprintf(f, " %s_q05 %s_q25 %s_q50 %s_q75 %s_q95", obs[o].name.c_str(), obs[o].name.c_str(), obs[o].name.c_str(),
+		obs[o].name.c_str(), obs[o].name.c_str());
+      fprintf(f, "\n");
+      for (j=0 ; j<G ; j++) {
+	fprintf(f, "%g", j*dt);
+	for (o=0 ; o<O ; o++)
+	  fprintf(f, " %g", total.moment[total.m(j, o)] / n / Na);
+	fprintf(f, " %g", total.running[j] / n);
+	for (o=0 ; o<O ; o++) {
+	  double mean = total.moment[total.m(j, o)] / n;
+	  fprintf(f, " %g", sqrt(std::max(0.0, total.moment[total.m(j, o)+1] / n - mean*mean)) / Na);
+	}
+	for (o=0 ; o<O ; o++) {
+	  int64_t cum = 0;
+	  for (b=0, k=0 ; k<5 ; k++) {
+	    while (b < total.bins-1 && cum + total.hist[total.h(j, o, b)] < q[k] * n)
+	      cum += total.hist[total.h(j, o, b++)];
+	    // value of bin b: exact with one bin per value, else the centre of the bin
+	    fprintf(f, " %g", ((total.bins == total.Na+1)? b : (b + 0.5) * width - 0.5) / Na);
+	  }
+	}
+	fprintf(f, "\n");
+      }
+      fprintf(f, "\n\n");
+    }
+    fclose(f);
+    return true;
+  }
+};
+
+// trajectory of the current realisation of one trial (each thread works on its own copy of the trial)
+struct trajectory_trace {
+  trajectory_recorder* rec; // NULL: not recording
+  long point;
+  trajectory_acc* acc;
+  double inv_dt;
+  int now; // grid(t) of the last event
+  uint64_t pending; // observables whose current segment began before now
+  const uint64_t* changes; // rec->changes
+  std::vector<int> since; // grid time at which the current segment of observable o began
+  std::vector<trajectory_segment> segments;
+
+  trajectory_trace(trajectory_recorder* rec_ = NULL, long point_ = 0)
+    : rec(rec_), point(point_), acc(NULL), inv_dt((rec_ != NULL)? 1.0/rec_->dt : 0.0), now(0), pending(0),
+      changes(NULL) {}
+
+  bool active() const { return rec != NULL; }
+
+  // first grid time >= t
+  int grid(double t) const {
+    double j = ceil(t * inv_dt);
+    return (j < rec->G)? (int)j : rec->G;
+  }
+
+  int value(int o, const int* x) const {
+    int v = 0;
+    for (int i=rec->comp_first[o] ; i<rec->comp_first[o+1] ; i++)
+      v += x[rec->comp[i]];
+    return v;
+  }
+
+  void begin() {
+    since.assign(rec->O, 0);
+    segments.clear();
+    now = 0;
+    pending = 0;
+    changes = &rec->changes[0];
+  }
+
+  // an ant has moved from a to b at time t; x is the state after the event. Inlined in the loop of the SSA,
+  // where GCC would otherwise call it.
+  __attribute__((always_inline)) void jumped(double t, int a, int b, const int* x) {
+    if (t * inv_dt > now) {
+      now = grid(t);
+      pending = ~(uint64_t)0;
+    }
+    const int m = a * rec->n_species + b;
+    if ((pending & changes[m]) != 0)
+      close(m, x);
+  }
+
+  // closes the segments of the pending observables changed by move m
+  void close(int m, const int* x) {
+    pending &= ~changes[m];
+    for (int i=rec->first[m] ; i<rec->first[m+1] ; i++) {
+      const trajectory_change& c = rec->change[i];
+      if (since[c.o] < now) {
+	trajectory_segment seg = {c.o, since[c.o], now, value(c.o, x) - c.delta};
+	segments.push_back(seg);
+	since[c.o] = now;
+      }
+    }
+  }
+
+  // end of the realisation at time t in state x; its segments are added if it is accepted
+  void end(double t, const int* x, bool accepted, int Na) {
+    if (!accepted)
+      return;
+    if (acc == NULL)
+      acc = rec->local(point, Na);
+    const int O = rec->O;
+    for (int o=0 ; o<O ; o++) {
+      trajectory_segment seg = {o, since[o], rec->G, value(o, x)};
+      if (seg.end > seg.begin)
+	segments.push_back(seg);
+    }
+    for (size_t i=0 ; i<segments.size() ; i++) {
+      const trajectory_segment& s = segments[i];
+      int64_t v = s.value;
+      int b = acc->bin(s.value);
+      int64_t* begin = &acc->moment[acc->m(s.begin, s.o)];
+      int64_t* end = &acc->moment[acc->m(s.end, s.o)];
+      begin[0] += v;
+      begin[1] += v*v;
+      end[0] -= v;
+      end[1] -= v*v;
+      acc->hist[acc->h(s.begin, s.o, b)]++;
+      acc->hist[acc->h(s.end, s.o, b)]--;
+    }
+    acc->running[0]++;
+    acc->running[grid(t)]--;
+    acc->n++;
+  }
+};
+
+// stopping rule that passes the events to a trajectory_trace
+template <class Cont>
+struct traced_running {
+  Cont running;
+  trajectory_trace* trace;
+  traced_running(const Cont& running_, trajectory_trace* trace_) : running(running_), trace(trace_) {}
+  bool operator()(const int* x) const { return running(x); }
+  int margin(const int* x) const { return running.margin(x); }
+  void moved(int a, int b) { ssa_moved(running, a, b, 0); }
+  __attribute__((always_inline)) void jumped(double t, int a, int b, const int* x) {
+    trace->jumped(t, a, b, x);
+    ssa_jumped(running, t, a, b, x, 0);
+  }
+};
+
+// record=<file> record_dt=1 record_tmax=100; NULL without record=
+inline trajectory_recorder* trajectory_recorder_from(const options& opt, const std::vector<trajectory_observable>& obs,
+						     int n_species, long npoints) {
+  if (!opt.has("record"))
+    return NULL;
+  double dt = opt.get("record_dt", 1.0), tmax = opt.get("record_tmax", 100.0);
+  if (dt <= 0.0 || tmax < 0.0) {
+    std::cerr << "record_dt must be positive and record_tmax non-negative" << std::endl;
+    exit(8);
+  }
+  if (obs.size() > 64) {
+    std::cerr << "record= takes at most 64 observables" << std::endl;
+    exit(8);
+  }
+  if (opt.method() != SSA_AUTO || opt.has("checkpoint")) {
+    std::cerr << "record= is available with the exact SSA only, and not with checkpoint=" << std::endl;
+    exit(8);
+  }
+  return new trajectory_recorder(dt, tmax, obs, n_species, npoints);
+}
+
+#endif // TRAJECTORY_RECORDER_H
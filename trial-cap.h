@@ -0,0 +1,74 @@
+/* Per-trial caps on the work of a realisation, for the corners of the parameter space where a few trials
+run for very long (small z, high quorum threshold, leak).
+
+With the optional arguments
+        max_events=<n> max_seconds=<s>
+a realisation is stopped after n events of the SSA (n steps, events or leaps, of the approximate methods)
+or s seconds of wall time, whichever comes first. It is then neither accepted nor discarded but counted as
+capped (trial_sums::capped, kept in the checkpoint files), and it counts towards the trials of its chunk, so
+trials= is the # accepted plus capped realisations. The drivers append the # capped realisations to every
+output line. Since the capped realisations are the longest, the mean time is then that of the trials that
+end within the cap, biased low; the # capped says by how much the distribution is cut.
+The wall-time limit makes the results depend on the machine load; max_events= alone keeps them reproducible.
+*/
+
+#ifndef TRIAL_CAP_H
+#define TRIAL_CAP_H
+
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+#include "options.h"
+#include "ssa-engine.h"
+
+struct trial_cap {
+  long max_steps; // 0: no limit
+  double max_sec; // 0: no limit
+  long left; // # steps left in the current realisation
+  std::chrono::steady_clock::time_point deadline;
+  bool hit; // the current realisation was stopped by the cap
+
+  trial_cap(long max_steps_ = 0, double max_sec_ = 0.0) : max_steps(max_steps_), max_sec(max_sec_), left(0), hit(false) {}
+
+  bool active() const { return max_steps > 0 || max_sec > 0.0; }
+
+  void start() {
+    left = (max_steps > 0)? max_steps : -1;
+    if (max_sec > 0.0)
+      deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(max_sec));
+    hit = false;
+  }
+
+  // one more step; false once the cap is reached. The clock is read every 1024 steps.
+  bool spend() {
+    if (left == 0 || ((--left & 1023) == 0 && max_sec > 0.0 && std::chrono::steady_clock::now() > deadline)) {
+      hit = true;
+      return false;
+    }
+    return true;
+  }
+};
+
+// stopping rule running with a cap: keep_going(x) of the engine is called once per step
+template <class Cont>
+struct capped_running {
+  Cont running;
+  trial_cap* cap;
+  capped_running(const Cont& running_, trial_cap* cap_) : running(running_), cap(cap_) {}
+  bool operator()(const int* x) const { return running(x) && cap->spend(); }
+  int margin(const int* x) const { return running.margin(x); }
+  void moved(int a, int b) { ssa_moved(running, a, b, 0); }
+  void jumped(double t, int a, int b, const int* x) { ssa_jumped(running, t, a, b, x, 0); }
+};
+
+// max_events= and max_seconds=
+inline trial_cap trial_cap_from(const options& opt) {
+  trial_cap cap(opt.get_long("max_events", 0), opt.get("max_seconds", 0.0));
+  if (cap.max_steps < 0 || cap.max_sec < 0.0) {
+    std::cerr << "max_events and max_seconds must be positive" << std::endl;
+    exit(8);
+  }
+  return cap;
+}
+
+#endif // TRIAL_CAP_H
@@ -0,0 +1,47 @@
+/* Converts a per-trial output file of finite-nestchoice.cc or cohesion-tradeoff.cc (output=<file>, see
+trial-output.h) to text, one line per realisation:
+        point chunk index t score winner events x[0] ... x[n_species-1]
+winner is -1 for discarded realisations. The blocks are in the order in which the chunks finished,
+so sort the lines by point and chunk (sort -n -k1,1 -k2,2 -s) for the order of the trials.
+
+Usage:
+        a.out file
+*/
+
+#include <iostream>
+using namespace std;
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include "trial-output.h"
+
+int main (int argc, char **argv) {
+
+  if (argc != 2) {
+    cerr << "trial-dump.out file" << endl;
+    exit(8);
+  }
+  FILE* f = fopen(argv[1], "rb");
+  char magic[8];
+  uint32_t version[2];
+  uint64_t seed;
+  if (f == NULL || fread(magic, 1, 8, f) != 8 || memcmp(magic, "ANTTRIAL", 8) != 0
+      || fread(version, sizeof(uint32_t), 2, f) != 2 || version[0] != 1 || fread(&seed, sizeof(uint64_t), 1, f) != 1) {
+    cerr << argv[1] << " is not a per-trial output file" << endl;
+    exit(8);
+  }
+  cerr << "seed = " << seed << endl;
+  cout.precision(17);
+
+  trial_block b;
+  while (b.read(f))
+    for (size_t i=0 ; i<b.size() ; i++) {
+      cout << b.point << " " << b.chunk << " " << i << " " << b.t[i] << " " << b.score[i] << " " << (int)b.winner[i] << " " << b.events[i];
+      for (uint32_t s=0 ; s<b.n_species ; s++)
+	cout << " " << b.x[i*b.n_species + s];
+      cout << endl;
+    }
+  fclose(f);
+  return 0;
+}
@@ -0,0 +1,342 @@
+/* Per-trial output of the stochastic drivers: a compact columnar binary file and streaming quantiles.
+
+recorded_trial wraps a trial of nest-models.h (lh_trial, nnest_trial) for trial-runner.h. It keeps the
+realisations of the current chunk, and when the runner reports the end of the chunk (chunk_done), it hands
+them to a trial_writer as one block and adds the times of the accepted realisations to the t-digest of the
+chunk in trial_quantiles. The digests of a point are merged in chunk order, so the quantiles depend on the
+seed only, like the means.
+
+File format (native byte order):
+    file header     char magic[8] = "ANTTRIAL", uint32 version = 1, uint32 0, uint64 seed
+    blocks          one per chunk, in the order in which the chunks finish:
+                    uint32 n (# realisations), uint32 n_species, uint32 point, uint32 chunk, uint32 count_bytes,
+                    then the columns
+                    double t[n]               time at which the trial stopped
+                    double score[n]           precision or cohesion, 0 if discarded
+                    int8 winner[n]            nest with the most ants (0 = good nest of the L/H model), -1 if discarded
+                    uint64 events[n]          # events of the trial
+                    x[s][n], s = 0, ..., n_species-1: final # ants in compartment s, uint16 if count_bytes = 2, uint32 if 4
+Realisation i of a block is the i-th trial of chunk "chunk" of grid point "point", simulated with the
+generator Rng::for_chunk(seed, point, chunk) of trial-runner.h, so any trial can be replayed.
+A record takes 25 + count_bytes*n_species bytes (43 for the L/H model), and the blocks are written by a
+separate thread through a bounded queue, so the simulation does not wait for the disk. trial-dump.cc converts
+a file to text.
+
+The t-digest (Dunning and Ertl, arXiv:1902.04023) keeps a few hundred weighted centroids, small ones
+near the tails, so that its quantiles are accurate to a fraction of a percent in rank without storing the trials.
+*/
+
+#ifndef TRIAL_OUTPUT_H
+#define TRIAL_OUTPUT_H
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include "trial-runner.h"
+
+// merging t-digest with the scale function k1(q) = delta/(2 pi) asin(2q - 1)
+struct tdigest {
+  double delta; // compression; about delta centroids are kept
+  std::vector<std::pair<double, double> > c; // centroids (mean, weight), sorted by mean
+  std::vector<std::pair<double, double> > buf; // values not merged yet
+  double total, lo, hi; // total weight, min and max
+
+  tdigest(double delta_ = 200) : delta(delta_), total(0.0), lo(HUGE_VAL), hi(-HUGE_VAL) {}
+
+  void add(double x, double w = 1.0) {
+    buf.push_back(std::make_pair(x, w));
+    total += w;
+    lo = std::min(lo, x);
+    hi = std::max(hi, x);
+    if (buf.size() >= (size_t)(8*delta))
+      compress();
+  }
+
+  void merge(const tdigest& o) {
+    size_t i;
+    for (i=0 ; i<o.c.size() ; i++)
+      buf.push_back(o.c[i]);
+    for (i=0 ; i<o.buf.size() ; i++)
+      buf.push_back(o.buf[i]);
+    total += o.total;
+    lo = std::min(lo, o.lo);
+    hi = std::max(hi, o.hi);
+    compress();
+  }
+
+  double k(double q) const { return delta / (2*M_PI) * asin(2*q - 1); }
+
+  void compress() {
+    if (buf.empty())
+      return;
+    std::vector<std::pair<double, double> > all(c);
+    all.insert(all.end(), buf.begin(), buf.end());
+    buf.clear();
+    std::stable_sort(all.begin(), all.end());
+    c.clear();
+    double w_left = 0.0, k_left = k(0.0); // weight before the current centroid and its k
+    std::pair<double, double> cur = all[0];
+    for (size_t i=1 ; i<all.size() ; i++) {
+      if (k(std::min(1.0, (w_left + cur.second + all[i].second) / total)) - k_left <= 1.0) {
+	cur.first += (all[i].first - cur.first) * all[i].second / (cur.second + all[i].second);
+	cur.second += all[i].second;
+      } else {
+	c.push_back(cur);
+	w_left += cur.second;
+	k_left = k(std::min(1.0, w_left / total));
+	cur = all[i];
+      }
+    }
+    c.push_back(cur);
+  }
+
+  // q-quantile, interpolating linearly between the centres of the centroids
+  double quantile(double q) {
+    compress();
+    if (c.empty())
+      return NAN;
+    double target = q * total, cum = 0.0, mid, prev_mid = 0.0, prev_mean = lo;
+    for (size_t i=0 ; i<c.size() ; i++) {
+      mid = cum + c[i].second / 2;
+      if (target < mid) {
+	if (c[i].second == 1.0 && target >= cum) // a single value
+	  return c[i].first;
+	return prev_mean + (c[i].first - prev_mean) * (target - prev_mid) / (mid - prev_mid);
+      }
+      prev_mid = mid;
+      prev_mean = c[i].first;
+      cum += c[i].second;
+    }
+    return prev_mean + (hi - prev_mean) * (target - prev_mid) / (total - prev_mid);
+  }
+};
+
+// t-digests of the chunks of every grid point, merged in chunk order when the point is emitted
+struct trial_quantiles {
+  std::vector<std::vector<tdigest> > part;
+  std::mutex mtx;
+
+  trial_quantiles(long npoints) : part(npoints) {}
+
+  void store(long p, long c, const tdigest& d) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if ((long)part[p].size() <= c)
+      part[p].resize(c+1);
+    part[p][c] = d;
+  }
+
+  tdigest merged(long p) {
+    std::lock_guard<std::mutex> lock(mtx);
+    tdigest d;
+    for (size_t c=0 ; c<part[p].size() ; c++)
+      d.merge(part[p][c]);
+    std::vector<tdigest>().swap(part[p]);
+    return d;
+  }
+};
+
+// realisations of one chunk
+struct trial_block {
+  uint32_t point, chunk, n_species;
+  std::vector<double> t, score;
+  std::vector<int8_t> winner;
+  std::vector<uint64_t> events;
+  std::vector<uint32_t> x; // compartment s of realisation i at i*n_species + s
+
+  size_t size() const { return t.size(); }
+
+  void clear() {
+    t.clear();
+    score.clear();
+    winner.clear();
+    events.clear();
+    x.clear();
+  }
+
+  // columnar encoding of the file format
+  void encode(std::vector<char>& out) const {
+    uint32_t n = (uint32_t)size(), s, i, count_bytes = 2;
+    for (i=0 ; i<x.size() ; i++)
+      if (x[i] > 0xffff)
+	count_bytes = 4;
+    uint32_t head[5] = {n, n_species, point, chunk, count_bytes};
+    out.clear();
+    out.reserve(sizeof(head) + n*(25 + count_bytes*n_species));
+    out.insert(out.end(), (const char*)head, (const char*)(head+5));
+    out.insert(out.end(), (const char*)&t[0], (const char*)(&t[0] + n));
+    out.insert(out.end(), (const char*)&score[0], (const char*)(&score[0] + n));
+    out.insert(out.end(), (const char*)&winner[0], (const char*)(&winner[0] + n));
+    out.insert(out.end(), (const char*)&events[0], (const char*)(&events[0] + n));
+    for (s=0 ; s<n_species ; s++)
+      for (i=0 ; i<n ; i++) {
+	uint32_t v32 = x[i*n_species + s];
+	uint16_t v16 = (uint16_t)v32;
+	if (count_bytes == 2)
+	  out.insert(out.end(), (const char*)&v16, (const char*)(&v16 + 1));
+	else
+	  out.insert(out.end(), (const char*)&v32, (const char*)(&v32 + 1));
+      }
+  }
+
+  // reads the next block of a file; false at the end of the file
+  bool read(FILE* f) {
+    uint32_t head[5], n, s, i, count_bytes;
+    if (fread(head, sizeof(uint32_t), 5, f) != 5)
+      return false;
+    n = head[0];
+    n_species = head[1];
+    point = head[2];
+    chunk = head[3];
+    count_bytes = head[4];
+    t.resize(n);
+    score.resize(n);
+    winner.resize(n);
+    events.resize(n);
+    x.resize((size_t)n*n_species);
+    bool ok = fread(&t[0], sizeof(double), n, f) == n && fread(&score[0], sizeof(double), n, f) == n
+      && fread(&winner[0], 1, n, f) == n && fread(&events[0], sizeof(uint64_t), n, f) == n;
+    std::vector<char> col(count_bytes*n);
+    for (s=0 ; ok && s<n_species ; s++) {
+      ok = fread(&col[0], count_bytes, n, f) == n;
+      for (i=0 ; i<n ; i++) {
+	uint16_t v16;
+	uint32_t v32;
+	if (count_bytes == 2) {
+	  memcpy(&v16, &col[2*i], 2);
+	  x[i*n_species + s] = v16;
+	} else {
+	  memcpy(&v32, &col[4*i], 4);
+	  x[i*n_species + s] = v32;
+	}
+      }
+    }
+    return ok;
+  }
+};
+
+// writes blocks to a file from a separate thread; put() waits only when max_queue blocks are pending
+struct trial_writer {
+  FILE* f;
+  std::deque<std::vector<char> > queue;
+  size_t max_queue;
+  bool closing;
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::thread thread;
+  long records;
+
+  trial_writer(const char* path, unsigned long seed, size_t max_queue_ = 256)
+    : max_queue(max_queue_), closing(false), records(0) {
+    f = fopen(path, "wb");
+    if (f == NULL) {
+      std::cerr << "cannot open " << path << std::endl;
+      exit(8);
+    }
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+    uint32_t version[2] = {1, 0};
+    uint64_t seed64 = seed;
+    fwrite("ANTTRIAL", 1, 8, f);
+    fwrite(version, sizeof(uint32_t), 2, f);
+    fwrite(&seed64, sizeof(uint64_t), 1, f);
+    thread = std::thread([this]() { drain(); });
+  }
+
+  ~trial_writer() {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      closing = true;
+    }
+    cv.notify_all();
+    thread.join();
+    fclose(f);
+  }
+
+  void put(const trial_block& b) {
+    std::vector<char> bytes;
+    b.encode(bytes);
+    std::unique_lock<std::mutex> lock(mtx);
+    while (queue.size() >= max_queue)
+      cv.wait(lock);
+    queue.push_back(std::vector<char>());
+    queue.back().swap(bytes);
+    records += b.size();
+    cv.notify_all();
+  }
+
+  void drain() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+      while (queue.empty() && !closing)
+	cv.wait(lock);
+      if (queue.empty())
+	break;
+      std::vector<char> bytes;
+      bytes.swap(queue.front());
+      queue.pop_front();
+      cv.notify_all();
+      lock.unlock();
+      fwrite(&bytes[0], 1, bytes.size(), f);
+      lock.lock();
+    }
+  }
+};
+
+/* Trial of nest-models.h with per-trial output to a trial_writer and/or quantiles of the time of the
+   accepted realisations in trial_quantiles (either may be NULL). The trial must provide engine.events,
+   the final state x, and int winner() const. */
+template <class Trial>
+struct recorded_trial {
+  Trial trial;
+  trial_writer* out;
+  trial_quantiles* quantiles;
+  trial_block block;
+  tdigest digest;
+
+  recorded_trial(const Trial& trial_, trial_writer* out_, trial_quantiles* quantiles_)
+    : trial(trial_), out(out_), quantiles(quantiles_) {
+    block.n_species = trial.engine.net.n_species;
+  }
+
+  bool capped() const { return trial_capped(trial, 0); }
+
+  template <class Rng>
+  bool operator()(Rng& rng, double& t, double& score) {
+    bool accepted = trial(rng, t, score);
+    if (accepted && quantiles != NULL)
+      digest.add(t);
+    if (out != NULL) {
+      block.t.push_back(t);
+      block.score.push_back(accepted? score : 0.0);
+      block.winner.push_back(accepted? trial.winner() : -1);
+      block.events.push_back(trial.engine.events);
+      for (uint32_t s=0 ; s<block.n_species ; s++)
+	block.x.push_back(trial.x[s]);
+    }
+    return accepted;
+  }
+};
+
+template <class Trial>
+void chunk_done(recorded_trial<Trial>& r, long p, long c) {
+  if (r.out != NULL) {
+    r.block.point = p;
+    r.block.chunk = c;
+    r.out->put(r.block);
+    r.block.clear();
+  }
+  if (r.quantiles != NULL) {
+    r.quantiles->store(p, c, r.digest);
+    r.digest = tdigest();
+  }
+}
+
+#endif // TRIAL_OUTPUT_H
@@ -0,0 +1,319 @@
+/* Parallel runner of independent stochastic trials.
+
+The trials of each grid point are divided into chunks of TRIAL_CHUNK trials. Worker threads take
+chunks in turn, and chunk c of point p is simulated with its own generator Rng::for_chunk(seed, p, c)
+(Rng = SSA_RNG by default, see rng.h). The partial sums of the chunks are reduced in chunk order, so the
+result depends on the seed only, not on the number of threads or on the scheduling.
+
+A trial is a copyable object with
+    template <class Rng> bool operator()(Rng& rng, double& t, double& score)
+which simulates one realisation and returns false if the realisation is to be discarded
+(e.g., all ants have returned to the old nest). Each thread works on its own copy.
+*/
+
+#ifndef TRIAL_RUNNER_H
+#define TRIAL_RUNNER_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cmath>
+#include "rng.h"
+#include "ssa-profile.h"
+
+#define TRIAL_CHUNK 100
+
+struct trial_sums {
+  long n; // # accepted trials
+  long rejected; // # discarded realisations
+  long capped; // # realisations stopped by the per-trial cap of trial-cap.h, not in n
+  double t, t2; // sum of the times and of their squares
+  double s, s2; // sum of the scores (precision or cohesion) and of their squares
+
+  trial_sums() : n(0), rejected(0), capped(0), t(0.0), t2(0.0), s(0.0), s2(0.0) {}
+
+  void add(double t_, double s_) {
+    n++;
+    t += t_;
+    t2 += t_*t_;
+    s += s_;
+    s2 += s_*s_;
+  }
+
+  void merge(const trial_sums& o) {
+    n += o.n;
+    rejected += o.rejected;
+    capped += o.capped;
+    t += o.t;
+    t2 += o.t2;
+    s += o.s;
+    s2 += o.s2;
+  }
+
+  double t_ave() const { return t/n; }
+  double t_std() const { return sqrt(t2/n - t_ave()*t_ave()); }
+  double s_ave() const { return s/n; }
+  double s_std() const { return sqrt(s2/n - s_ave()*s_ave()); }
+};
+
+// run trials until n accepted realisations are collected
+template <class Trial, class Rng>
+void run_chunk(Trial& trial, Rng& rng, long n, trial_sums& sums) {
+  double t, score;
+  while (sums.n < n) {
+    if (trial(rng, t, score))
+      sums.add(t, score);
+    else
+      sums.rejected++;
+  }
+}
+
+/* A multi-output trial reports each realisation for several outputs at once, e.g., the first-passage
+   times of several quorum thresholds along one trajectory:
+       int outputs() const
+       template <class Rng> void operator()(Rng& rng, trial_outcome* out)
+   Each output collects its own accepted realisations. single_output adapts an ordinary trial.
+   A realisation stopped by a per-trial cap (trial-cap.h) is not accepted and has capped set; it counts
+   towards the trials of the chunk, so that a chunk ends even if every realisation hits the cap.
+*/
+struct trial_outcome {
+  bool accepted, capped;
+  double t, score;
+};
+
+// whether the last realisation of an ordinary trial was stopped by its cap, for trials with bool capped() const
+template <class Trial>
+inline auto trial_capped(const Trial& trial, int) -> decltype(trial.capped()) { return trial.capped(); }
+template <class Trial>
+inline bool trial_capped(const Trial&, long) { return false; }
+
+template <class Trial>
+struct single_output {
+  Trial trial;
+  single_output(const Trial& trial_) : trial(trial_) {}
+  int outputs() const { return 1; }
+  template <class Rng>
+  void operator()(Rng& rng, trial_outcome* out) {
+    out->accepted = trial(rng, out->t, out->score);
+    out->capped = !out->accepted && trial_capped(trial, 0);
+  }
+};
+
+/* Called by the runner when trial has run chunk c of point p, before the results of the chunk are reduced.
+   Trials that report per-trial results (trial-output.h) overload it; the default does nothing. */
+template <class Trial>
+void chunk_done(Trial&, long, long) {}
+
+template <class Trial>
+void chunk_done(single_output<Trial>& s, long p, long c) { chunk_done(s.trial, p, c); }
+
+// run realisations until every output has n accepted (or capped) ones; complete outputs ignore the later realisations
+template <class Trial, class Rng>
+void run_chunk_outputs(Trial& trial, Rng& rng, long n, std::vector<trial_sums>& sums) {
+  int k, nout = trial.outputs();
+  std::vector<trial_outcome> out(nout);
+  sums.assign(nout, trial_sums());
+  while (true) {
+    for (k=0 ; k<nout && sums[k].n + sums[k].capped >= n ; k++)
+      ;
+    if (k == nout)
+      break;
+    trial(rng, &out[0]);
+    for (k=0 ; k<nout ; k++) {
+      if (sums[k].n + sums[k].capped >= n)
+	continue;
+      if (out[k].accepted)
+	sums[k].add(out[k].t, out[k].score);
+      else if (out[k].capped)
+	sums[k].capped++;
+      else
+	sums[k].rejected++;
+    }
+  }
+  SSA_PROF(ssa_profile_trials(sums[0].n, sums[0].rejected));
+}
+
+/* Stopping rule of the adaptive mode. The trials of a grid point are run in batches of "batch" trials,
+   and the point is finished as soon as the 95% confidence intervals are narrower than requested
+   or the maximum # trials is reached. batch=0 disables the adaptive mode.
+*/
+struct stop_rule {
+  long batch; // # trials between two checks
+  double tol; // half-width of the CI of the mean score (Wilson interval if binomial)
+  double rtol_t; // half-width of the CI of the mean time divided by the mean time
+  bool binomial; // score is 0 or 1 (precision)
+
+  stop_rule() : batch(0), tol(0.0), rtol_t(0.0), binomial(false) {}
+  stop_rule(long batch_, double tol_, double rtol_t_, bool binomial_)
+    : batch(batch_), tol(tol_), rtol_t(rtol_t_), binomial(binomial_) {}
+
+  bool adaptive() const { return batch > 0 && (tol > 0.0 || rtol_t > 0.0); }
+
+  bool done(const trial_sums& s) const {
+    const double zc = 1.96;
+    double n = (double)s.n, hw, p;
+    if (s.n < 2)
+      return false;
+    if (tol > 0.0) {
+      if (binomial) {
+	p = s.s_ave();
+	hw = zc/(1+zc*zc/n) * sqrt(p*(1-p)/n + zc*zc/(4*n*n));
+      } else
+	hw = zc * sqrt((s.s2/n - s.s_ave()*s.s_ave())/(n-1));
+      if (hw > tol)
+	return false;
+    }
+    if (rtol_t > 0.0) {
+      hw = zc * sqrt((s.t2/n - s.t_ave()*s.t_ave())/(n-1));
+      if (hw > rtol_t * s.t_ave())
+	return false;
+    }
+    return true;
+  }
+};
+
+/* Store of the partial sums of finished chunks (checkpoint.h). restore() gives the sums of a chunk that need not
+   be simulated again, save() records a simulated chunk. In a sharded sweep, only the chunks with mine(c) are
+   simulated, and the points are not emitted. stream(p, crn) is the point argument of Rng::for_chunk for the
+   chunks of point p; a store may override it to give a point generators of its own (result-cache.h). */
+struct chunk_store {
+  virtual bool sharded() const = 0;
+  virtual bool mine(long c) const = 0;
+  virtual bool restore(long p, long c, std::vector<trial_sums>& sums) = 0;
+  virtual void save(long p, long c, const std::vector<trial_sums>& sums) = 0;
+  virtual uint64_t stream(long p, long crn) const { return p / crn; }
+  virtual ~chunk_store() {}
+};
+
+/* Runs trials at each of the grid points 0, ..., npoints-1 in one pool of threads.
+   Every point gets "trials" trials, or, in the adaptive mode, batches of trials until rule.done()
+   holds, with "trials" as the maximum. The threads take chunks of the lowest-numbered points first,
+   so that they move on to the next points while the slow chunks of the current point are running.
+   make_trial(p) returns the trial of point p, and emit(p, sums) is called once per point,
+   in the order of p, as soon as points 0, ..., p are finished.
+   Whether another batch is run depends on the partial sums of the earlier chunks only, so the
+   result is still independent of the thread count.
+   With crn > 1, the blocks of crn consecutive points use common random numbers: chunk c of point p
+   has the generator of chunk c of point p/crn, so that differences between the points of a block
+   are estimated with less variance.
+
+   With a chunk_store, the chunks it holds are not simulated again, and the others are saved to it.
+
+   run_sweep_outputs does the same for multi-output trials; emit(p, sums) then receives one trial_sums
+   per output, and a point is finished in the adaptive mode when rule.done() holds for all outputs.
+*/
+template <class Rng = SSA_RNG, class Factory, class Emit>
+void run_sweep_outputs(Factory& make_trial, long npoints, long trials, unsigned long seed, int threads, Emit emit,
+		       const stop_rule& rule = stop_rule(), long crn = 1, chunk_store* store = NULL) {
+  typedef decltype(make_trial(0)) Trial;
+  const long max_chunks = (trials + TRIAL_CHUNK - 1) / TRIAL_CHUNK;
+  const long batch_chunks = rule.adaptive()? (rule.batch + TRIAL_CHUNK - 1) / TRIAL_CHUNK : max_chunks;
+  struct sweep_point {
+    long issued, done, target; // # chunks started, finished and to be run in the current batch
+    bool finished;
+    std::vector<std::vector<trial_sums> > part;
+  };
+  std::vector<sweep_point> pts(npoints);
+  std::mutex mtx;
+  std::condition_variable cv;
+  long first_open = 0; // points below first_open are finished
+  long next_emit = 0;
+
+  for (long p=0 ; p<npoints ; p++) {
+    pts[p].issued = pts[p].done = 0;
+    pts[p].target = std::min(batch_chunks, max_chunks);
+    pts[p].finished = false;
+  }
+
+  // records chunk c of point p, with the lock held, and emits the points that are finished
+  auto finish_chunk = [&](long p, long c, std::vector<trial_sums>& sums) {
+    long q;
+    if ((long)pts[p].part.size() <= c)
+      pts[p].part.resize(c+1);
+    pts[p].part[c].swap(sums);
+    if (++pts[p].done < pts[p].target)
+      return;
+    // batch finished
+    bool done = (pts[p].target == max_chunks);
+    for (size_t k=0 ; !done && k<pts[p].part[0].size() ; k++) {
+      trial_sums total;
+      for (c=0 ; c<pts[p].done ; c++)
+	total.merge(pts[p].part[c][k]);
+      done = rule.done(total);
+    }
+    if (done)
+      pts[p].finished = true;
+    else
+      pts[p].target = std::min(pts[p].target + batch_chunks, max_chunks);
+    while (next_emit < npoints && pts[next_emit].finished) {
+      q = next_emit++;
+      if (store == NULL || !store->sharded()) {
+	std::vector<trial_sums> merged(pts[q].part[0].size());
+	for (c=0 ; c<pts[q].done ; c++)
+	  for (size_t k=0 ; k<merged.size() ; k++)
+	    merged[k].merge(pts[q].part[c][k]);
+	emit(q, merged);
+      }
+      std::vector<std::vector<trial_sums> >().swap(pts[q].part);
+    }
+    cv.notify_all();
+  };
+
+  auto worker = [&]() {
+    std::unique_lock<std::mutex> lock(mtx);
+    long p, c;
+    while (true) {
+      while (first_open < npoints && pts[first_open].finished)
+	first_open++;
+      if (first_open == npoints)
+	break;
+      for (p=first_open ; p<npoints ; p++)
+	if (!pts[p].finished && pts[p].issued < pts[p].target)
+	  break;
+      if (p == npoints) { // wait until a batch is finished
+	cv.wait(lock);
+	continue;
+      }
+      c = pts[p].issued++;
+      std::vector<trial_sums> sums;
+      if (store != NULL && (store->restore(p, c, sums) || !store->mine(c))) { // restored, or left to another shard
+	finish_chunk(p, c, sums);
+	continue;
+      }
+      lock.unlock();
+
+      Trial trial = make_trial(p);
+      Rng rng = Rng::for_chunk(seed, (store != NULL)? store->stream(p, crn) : p / crn, c);
+      run_chunk_outputs(trial, rng, (c+1)*TRIAL_CHUNK <= trials? TRIAL_CHUNK : trials - c*TRIAL_CHUNK, sums);
+      chunk_done(trial, p, c);
+      if (store != NULL)
+	store->save(p, c, sums);
+
+      lock.lock();
+      finish_chunk(p, c, sums);
+    }
+    cv.notify_all();
+  };
+
+  std::vector<std::thread> pool;
+  for (int i=1 ; i<threads && i<npoints*max_chunks ; i++)
+    pool.push_back(std::thread(worker));
+  worker();
+  for (size_t i=0 ; i<pool.size() ; i++)
+    pool[i].join();
+}
+
+// run_sweep_outputs for ordinary trials, emit(p, sums) receiving the trial_sums of point p
+template <class Rng = SSA_RNG, class Factory, class Emit>
+void run_sweep(Factory& make_trial, long npoints, long trials, unsigned long seed, int threads, Emit emit,
+	       const stop_rule& rule = stop_rule(), long crn = 1, chunk_store* store = NULL) {
+  typedef decltype(make_trial(0)) Trial;
+  auto make = [&](long p) { return single_output<Trial>(make_trial(p)); };
+  auto emit_one = [&](long p, const std::vector<trial_sums>& sums) { emit(p, sums[0]); };
+  run_sweep_outputs<Rng>(make, npoints, trials, seed, threads, emit_one, rule, crn, store);
+}
+
+#endif // TRIAL_RUNNER_H